@@ -1,5 +1,9 @@
 ﻿#include <imgui/imgui.h>
 
+#include <fstream>
+
+#include "frameTimer.h"
+
 // Helper to display a little (?) mark which shows a tooltip when hovered.
 static void HelpMarker(const char* desc)
 {
@@ -12,4 +16,68 @@ static void HelpMarker(const char* desc)
         ImGui::PopTextWrapPos();
         ImGui::EndTooltip();
     }
-}
\ No newline at end of file
+}
+
+// Frame and stage times of the frames kept by a FrameTimer: min, average and 99th percentile
+// of each stage, the history of the whole frame, and buttons to save all of it.
+static void ProfilerWindow(const FrameTimer& timer, bool* open)
+{
+    if (!ImGui::Begin("Profiler", open))
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("%d frames, times in ms", (int)timer.timings.size());
+    if (ImGui::BeginTable("stages", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        const char* headers[] = { "stage", "CPU min", "CPU avg", "CPU p99", "GPU min", "GPU avg", "GPU p99" };
+        for (auto header : headers)
+            ImGui::TableSetupColumn(header);
+        ImGui::TableHeadersRow();
+        for (int stage = -1; stage < (int)timer.stages.size(); stage++)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(stage < 0 ? "frame" : timer.stages[stage].c_str());
+            for (int gpu = 0; gpu < 2; gpu++)
+            {
+                auto statistics = timer.statistics(stage, gpu != 0);
+                double values[] = { statistics.min, statistics.avg, statistics.p99 };
+                for (auto value : values)
+                {
+                    ImGui::TableNextColumn();
+                    if (statistics.count > 0)
+                        ImGui::Text("%.3f", value);
+                    else
+                        ImGui::TextDisabled("-");
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    // frames whose GPU time is not known yet show as zero
+    auto cpuTime = [](void* data, int i) { return (float)static_cast<const FrameTimer*>(data)->timings[i].cpuMs; };
+    auto gpuTime = [](void* data, int i) { return (float)std::max(static_cast<const FrameTimer*>(data)->timings[i].gpuMs, 0.0); };
+    auto data = const_cast<FrameTimer*>(&timer);
+    auto count = (int)timer.timings.size() - 1; // the last frame is still being timed
+    if (count > 0)
+    {
+        ImGui::PlotLines("CPU", cpuTime, data, count, 0, NULL, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+        ImGui::PlotLines("GPU", gpuTime, data, count, 0, NULL, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+    }
+
+    if (ImGui::Button("Save CSV"))
+    {
+        std::ofstream csv("profile.csv");
+        timer.writeCSV(csv);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save JSON"))
+    {
+        std::ofstream json("profile.json");
+        timer.writeJSON(json);
+    }
+    ImGui::End();
+}
@@ -1,6 +1,8 @@
 ﻿// --------------------------------------------------------------------------------
 // Reference: https://github.com/selfshadow/ltc_code/tree/master/fit/results
 // The fitted M matrix data for GGX BRDF material (only for specular term)
+// Source of the table files in resources/ltc (see LTC_Table_Generator), the renderer
+// loads those instead of compiling this file.
 // --------------------------------------------------------------------------------
 
 const float LTC1[] = {
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "threadPool.h"
+#include "ktx2.h"
+#include "model.h" // also stb_image
+
+// texture object
+struct TextureMap
+{
+	string name;
+	GLuint id;
+};
+
+// Startup asset pipeline.
+// Images are decoded and models imported on worker threads; the GL thread picks up the
+// results with update() and creates the GL objects, uploading pixels through a PBO.
+// Each texture can be queried on its own, so rendering starts before everything is loaded.
+// A KTX2 file next to an image (made by Texture_Converter) is used instead of the image,
+// its compressed mip chain is uploaded as it is.
+class AssetLoader
+{
+public:
+	explicit AssetLoader(size_t numThreads = 0) : pool(numThreads), pbo(0)
+	{
+	}
+
+	// queue a texture, returns its index for isReady() and texture().
+	// srgb: color data, sampled as linear values
+	size_t loadTexture(const string& path, const string& name, bool srgb = false)
+	{
+		TextureRequest request;
+		request.path = path;
+		request.map = TextureMap{ name, 0 };
+		request.image = pool.submit([path, srgb] { return decode(path, srgb); });
+		textures.push_back(std::move(request));
+		return textures.size() - 1;
+	}
+
+	// import a model on a worker, Model(future.get()) then creates it on the GL thread
+	std::shared_future<ModelData> loadModel(const string& path)
+	{
+		return pool.submit([path] { return Model::import(path); }).share();
+	}
+
+	// create the textures whose images are decoded, at most maxUploads per call to keep frames short.
+	// Returns the number of textures still pending.
+	size_t update(size_t maxUploads = std::numeric_limits<size_t>::max())
+	{
+		return process(maxUploads, false);
+	}
+
+	// wait for and upload every queued texture
+	void finish()
+	{
+		process(std::numeric_limits<size_t>::max(), true);
+	}
+
+	bool isReady(size_t index) const
+	{
+		return textures[index].done;
+	}
+
+	bool isReady(const vector<size_t>& indices) const
+	{
+		for (auto index : indices)
+			if (!isReady(index))
+				return false;
+		return true;
+	}
+
+	TextureMap texture(size_t index) const
+	{
+		return textures[index].map;
+	}
+
+	// estimated GPU memory of an uploaded texture, mipmaps included
+	size_t textureBytes(size_t index) const
+	{
+		return textures[index].bytes;
+	}
+
+	// delete an uploaded texture, its index must not be used afterwards
+	void deleteTexture(size_t index)
+	{
+		auto& request = textures[index];
+		if (request.map.id)
+			glDeleteTextures(1, &request.map.id);
+		request.map.id = 0;
+		request.bytes = 0;
+	}
+
+	void deleteBuffers()
+	{
+		if (pbo)
+			glDeleteBuffers(1, &pbo);
+		pbo = 0;
+	}
+
+private:
+	// decoded pixels, freed by stb when the last reference goes away,
+	// or the levels of a compressed texture
+	struct Image
+	{
+		GLint width = 0, height = 0, components = 0;
+		bool srgb = false;
+		std::shared_ptr<unsigned char> pixels;
+		GLenum compressedFormat = 0;
+		vector<ktx2::Level> levels;
+		size_t size = 0;
+	};
+
+	struct TextureRequest
+	{
+		string path;
+		TextureMap map;
+		std::future<Image> image;
+		size_t bytes = 0;
+		bool done = false;
+	};
+
+	ThreadPool pool;
+	vector<TextureRequest> textures;
+	GLuint pbo;
+
+	static Image decode(const string& path, bool srgb)
+	{
+		Image image;
+		image.srgb = srgb;
+		ktx2::Texture texture;
+		if (ktx2::read(path.substr(0, path.find_last_of('.')) + ".ktx2", texture))
+		{
+			image.width = texture.width;
+			image.height = texture.height;
+			image.compressedFormat = ktx2::glInternalFormat(texture.format);
+			image.levels = texture.levels;
+			image.size = texture.data.size();
+			auto data = std::make_shared<vector<unsigned char>>(std::move(texture.data));
+			image.pixels = std::shared_ptr<unsigned char>(data, data->data());
+			return image;
+		}
+		return decodeImage(path, srgb);
+	}
+
+	static Image decodeImage(const string& path, bool srgb)
+	{
+		Image image;
+		image.srgb = srgb;
+		stbi_set_flip_vertically_on_load_thread(true);
+		auto data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+		if (data)
+		{
+			image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+			image.size = (size_t)image.width * image.height * image.components;
+		}
+		return image;
+	}
+
+	size_t process(size_t maxUploads, bool wait)
+	{
+		size_t pending = 0;
+		for (auto& request : textures)
+		{
+			if (request.done)
+				continue;
+			if (maxUploads == 0 || (!wait && request.image.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+			{
+				pending++;
+				continue;
+			}
+
+			auto image = request.image.get();
+			maxUploads--;
+			if (image.pixels)
+			{
+				request.map.id = image.compressedFormat ? uploadCompressed(image) : upload(image);
+				if (!request.map.id)
+				{
+					// the driver does not support the compressed format, use the image instead
+					std::cout << "Unsupported compressed texture, loading " << request.path << std::endl;
+					auto path = request.path;
+					auto srgb = image.srgb;
+					request.image = pool.submit([path, srgb] { return decodeImage(path, srgb); });
+					pending++;
+					continue;
+				}
+				// a full mip chain adds a third to the base level
+				request.bytes = image.compressedFormat ? image.size : image.size * 4 / 3;
+			}
+			else
+				std::cout << "Texture failed to load at path: " << request.path << std::endl;
+			request.done = true;
+		}
+		return pending;
+	}
+
+	// copy the pixels into the PBO and let the driver transfer them from there.
+	// Returns the address the uploads read from: 0, the start of the PBO, or the pixels
+	// themselves with the PBO unbound when it cannot be mapped (out of memory)
+	size_t fillBuffer(const Image& image)
+	{
+		if (!pbo)
+			glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		// orphan the storage of the previous upload instead of waiting for it
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, image.size, NULL, GL_STREAM_DRAW);
+		auto mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!mapped)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return (size_t)image.pixels.get();
+		}
+		memcpy(mapped, image.pixels.get(), image.size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		return 0;
+	}
+
+	GLuint upload(const Image& image)
+	{
+		const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		const GLenum internalFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+		auto format = formats[image.components - 1];
+		auto internalFormat = internalFormats[image.components - 1];
+		if (image.srgb && image.components >= 3)
+			internalFormat = image.components == 3 ? GL_SRGB8 : GL_SRGB8_ALPHA8;
+		auto pixels = fillBuffer(image);
+
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		auto levels = 1 + (GLint)std::floor(std::log2(std::max(image.width, image.height)));
+		glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, image.width, image.height);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, (void*)pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		setSampling();
+		return textureID;
+	}
+
+	// all levels come from the file, returns 0 when the format is not supported
+	GLuint uploadCompressed(const Image& image)
+	{
+		while (glGetError() != GL_NO_ERROR);
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexStorage2D(GL_TEXTURE_2D, (GLsizei)image.levels.size(), image.compressedFormat, image.width, image.height);
+		if (glGetError() != GL_NO_ERROR)
+		{
+			glDeleteTextures(1, &textureID);
+			return 0;
+		}
+
+		auto pixels = fillBuffer(image);
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			auto& level = image.levels[i];
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, image.compressedFormat,
+				(GLsizei)level.size, (void*)(pixels + level.offset));
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		setSampling();
+		return textureID;
+	}
+
+	static void setSampling()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Benchmark scenarios: named, fully scripted headless runs.
+// A scenario fixes every input of a run (scene, lights, material, seed, time step
+// and a camera path), renders warm-up frames that are not timed, then measured
+// frames. The frame and stage times are compared against a baseline file of
+// "scenario,series,avg_ms,p99_ms" lines, so slower shaders or host code show up
+// as a failed run.
+// --------------------------------------------------------------------------------
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "camera.h"
+#include "headless.h"
+#include "frameTimer.h"
+
+// camera orbit at a time of the run, in seconds
+struct CameraKey
+{
+	GLfloat time;
+	GLfloat yaw, pitch, radius;
+};
+
+struct BenchmarkScenario
+{
+	const char* name;
+	GLint scene; // 0: scene 1, 1: scene 2
+	GLint lightType; // LightType, scene 1 only
+	GLint numSphereLights; // scene 2 only
+	GLint planeType;
+	GLint lightCulling; // LightCulling
+	bool sphereImpostors;
+	bool ripple;
+	GLfloat roughness;
+	GLuint seed;
+	GLint warmupFrames;
+	GLint measuredFrames;
+	std::vector<CameraKey> cameraPath; // sorted by time, held before the first and after the last key
+
+	// the camera linearly interpolated between the keys around time
+	void cameraAt(GLfloat time, Camera& camera) const
+	{
+		if (cameraPath.empty())
+			return;
+		auto next = std::find_if(cameraPath.begin(), cameraPath.end(), [time](const CameraKey& key) { return key.time > time; });
+		auto& a = next == cameraPath.begin() ? *next : *(next - 1);
+		auto& b = next == cameraPath.end() ? cameraPath.back() : *next;
+		auto t = b.time > a.time ? glm::clamp((time - a.time) / (b.time - a.time), 0.0f, 1.0f) : 0.0f;
+		camera.yaw = glm::mix(a.yaw, b.yaw, t);
+		camera.pitch = glm::mix(a.pitch, b.pitch, t);
+		camera.radius = glm::mix(a.radius, b.radius, t);
+		camera.updateCameraVectors();
+	}
+};
+
+inline const std::vector<BenchmarkScenario>& benchmarkScenarios()
+{
+	// one orbit around the scene in 4 seconds, dipping lower halfway
+	static const std::vector<CameraKey> closeOrbit = { { 0.0f, 90.0f, 30.0f, 6.0f }, { 2.0f, 270.0f, 15.0f, 5.0f }, { 4.0f, 450.0f, 30.0f, 6.0f } };
+	static const std::vector<CameraKey> wideOrbit = { { 0.0f, 90.0f, 30.0f, 35.0f }, { 2.0f, 270.0f, 20.0f, 25.0f }, { 4.0f, 450.0f, 30.0f, 35.0f } };
+	static const std::vector<BenchmarkScenario> scenarios = {
+		{ "scene1-rect-rough0.25", 0, 0, 0, 0, 0, false, false, 0.25f, 1, 30, 240, closeOrbit },
+		{ "scene1-cylinder-rough0.5", 0, 1, 0, 0, 0, false, false, 0.5f, 1, 30, 240, closeOrbit },
+		{ "scene1-sphere-rough0.25", 0, 3, 0, 0, 0, false, false, 0.25f, 1, 30, 240, closeOrbit },
+		{ "scene2-100-spheres-wood-ripple", 1, 0, 100, 3, 0, false, true, 0.25f, 1, 30, 240, wideOrbit },
+		{ "scene2-1k-spheres-cpu-culling", 1, 0, 1000, 0, 1, false, false, 0.25f, 1, 30, 240, wideOrbit },
+		{ "scene2-10k-spheres", 1, 0, 10000, 0, 2, true, false, 0.25f, 1, 30, 240, wideOrbit },
+	};
+	return scenarios;
+}
+
+// the scenario called name, or nullptr
+inline const BenchmarkScenario* findScenario(const std::string& name)
+{
+	for (auto& scenario : benchmarkScenarios())
+		if (name == scenario.name)
+			return &scenario;
+	return nullptr;
+}
+
+// headless run of the scenario, keeping the options it does not set such as the size and the caches
+inline void applyScenario(const BenchmarkScenario& scenario, HeadlessOptions& options)
+{
+	options.headless = true;
+	options.scene = scenario.scene;
+	options.lightType = scenario.lightType;
+	options.numSphereLights = scenario.numSphereLights;
+	options.planeType = scenario.planeType;
+	options.lightCulling = scenario.lightCulling;
+	options.sphereImpostors = scenario.sphereImpostors;
+	options.gpuAnimation = false;
+	options.seed = scenario.seed;
+	options.timeStep = 1.0f / 60.0f;
+	options.warmupFrames = scenario.warmupFrames;
+	options.frames = scenario.measuredFrames;
+}
+
+// Prints the average and 99th percentile of every series of the measured frames, next to the
+// baseline lines of the scenario when a baseline path is given.
+// A series regressed when its average or 99th percentile exceeds the baseline by more than
+// tolerance (relative), plus a small absolute slack for stages that take next to no time.
+// Series missing from the baseline are reported but do not fail. Returns false on a regression
+// or when the baseline cannot be read.
+inline bool reportBenchmark(const std::string& scenario, const FrameTimer& timer, const std::string& path, GLfloat tolerance)
+{
+	const double SLACK_MS = 0.05;
+
+	std::ifstream file;
+	if (!path.empty())
+	{
+		file.open(path);
+		if (!file)
+		{
+			std::cout << "Fail to open baseline " << path << std::endl;
+			return false;
+		}
+	}
+	struct Entry { std::string series; double avg, p99; };
+	std::vector<Entry> entries;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::stringstream fields(line);
+		std::string name, series, avg, p99;
+		if (std::getline(fields, name, ',') && name == scenario && std::getline(fields, series, ',')
+			&& std::getline(fields, avg, ',') && std::getline(fields, p99, ','))
+			entries.push_back({ series, atof(avg.c_str()), atof(p99.c_str()) });
+	}
+
+	bool passed = true;
+	std::cout << std::fixed << std::setprecision(3) << "Benchmark " << scenario << ", " << timer.timings.size() << " frames"
+		<< (path.empty() ? std::string() : ", baseline " + path) << "\n";
+	for (GLint stage = -1; stage < (GLint)timer.stages.size(); stage++)
+	{
+		for (int gpu = 0; gpu < 2; gpu++)
+		{
+			auto series = (stage < 0 ? std::string("frame") : timer.stages[stage]) + (gpu ? "_gpu" : "_cpu");
+			auto statistics = timer.statistics(stage, gpu != 0);
+			if (statistics.count == 0)
+				continue;
+			auto entry = std::find_if(entries.begin(), entries.end(), [&series](const Entry& e) { return e.series == series; });
+			std::cout << "  " << std::left << std::setw(16) << series << std::right
+				<< " avg " << std::setw(8) << statistics.avg << " p99 " << std::setw(8) << statistics.p99;
+			if (entry == entries.end())
+			{
+				std::cout << (path.empty() ? "\n" : "  (no baseline)\n");
+				continue;
+			}
+			auto regressed = statistics.avg > entry->avg * (1.0 + tolerance) + SLACK_MS || statistics.p99 > entry->p99 * (1.0 + tolerance) + SLACK_MS;
+			std::cout << "  baseline avg " << std::setw(8) << entry->avg << " p99 " << std::setw(8) << entry->p99 << (regressed ? "  REGRESSION\n" : "  ok\n");
+			passed = passed && !regressed;
+		}
+	}
+	if (!path.empty())
+		std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+// replace the baseline lines of the scenario by the measured frames, keeping the other scenarios
+inline bool updateBaseline(const std::string& path, const std::string& scenario, const FrameTimer& timer)
+{
+	std::vector<std::string> lines;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line))
+		if (!line.empty() && line.compare(0, scenario.size() + 1, scenario + ",") != 0)
+			lines.push_back(line);
+	file.close();
+
+	std::ofstream out(path);
+	if (!out)
+	{
+		std::cout << "Fail to write baseline " << path << std::endl;
+		return false;
+	}
+	for (auto& kept : lines)
+		out << kept << "\n";
+	out << std::fixed << std::setprecision(4);
+	for (GLint stage = -1; stage < (GLint)timer.stages.size(); stage++)
+	{
+		for (int gpu = 0; gpu < 2; gpu++)
+		{
+			auto statistics = timer.statistics(stage, gpu != 0);
+			if (statistics.count > 0)
+				out << scenario << "," << (stage < 0 ? std::string("frame") : timer.stages[stage]) << (gpu ? "_gpu," : "_cpu,")
+					<< statistics.avg << "," << statistics.p99 << "\n";
+		}
+	}
+	std::cout << "Baseline of " << scenario << " written to " << path << std::endl;
+	return true;
+}
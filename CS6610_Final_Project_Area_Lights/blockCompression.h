@@ -0,0 +1,380 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// CPU encoders for the block compressed texture formats used by the plane materials.
+// Every function encodes one 4x4 block given as 16 RGBA8 pixels in row order.
+//   BC1: RGB color, 4 bits per pixel
+//   BC4: one channel (red), 4 bits per pixel
+//   BC5: two channels (red, green), 8 bits per pixel, used for normal maps
+//   BC7: RGBA color, 8 bits per pixel, mode 6 only (one subset, 4-bit indices)
+// Endpoints come from the principal axis of the block colors and are refined once
+// with a least squares fit to the chosen indices.
+// --------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace bc
+{
+	// principal axis of the block colors by power iteration, returns the mean in center
+	inline void principalAxis(const uint8_t* pixels, int channels, float center[4], float axis[4])
+	{
+		for (int c = 0; c < 4; c++)
+			center[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < channels; c++)
+				center[c] += pixels[i * 4 + c] / 16.0f;
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+			for (int a = 0; a < channels; a++)
+				for (int b = 0; b < channels; b++)
+					covariance[a][b] += (pixels[i * 4 + a] - center[a]) * (pixels[i * 4 + b] - center[b]);
+
+		for (int c = 0; c < 4; c++)
+			axis[c] = c < channels ? 1.0f : 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::abs(next[a]));
+			}
+			if (length == 0.0f)
+				return; // flat block, any axis works
+			for (int c = 0; c < channels; c++)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	// endpoints at the extreme projections of the pixels on the principal axis
+	inline void axisEndpoints(const uint8_t* pixels, int channels, float e0[4], float e1[4])
+	{
+		float center[4], axis[4];
+		principalAxis(pixels, channels, center, axis);
+		float lo = 1e30f, hi = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (pixels[i * 4 + c] - center[c]) * axis[c];
+			lo = std::min(lo, t);
+			hi = std::max(hi, t);
+		}
+		float length2 = 0.0f;
+		for (int c = 0; c < channels; c++)
+			length2 += axis[c] * axis[c];
+		length2 = std::max(length2, 1e-12f);
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = center[c] + axis[c] * lo / length2;
+			e1[c] = center[c] + axis[c] * hi / length2;
+		}
+	}
+
+	// least squares endpoints for pixels interpolated with the weights t in [0, 1].
+	// Returns false when all weights are equal and the system is singular.
+	inline bool fitEndpoints(const uint8_t* pixels, int channels, const float t[16], float e0[4], float e1[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float a = 1.0f - t[i], b = t[i];
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; c++)
+			{
+				ax[c] += a * pixels[i * 4 + c];
+				bx[c] += b * pixels[i * 4 + c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::abs(det) < 1e-6f)
+			return false;
+		for (int c = 0; c < channels; c++)
+		{
+			e0[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / det));
+			e1[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / det));
+		}
+		return true;
+	}
+
+	// little endian bit packing of a 128-bit block
+	struct BitWriter
+	{
+		uint8_t* out;
+		int position = 0;
+
+		explicit BitWriter(uint8_t* out) : out(out) {}
+
+		void write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, position++)
+				if (value >> i & 1)
+					out[position >> 3] |= 1 << (position & 7);
+		}
+	};
+
+	// ----------------------------------------------------------------------------
+	// BC1
+
+	inline uint16_t packRGB565(const float color[4])
+	{
+		auto quantize = [](float v, int max) { return (int)std::min((float)max, std::max(0.0f, std::round(v * max / 255.0f))); };
+		return (uint16_t)(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+	}
+
+	inline void unpackRGB565(uint16_t packed, int color[3])
+	{
+		int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+		color[0] = r << 3 | r >> 2;
+		color[1] = g << 2 | g >> 4;
+		color[2] = b << 3 | b >> 2;
+	}
+
+	// indices for a pair of 565 endpoints in four color mode, returns the squared error
+	inline uint32_t assignBC1(const uint8_t* pixels, uint16_t c0, uint16_t c1, uint8_t indices[16])
+	{
+		int palette[4][3];
+		unpackRGB565(c0, palette[0]);
+		unpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t best = ~0u;
+			for (int j = 0; j < 4; j++)
+			{
+				uint32_t error = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = pixels[i * 4 + c] - palette[j][c];
+					error += d * d;
+				}
+				if (error < best)
+				{
+					best = error;
+					indices[i] = j;
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	inline void encodeBC1(const uint8_t pixels[64], uint8_t out[8])
+	{
+		static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		float e0[4], e1[4];
+		axisEndpoints(pixels, 3, e0, e1);
+
+		uint16_t best0 = 0, best1 = 0;
+		uint8_t bestIndices[16] = {};
+		uint32_t bestError = ~0u;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			// four color mode needs c0 > c1
+			uint16_t c0 = packRGB565(e1), c1 = packRGB565(e0);
+			if (c0 < c1)
+				std::swap(c0, c1);
+			if (c0 == c1)
+			{
+				if (pass == 0)
+				{
+					best0 = best1 = c0;
+					memset(bestIndices, 0, sizeof(bestIndices));
+				}
+				break;
+			}
+			uint8_t indices[16];
+			auto error = assignBC1(pixels, c0, c1, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best0 = c0;
+				best1 = c1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			// refit to the indices, index 0 is the c0 end
+			float t[16];
+			for (int i = 0; i < 16; i++)
+				t[i] = 1.0f - weights[indices[i]];
+			if (!fitEndpoints(pixels, 3, t, e0, e1))
+				break;
+		}
+
+		memcpy(out, &best0, 2);
+		memcpy(out + 2, &best1, 2);
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint32_t)bestIndices[i] << (2 * i);
+		memcpy(out + 4, &bits, 4);
+	}
+
+	// ----------------------------------------------------------------------------
+	// BC4 and BC5
+
+	// one channel of the block, in eight value mode between its min and max
+	inline void encodeBC4(const uint8_t pixels[64], int channel, uint8_t out[8])
+	{
+		int lo = 255, hi = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			lo = std::min<int>(lo, pixels[i * 4 + channel]);
+			hi = std::max<int>(hi, pixels[i * 4 + channel]);
+		}
+		memset(out, 0, 8);
+		out[0] = (uint8_t)hi;
+		out[1] = (uint8_t)lo;
+		if (hi == lo)
+			return;
+
+		int palette[8] = { hi, lo };
+		for (int j = 2; j < 8; j++)
+			palette[j] = ((8 - j) * hi + (j - 1) * lo) / 7;
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 256;
+			for (int j = 0; j < 8; j++)
+			{
+				int error = std::abs(pixels[i * 4 + channel] - palette[j]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = j;
+				}
+			}
+			bits |= (uint64_t)best << (3 * i);
+		}
+		for (int b = 0; b < 6; b++)
+			out[2 + b] = (uint8_t)(bits >> (8 * b));
+	}
+
+	inline void encodeBC4(const uint8_t pixels[64], uint8_t out[8])
+	{
+		encodeBC4(pixels, 0, out);
+	}
+
+	inline void encodeBC5(const uint8_t pixels[64], uint8_t out[16])
+	{
+		encodeBC4(pixels, 0, out);
+		encodeBC4(pixels, 1, out + 8);
+	}
+
+	// ----------------------------------------------------------------------------
+	// BC7 mode 6: 7-bit RGBA endpoints with a shared low bit each, 16 interpolated values
+
+	static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// quantize the endpoints with the given low bits, returns the squared error of the best indices
+	inline uint32_t assignBC7Mode6(const uint8_t* pixels, const float e0[4], const float e1[4], int p0, int p1,
+		int q0[4], int q1[4], uint8_t indices[16])
+	{
+		int end0[4], end1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = std::min(127, std::max(0, (int)std::round((e0[c] - p0) / 2.0f)));
+			q1[c] = std::min(127, std::max(0, (int)std::round((e1[c] - p1) / 2.0f)));
+			end0[c] = q0[c] << 1 | p0;
+			end1[c] = q1[c] << 1 | p1;
+		}
+		int palette[16][4];
+		for (int j = 0; j < 16; j++)
+			for (int c = 0; c < 4; c++)
+				palette[j][c] = ((64 - BC7_WEIGHTS4[j]) * end0[c] + BC7_WEIGHTS4[j] * end1[c] + 32) >> 6;
+
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t best = ~0u;
+			for (int j = 0; j < 16; j++)
+			{
+				uint32_t error = 0;
+				for (int c = 0; c < 4; c++)
+				{
+					int d = pixels[i * 4 + c] - palette[j][c];
+					error += d * d;
+				}
+				if (error < best)
+				{
+					best = error;
+					indices[i] = j;
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	inline void encodeBC7(const uint8_t pixels[64], uint8_t out[16])
+	{
+		float e0[4], e1[4];
+		axisEndpoints(pixels, 4, e0, e1);
+
+		int best0[4] = {}, best1[4] = {}, bestP0 = 0, bestP1 = 0;
+		uint8_t bestIndices[16] = {};
+		uint32_t bestError = ~0u;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (int p = 0; p < 4; p++)
+			{
+				int q0[4], q1[4];
+				uint8_t indices[16];
+				auto error = assignBC7Mode6(pixels, e0, e1, p & 1, p >> 1, q0, q1, indices);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestP0 = p & 1;
+					bestP1 = p >> 1;
+					memcpy(best0, q0, sizeof(q0));
+					memcpy(best1, q1, sizeof(q1));
+					memcpy(bestIndices, indices, sizeof(indices));
+				}
+			}
+			if (bestError == 0)
+				break;
+
+			float t[16];
+			for (int i = 0; i < 16; i++)
+				t[i] = BC7_WEIGHTS4[bestIndices[i]] / 64.0f;
+			if (!fitEndpoints(pixels, 4, t, e0, e1))
+				break;
+		}
+
+		// the first index is stored without its high bit, swap the endpoints when it is set
+		if (bestIndices[0] & 8)
+		{
+			std::swap(best0, best1);
+			std::swap(bestP0, bestP1);
+			for (int i = 0; i < 16; i++)
+				bestIndices[i] = 15 - bestIndices[i];
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer(out);
+		writer.write(1 << 6, 7); // mode 6
+		for (int c = 0; c < 4; c++)
+		{
+			writer.write(best0[c], 7);
+			writer.write(best1[c], 7);
+		}
+		writer.write(bestP0, 1);
+		writer.write(bestP1, 1);
+		writer.write(bestIndices[0], 3);
+		for (int i = 1; i < 16; i++)
+			writer.write(bestIndices[i], 4);
+	}
+}
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "shader.h"
+#include "lightBuffer.h"
+
+enum class LightCulling
+{
+	None,
+	ClusteredCPU,
+	ClusteredGPU
+};
+
+// uniforms a program needs to find the cluster of a view-space position, resolved once per program
+struct ClusterUniforms
+{
+	Uniform tileSize, sliceScale, sliceBias;
+
+	ClusterUniforms() = default;
+	explicit ClusterUniforms(const Shader& shader)
+		: tileSize(shader.uniform("clusterTileSize")), sliceScale(shader.uniform("clusterSliceScale")),
+		sliceBias(shader.uniform("clusterSliceBias"))
+	{
+	}
+};
+
+// Clustered forward light assignment.
+// The view frustum is split into GRID_X * GRID_Y screen tiles and GRID_Z exponential depth slices.
+// Each cluster gets the list of lights whose bounds overlap it, so the fragment shader only
+// loops over the lights that can reach it. Lights are read from the LightBuffer records.
+class ClusteredLights
+{
+public:
+	static const GLuint GRID_X = 16;
+	static const GLuint GRID_Y = 9;
+	static const GLuint GRID_Z = 24;
+	static const GLuint NUM_CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+	static constexpr GLfloat TILE_EPSILON = 0.01f; // padding of the projected bounds, in tiles
+
+	// binding points, binding 0 is the light buffer
+	static const GLuint GRID_BINDING = 1;
+	static const GLuint INDEX_BINDING = 2;
+	static const GLuint COUNTER_BINDING = 3;
+	static const GLuint BOUNDS_BINDING = 7; // after the LightAnimation buffers
+	static const GLuint BOUNDS_STRIDE = 80; // std430 size of ClusterLight in clusterBounds.comp
+
+	static const GLint NUM_FRAMES = 4; // frames in flight, each reads back its index total later
+	static const GLuint MIN_INDEX_CAPACITY = NUM_CLUSTERS * 8; // before any total has been read back
+
+	GLuint gridSSBO, indexSSBO, counterSSBO, boundsSSBO, totalsBuffer;
+	Shader boundsShader, buildShader;
+
+	ClusteredLights() : boundsShader("clusterBounds.comp"), buildShader("clusterBuild.comp"), zNear(0.0f), zFar(0.0f),
+		indexCapacity(0), indexTotal(0), boundsCapacity(0), frame(0), boundsUniforms(boundsShader), buildUniforms(buildShader)
+	{
+		glGenBuffers(1, &gridSSBO);
+		glGenBuffers(1, &indexSSBO);
+		glGenBuffers(1, &counterSSBO);
+		glGenBuffers(1, &boundsSSBO);
+		glGenBuffers(1, &totalsBuffer);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::uvec2) * NUM_CLUSTERS, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Counter), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		// the counter of each frame in flight is copied here and read through a persistent mapping
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, totalsBuffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, sizeof(Counter) * NUM_FRAMES, NULL, flags);
+		totals = (const Counter*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, sizeof(Counter) * NUM_FRAMES, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		std::fill(fences, fences + NUM_FRAMES, (GLsync)0);
+
+		clusterGrid.resize(NUM_CLUSTERS);
+		clusterMin.resize(NUM_CLUSTERS);
+		clusterMax.resize(NUM_CLUSTERS);
+	}
+
+	// rebuild the view-space cluster boxes when the projection changes
+	void setup(const glm::mat4& projection)
+	{
+		if (projection == this->projection)
+			return;
+		this->projection = projection;
+		invProjection = glm::inverse(projection);
+
+		// recover the clip planes from the perspective matrix
+		zNear = projection[3][2] / (projection[2][2] - 1.0f);
+		zFar = projection[3][2] / (projection[2][2] + 1.0f);
+
+		for (GLuint z = 0; z < GRID_Z; z++)
+		{
+			GLfloat sliceNear = sliceDepth(z);
+			GLfloat sliceFar = sliceDepth(z + 1);
+			for (GLuint y = 0; y < GRID_Y; y++)
+			{
+				for (GLuint x = 0; x < GRID_X; x++)
+				{
+					glm::vec3 minPos(std::numeric_limits<GLfloat>::max());
+					glm::vec3 maxPos(-std::numeric_limits<GLfloat>::max());
+					for (int corner = 0; corner < 4; corner++)
+					{
+						// view ray through the tile corner, scaled to z = -1
+						GLfloat ndcX = 2.0f * (x + (corner & 1)) / GRID_X - 1.0f;
+						GLfloat ndcY = 2.0f * (y + (corner >> 1)) / GRID_Y - 1.0f;
+						glm::vec4 p = invProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+						glm::vec3 ray = glm::vec3(p) / -p.z;
+
+						minPos = glm::min(minPos, glm::min(ray * sliceNear, ray * sliceFar));
+						maxPos = glm::max(maxPos, glm::max(ray * sliceNear, ray * sliceFar));
+					}
+					clusterMin[clusterIndex(x, y, z)] = minPos;
+					clusterMax[clusterIndex(x, y, z)] = maxPos;
+				}
+			}
+		}
+	}
+
+	// assign lights to clusters on the CPU and upload the lists
+	void buildCPU(const LightBuffer& lightBuffer, const glm::mat4& view)
+	{
+		std::fill(clusterGrid.begin(), clusterGrid.end(), glm::uvec2(0));
+		pairs.clear();
+
+		for (GLuint i = 0; i < lightBuffer.bounds.size(); i++)
+		{
+			const LightBounds& bounds = lightBuffer.bounds[i];
+
+			// move the bounding volume to view space
+			glm::vec3 segment0 = glm::vec3(view * glm::vec4(bounds.segment[0], 1.0f));
+			glm::vec3 segment1 = glm::vec3(view * glm::vec4(bounds.segment[1], 1.0f));
+			glm::vec3 center = glm::vec3(view * glm::vec4(bounds.center, 1.0f));
+			glm::vec3 axes[3];
+			for (int k = 0; k < 3; k++)
+				axes[k] = glm::mat3(view) * bounds.axes[k];
+
+			// depth range of the ellipsoid
+			GLfloat extentZ = sqrt(axes[0].z * axes[0].z + axes[1].z * axes[1].z + axes[2].z * axes[2].z);
+			GLfloat depthMin = -center.z - extentZ;
+			GLfloat depthMax = -center.z + extentZ;
+			if (depthMax < zNear || depthMin > zFar)
+				continue;
+			GLuint z0 = depthSlice(depthMin);
+			GLuint z1 = depthSlice(depthMax);
+
+			// tiles covered by the projected ellipsoid
+			glm::ivec4 tiles(0, 0, GRID_X - 1, GRID_Y - 1);
+			if (depthMin > zNear)
+			{
+				// pad by a fraction of a tile, rounding may only add lights to a cluster
+				glm::vec4 rect = projectEllipsoid(center, axes);
+				tiles.x = std::max(0, (int)floor((rect.x * 0.5f + 0.5f) * GRID_X - TILE_EPSILON));
+				tiles.y = std::max(0, (int)floor((rect.y * 0.5f + 0.5f) * GRID_Y - TILE_EPSILON));
+				tiles.z = std::min((int)GRID_X - 1, (int)floor((rect.z * 0.5f + 0.5f) * GRID_X + TILE_EPSILON));
+				tiles.w = std::min((int)GRID_Y - 1, (int)floor((rect.w * 0.5f + 0.5f) * GRID_Y + TILE_EPSILON));
+			}
+
+			for (GLuint z = z0; z <= z1; z++)
+			{
+				for (int y = tiles.y; y <= tiles.w; y++)
+				{
+					for (int x = tiles.x; x <= tiles.z; x++)
+					{
+						GLuint cluster = clusterIndex(x, y, z);
+						if (capsuleIntersectsBox(segment0, segment1, bounds.radius, clusterMin[cluster], clusterMax[cluster]))
+						{
+							pairs.push_back(glm::uvec2(cluster, i));
+							clusterGrid[cluster].y++;
+						}
+					}
+				}
+			}
+		}
+
+		// prefix sum of the counts gives the list offsets
+		GLuint offset = 0;
+		for (auto& cluster : clusterGrid)
+		{
+			cluster.x = offset;
+			offset += cluster.y;
+			cluster.y = 0;
+		}
+		lightIndices.resize(std::max<size_t>(pairs.size(), 1));
+		for (const auto& pair : pairs)
+		{
+			auto& cluster = clusterGrid[pair.x];
+			lightIndices[cluster.x + cluster.y++] = pair.y;
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(glm::uvec2) * NUM_CLUSTERS, clusterGrid.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * lightIndices.size(), lightIndices.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		indexCapacity = 0;
+	}
+
+	// assign lights to clusters with the compute shaders.
+	// clusterBounds.comp moves the bounds of each light to view space and projects them once,
+	// then clusterBuild.comp runs one invocation per cluster over those bounds. A count pass
+	// reserves the range of each cluster's list, then a second pass writes the lists.
+	// The index buffer is sized from the totals of earlier frames, which are read back once
+	// their fences have passed, so the CPU never waits for the GPU. Lists that do not fit are
+	// cut and the counter is flagged; the buffer grows when that frame's total arrives.
+	void buildGPU(const LightBuffer& lightBuffer, const glm::mat4& view)
+	{
+		readTotals();
+		if (indexCapacity == 0)
+			resizeIndices(std::max(indexTotal + indexTotal / 2, MIN_INDEX_CAPACITY));
+
+		Counter counter = { 0, 0 };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Counter), &counter);
+		if (boundsCapacity < (GLuint)std::max(lightBuffer.size(), 1))
+		{
+			boundsCapacity = (GLuint)std::max(lightBuffer.size(), 1);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsSSBO);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, BOUNDS_STRIDE * boundsCapacity, NULL, GL_DYNAMIC_DRAW);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		lightBuffer.bind(0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, boundsSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_BINDING, gridSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, counterSSBO);
+
+		boundsShader.use();
+		boundsUniforms.view.set(view);
+		boundsUniforms.projection.set(projection);
+		boundsUniforms.zNear.set(zNear);
+		boundsUniforms.numLights.set(lightBuffer.size());
+		setSliceUniforms(boundsUniforms.slices);
+		glDispatchCompute((lightBuffer.size() + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		buildShader.use();
+		buildUniforms.invProjection.set(invProjection);
+		buildUniforms.numLights.set(lightBuffer.size());
+		buildUniforms.indexCapacity.set(indexCapacity);
+		setSliceUniforms(buildUniforms.slices);
+		buildUniforms.countPass.set(true);
+		glDispatchCompute((NUM_CLUSTERS + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// keep the total for a later frame, a slot whose fence has not passed yet is dropped
+		auto slot = frame++ % NUM_FRAMES;
+		if (fences[slot])
+			glDeleteSync(fences[slot]);
+		glBindBuffer(GL_COPY_READ_BUFFER, counterSSBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, totalsBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(Counter) * slot, sizeof(Counter));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		bind();
+		buildUniforms.countPass.set(false);
+		glDispatchCompute((NUM_CLUSTERS + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void bind() const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_BINDING, gridSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, indexSSBO);
+	}
+
+	// uniforms the shading pass needs to find its cluster
+	void setUniforms(ClusterUniforms& uniforms, GLuint width, GLuint height) const
+	{
+		uniforms.tileSize.set(glm::vec2((GLfloat)width / GRID_X, (GLfloat)height / GRID_Y));
+		setSliceUniforms(uniforms);
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteBuffers(1, &gridSSBO);
+		glDeleteBuffers(1, &indexSSBO);
+		glDeleteBuffers(1, &counterSSBO);
+		glDeleteBuffers(1, &boundsSSBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, totalsBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &totalsBuffer);
+		for (auto& fence : fences)
+			if (fence)
+				glDeleteSync(fence);
+		boundsShader.deleteProgram();
+		buildShader.deleteProgram();
+	}
+
+private:
+	// uniforms of boundsShader and buildShader, each uses some of them
+	struct BuildUniforms
+	{
+		ClusterUniforms slices;
+		Uniform view, projection, invProjection, zNear, numLights, countPass, indexCapacity;
+
+		explicit BuildUniforms(const Shader& shader)
+			: slices(shader), view(shader.uniform("view")), projection(shader.uniform("projection")),
+			invProjection(shader.uniform("invProjection")), zNear(shader.uniform("zNear")),
+			numLights(shader.uniform("numLights")), countPass(shader.uniform("countPass")),
+			indexCapacity(shader.uniform("indexCapacity"))
+		{
+		}
+	};
+
+	// mirrors ClusterCounter in clusterBuild.comp
+	struct Counter
+	{
+		GLuint indexCount; // indices the lists need, also when they did not fit
+		GLuint overflow; // set when lists were cut
+	};
+
+	glm::mat4 projection;
+	glm::mat4 invProjection;
+	GLfloat zNear, zFar;
+	GLuint indexCapacity, indexTotal, boundsCapacity;
+	GLint frame;
+	const Counter* totals; // persistent mapping of totalsBuffer, one counter per frame in flight
+	GLsync fences[NUM_FRAMES];
+	BuildUniforms boundsUniforms, buildUniforms;
+
+	std::vector<glm::vec3> clusterMin, clusterMax; // view-space cluster boxes
+	std::vector<glm::uvec2> clusterGrid; // x: offset, y: count
+	std::vector<glm::uvec2> pairs; // x: cluster, y: light
+	std::vector<GLuint> lightIndices;
+
+	// pick up the totals of the frames whose fences have passed, without waiting for the others,
+	// and grow the index buffer by half again when lists were cut
+	void readTotals()
+	{
+		for (GLint slot = 0; slot < NUM_FRAMES; slot++)
+		{
+			if (!fences[slot] || glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+				continue;
+			glDeleteSync(fences[slot]);
+			fences[slot] = 0;
+			indexTotal = totals[slot].indexCount;
+			if (totals[slot].overflow && indexCapacity > 0 && indexTotal > indexCapacity)
+				resizeIndices(indexTotal + indexTotal / 2);
+		}
+	}
+
+	void resizeIndices(GLuint capacity)
+	{
+		indexCapacity = capacity;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * indexCapacity, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	GLuint clusterIndex(GLuint x, GLuint y, GLuint z) const
+	{
+		return x + GRID_X * (y + GRID_Y * z);
+	}
+
+	// depth of the near boundary of slice z, slices are spaced exponentially
+	GLfloat sliceDepth(GLuint z) const
+	{
+		return zNear * pow(zFar / zNear, (GLfloat)z / GRID_Z);
+	}
+
+	GLuint depthSlice(GLfloat depth) const
+	{
+		GLfloat slice = log(std::max(depth, zNear) / zNear) / log(zFar / zNear) * GRID_Z;
+		return std::min((GLuint)std::max(slice, 0.0f), GRID_Z - 1);
+	}
+
+	// slice = log(depth) * scale + bias
+	void setSliceUniforms(ClusterUniforms& uniforms) const
+	{
+		GLfloat scale = GRID_Z / log(zFar / zNear);
+		uniforms.sliceScale.set(scale);
+		uniforms.sliceBias.set(-log(zNear) * scale);
+	}
+
+	// NDC rectangle (minX, minY, maxX, maxY) of a view-space ellipsoid in front of the camera.
+	// The silhouette planes are tangent to the dual quadric P * T * diag(1, 1, 1, -1) * T^T * P^T,
+	// where T maps the unit sphere to the ellipsoid.
+	glm::vec4 projectEllipsoid(const glm::vec3& center, const glm::vec3 axes[3]) const
+	{
+		glm::mat4 T(glm::vec4(axes[0], 0.0f), glm::vec4(axes[1], 0.0f), glm::vec4(axes[2], 0.0f), glm::vec4(center, 1.0f));
+		glm::mat4 M = projection * T;
+
+		// rows of M
+		glm::vec4 r0(M[0][0], M[1][0], M[2][0], M[3][0]);
+		glm::vec4 r1(M[0][1], M[1][1], M[2][1], M[3][1]);
+		glm::vec4 r3(M[0][3], M[1][3], M[2][3], M[3][3]);
+		auto dual = [](const glm::vec4& a, const glm::vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z - a.w * b.w; };
+
+		GLfloat q33 = dual(r3, r3);
+		GLfloat q03 = dual(r0, r3), q00 = dual(r0, r0);
+		GLfloat q13 = dual(r1, r3), q11 = dual(r1, r1);
+		GLfloat dx = sqrt(std::max(q03 * q03 - q00 * q33, 0.0f));
+		GLfloat dy = sqrt(std::max(q13 * q13 - q11 * q33, 0.0f));
+
+		glm::vec4 rect((q03 + dx) / q33, (q13 + dy) / q33, (q03 - dx) / q33, (q13 - dy) / q33);
+		return glm::vec4(std::min(rect.x, rect.z), std::min(rect.y, rect.w), std::max(rect.x, rect.z), std::max(rect.y, rect.w));
+	}
+
+	static GLfloat distanceToBox2(const glm::vec3& p, const glm::vec3& minPos, const glm::vec3& maxPos)
+	{
+		glm::vec3 d = glm::max(glm::max(minPos - p, p - maxPos), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+
+	// The squared distance from the segment to the box is convex along the segment,
+	// so a golden section search finds its minimum.
+	static bool capsuleIntersectsBox(const glm::vec3& p0, const glm::vec3& p1, GLfloat radius, const glm::vec3& minPos, const glm::vec3& maxPos)
+	{
+		GLfloat radius2 = radius * radius * 1.0001f;
+		if (p0 == p1)
+			return distanceToBox2(p0, minPos, maxPos) <= radius2;
+
+		const GLfloat ratio = 0.618034f;
+		GLfloat a = 0.0f, b = 1.0f;
+		GLfloat c = b - ratio * (b - a), d = a + ratio * (b - a);
+		GLfloat fc = distanceToBox2(glm::mix(p0, p1, c), minPos, maxPos);
+		GLfloat fd = distanceToBox2(glm::mix(p0, p1, d), minPos, maxPos);
+		for (int i = 0; i < 24; i++)
+		{
+			if (fc <= radius2 || fd <= radius2)
+				return true;
+			if (fc < fd)
+			{
+				b = d; d = c; fd = fc;
+				c = b - ratio * (b - a);
+				fc = distanceToBox2(glm::mix(p0, p1, c), minPos, maxPos);
+			}
+			else
+			{
+				a = c; c = d; fc = fd;
+				d = a + ratio * (b - a);
+				fd = distanceToBox2(glm::mix(p0, p1, d), minPos, maxPos);
+			}
+		}
+		return std::min(fc, fd) <= radius2 ||
+			distanceToBox2(p0, minPos, maxPos) <= radius2 || distanceToBox2(p1, minPos, maxPos) <= radius2;
+	}
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <iomanip>
+
+// Per-frame CPU and GPU times, in total and per named stage.
+// A stage is timed by a Scope: the CPU time with a high resolution clock, the GPU time with a
+// GL_TIME_ELAPSED query. The queries come from a ring that holds the frames in flight, so reading
+// a result never waits for a frame that the GPU is still working on.
+// Only one GL_TIME_ELAPSED query can be active, so stages must not overlap; a stage can be
+// entered several times per frame and then adds up.
+class FrameTimer
+{
+public:
+	static const GLint NUM_FRAMES = 4; // frames in flight
+	static const GLint MAX_STAGES = 16;
+	static const GLint MAX_SCOPES = 32; // scopes with a GPU query per frame
+
+	struct Timing
+	{
+		GLint frame;
+		double cpuMs; // negative until end()
+		double gpuMs; // sum of the stages, negative until all query results arrived
+		double stageCpuMs[MAX_STAGES]; // negative for stages the frame did not enter
+		double stageGpuMs[MAX_STAGES];
+	};
+	std::vector<Timing> timings;
+	std::vector<std::string> stages; // stage names in order of first use
+
+	struct Statistics
+	{
+		double min, avg, p99;
+		size_t count; // frames the series has a value for
+	};
+
+	// times the stage name from construction to destruction
+	class Scope
+	{
+	public:
+		Scope(FrameTimer& timer, const char* name) : timer(timer)
+		{
+			timer.beginStage(name);
+		}
+		~Scope()
+		{
+			timer.endStage();
+		}
+
+	private:
+		FrameTimer& timer;
+	};
+
+	// historySize: number of frames to keep, 0 keeps all of them
+	explicit FrameTimer(size_t historySize = 0) : historySize(historySize), current(-1), stage(-1), query(false)
+	{
+		glGenQueries(NUM_FRAMES * MAX_SCOPES, &queries[0][0]);
+		for (GLint slot = 0; slot < NUM_FRAMES; slot++)
+		{
+			pending[slot] = -1;
+			numScopes[slot] = 0;
+		}
+	}
+
+	// start timing a frame, call end() after its last stage
+	void begin()
+	{
+		current++;
+		auto slot = current % NUM_FRAMES;
+		if (pending[slot] >= 0)
+			resolve(slot, true);
+
+		if (historySize > 0 && timings.size() >= 2 * historySize)
+			timings.erase(timings.begin(), timings.begin() + historySize);
+		Timing timing;
+		timing.frame = current;
+		timing.cpuMs = -1.0;
+		timing.gpuMs = -1.0;
+		std::fill(timing.stageCpuMs, timing.stageCpuMs + MAX_STAGES, -1.0);
+		std::fill(timing.stageGpuMs, timing.stageGpuMs + MAX_STAGES, -1.0);
+		timings.push_back(timing);
+		pending[slot] = current;
+		numScopes[slot] = 0;
+		start = std::chrono::high_resolution_clock::now();
+	}
+
+	void end()
+	{
+		timings.back().cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// pick up every result that is already available
+		for (GLint slot = 0; slot < NUM_FRAMES; slot++)
+			if (pending[slot] >= 0)
+				resolve(slot, false);
+	}
+
+	void beginStage(const char* name)
+	{
+		if (timings.empty() || stage >= 0)
+			return;
+		stage = stageIndex(name);
+		if (stage < 0)
+			return;
+		auto slot = current % NUM_FRAMES;
+		query = numScopes[slot] < MAX_SCOPES;
+		if (query)
+		{
+			scopeStages[slot][numScopes[slot]] = stage;
+			glBeginQuery(GL_TIME_ELAPSED, queries[slot][numScopes[slot]]);
+		}
+		stageStart = std::chrono::high_resolution_clock::now();
+	}
+
+	void endStage()
+	{
+		if (stage < 0)
+			return;
+		if (query)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			numScopes[current % NUM_FRAMES]++;
+		}
+		auto& cpuMs = timings.back().stageCpuMs[stage];
+		cpuMs = std::max(cpuMs, 0.0) + std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stageStart).count();
+		stage = -1;
+	}
+
+	// wait for all outstanding queries
+	void finish()
+	{
+		for (GLint slot = 0; slot < NUM_FRAMES; slot++)
+			if (pending[slot] >= 0)
+				resolve(slot, true);
+	}
+
+	// drop the frames timed so far, e.g. the warm-up frames of a benchmark
+	void reset()
+	{
+		finish();
+		timings.clear();
+	}
+
+	// latest frame with both times known
+	const Timing* latest() const
+	{
+		for (auto it = timings.rbegin(); it != timings.rend(); ++it)
+			if (it->gpuMs >= 0.0)
+				return &*it;
+		return nullptr;
+	}
+
+	// min, average and 99th percentile over the kept, finished frames of stage index, or of the whole frame for -1
+	Statistics statistics(GLint index, bool gpu) const
+	{
+		values.clear();
+		for (auto& timing : timings)
+		{
+			auto value = index < 0 ? (gpu ? timing.gpuMs : timing.cpuMs) : (gpu ? timing.stageGpuMs[index] : timing.stageCpuMs[index]);
+			if (value >= 0.0 && timing.cpuMs >= 0.0)
+				values.push_back(value);
+		}
+		Statistics result = { 0.0, 0.0, 0.0, values.size() };
+		if (values.empty())
+			return result;
+		std::sort(values.begin(), values.end());
+		result.min = values.front();
+		for (auto value : values)
+			result.avg += value;
+		result.avg /= values.size();
+		result.p99 = values[std::min(values.size() - 1, (size_t)std::ceil(0.99 * values.size()) - 1)];
+		return result;
+	}
+
+	void writeCSV(std::ostream& out) const
+	{
+		out << "frame,cpu_ms,gpu_ms";
+		for (auto& name : stages)
+			out << "," << name << "_cpu_ms," << name << "_gpu_ms";
+		out << "\n" << std::fixed << std::setprecision(4);
+		for (auto& timing : timings)
+		{
+			if (timing.cpuMs < 0.0)
+				continue;
+			out << timing.frame << "," << timing.cpuMs << ",";
+			if (timing.gpuMs >= 0.0)
+				out << timing.gpuMs;
+			for (size_t i = 0; i < stages.size(); i++)
+			{
+				out << ",";
+				if (timing.stageCpuMs[i] >= 0.0)
+					out << timing.stageCpuMs[i];
+				out << ",";
+				if (timing.stageGpuMs[i] >= 0.0)
+					out << timing.stageGpuMs[i];
+			}
+			out << "\n";
+		}
+	}
+
+	// the statistics of the frame and of every stage, followed by the per-frame times.
+	// Both writers skip a frame that is still being timed.
+	void writeJSON(std::ostream& out) const
+	{
+		auto number = [&out](double value)
+		{
+			if (value >= 0.0)
+				out << value;
+			else
+				out << "null";
+		};
+		auto summary = [&](const char* name, GLint index)
+		{
+			out << "    \"" << name << "\": {";
+			for (int gpu = 0; gpu < 2; gpu++)
+			{
+				auto s = statistics(index, gpu != 0);
+				out << (gpu ? ", \"gpu_ms\": " : " \"cpu_ms\": ") << "{ \"min\": " << s.min << ", \"avg\": " << s.avg
+					<< ", \"p99\": " << s.p99 << ", \"count\": " << s.count << " }";
+			}
+			out << " }";
+		};
+
+		out << std::fixed << std::setprecision(4) << "{\n  \"summary\": {\n";
+		summary("frame", -1);
+		for (size_t i = 0; i < stages.size(); i++)
+		{
+			out << ",\n";
+			summary(stages[i].c_str(), (GLint)i);
+		}
+		out << "\n  },\n  \"frames\": [";
+		auto first = true;
+		for (auto& timing : timings)
+		{
+			if (timing.cpuMs < 0.0)
+				continue;
+			out << (first ? "\n" : ",\n") << "    { \"frame\": " << timing.frame << ", \"cpu_ms\": ";
+			number(timing.cpuMs);
+			out << ", \"gpu_ms\": ";
+			number(timing.gpuMs);
+			for (size_t i = 0; i < stages.size(); i++)
+			{
+				out << ", \"" << stages[i] << "\": [";
+				number(timing.stageCpuMs[i]);
+				out << ", ";
+				number(timing.stageGpuMs[i]);
+				out << "]";
+			}
+			out << " }";
+			first = false;
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void deleteQueries()
+	{
+		glDeleteQueries(NUM_FRAMES * MAX_SCOPES, &queries[0][0]);
+	}
+
+private:
+	size_t historySize;
+	GLuint queries[NUM_FRAMES][MAX_SCOPES];
+	GLint scopeStages[NUM_FRAMES][MAX_SCOPES]; // stage of each query
+	GLint numScopes[NUM_FRAMES]; // queries issued in each frame
+	GLint pending[NUM_FRAMES]; // frame waiting on its queries, -1 if none
+	GLint current; // frame being timed
+	GLint stage; // stage being timed, -1 if none
+	bool query; // the stage being timed has a query
+	std::chrono::high_resolution_clock::time_point start, stageStart;
+	mutable std::vector<double> values; // scratch space of statistics()
+
+	GLint stageIndex(const char* name)
+	{
+		for (size_t i = 0; i < stages.size(); i++)
+			if (stages[i] == name)
+				return (GLint)i;
+		if (stages.size() >= MAX_STAGES)
+			return -1;
+		stages.push_back(name);
+		return (GLint)stages.size() - 1;
+	}
+
+	// add the query results of a frame slot to its timing, all at once
+	void resolve(GLint slot, bool wait)
+	{
+		if (pending[slot] == current && stage >= 0)
+			return;
+		if (!wait)
+		{
+			for (GLint i = 0; i < numScopes[slot]; i++)
+			{
+				GLint available = 0;
+				glGetQueryObjectiv(queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available)
+					return;
+			}
+		}
+
+		GLint index = timings.empty() ? -1 : pending[slot] - timings.front().frame;
+		auto timing = index >= 0 ? &timings[index] : nullptr;
+		if (timing)
+			timing->gpuMs = 0.0;
+		for (GLint i = 0; i < numScopes[slot]; i++)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[slot][i], GL_QUERY_RESULT, &elapsed);
+			if (!timing)
+				continue;
+			auto& gpuMs = timing->stageGpuMs[scopeStages[slot][i]];
+			gpuMs = std::max(gpuMs, 0.0) + elapsed * 1e-6;
+			timing->gpuMs += elapsed * 1e-6;
+		}
+		pending[slot] = -1;
+	}
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Headless mode: command line options and an offscreen OpenGL context.
+// On Linux the context comes from EGL (surfaceless platform, or a pbuffer as
+// fallback), which also works on Mesa llvmpipe without any display.
+// Elsewhere a hidden GLFW window is used instead.
+// --------------------------------------------------------------------------------
+
+#include <glad/glad.h>
+
+#ifdef __linux__
+#define HEADLESS_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdlib>
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+
+struct HeadlessOptions
+{
+	bool headless = false;
+	GLint scene = 0; // 0: scene 1, 1: scene 2
+	GLint lightType = 0; // LightType, scene 1 only
+	GLint numSphereLights = 0; // scene 2 only
+	GLint planeType = 0; // 0: Default, 1: stone, 2: marble, 3: wood, 4: diamond plate
+	GLint lightCulling = 0; // LightCulling
+	GLuint width = 0; // 0: keep the default FBO size
+	GLuint height = 0;
+	GLint frames = 100;
+	GLint warmupFrames = 0; // first frames rendered but left out of the timings
+	GLfloat timeStep = 1.0f / 60.0f; // fixed animation step, so runs are reproducible
+	GLuint seed = 1;
+	std::string outputPattern; // printf pattern with the frame number, .png or .exr
+	std::string csvPath; // empty: print to stdout
+	std::string jsonPath; // empty: no JSON summary
+	bool programCache = true; // load and store program binaries in shaderCache/
+	bool meshCache = true; // load and store imported models in meshCache/
+	bool compactVertices = false; // VertexFormat::Compact for all models
+	bool sphereImpostors = false; // draw the scene 2 sphere lights as impostors instead of meshes
+	bool gpuAnimation = false; // animate the scene 2 lights in a compute shader
+	bool separateLtc = false; // evaluate LTC diffuse and specular with separate calls, see SEPARATE_LTC in the shaders
+	bool analyticLtc = false; // scene 2 evaluates fits of the LTC tables instead of sampling them, see LTC_ANALYTIC
+	std::string ltcTablePath = "resources/ltc/ggx64_f16.ltc"; // written by LTC_Table_Generator
+	GLuint textureBudget = 256; // MB of plane material textures kept resident
+	std::string benchmark; // name of a scenario in benchmark.h that sets the options above
+	std::string baselinePath; // benchmark baseline to compare with or to update
+	bool updateBaseline = false;
+	GLfloat tolerance = 0.1f; // relative slowdown the baseline comparison accepts
+};
+
+inline void printUsage(const char* program)
+{
+	std::cout << "usage: " << program << " [--headless] [options]\n"
+		<< "  --headless            render offscreen without a window\n"
+		<< "  --scene <1|2>         scene to render\n"
+		<< "  --light <rect|cylinder|disk|sphere>  area light of scene 1\n"
+		<< "  --spheres <n>         moving sphere lights in scene 2\n"
+		<< "  --plane <default|stone|marble|wood|diamond>  plane material of scene 2\n"
+		<< "  --culling <none|cpu|gpu>  light culling of scene 2\n"
+		<< "  --sphere-impostors    draw the sphere lights of scene 2 as ray traced quads\n"
+		<< "  --gpu-animation       animate the lights of scene 2 in a compute shader\n"
+		<< "  --separate-ltc        evaluate LTC diffuse and specular in separate passes instead of fused\n"
+		<< "  --analytic-ltc        scene 2 evaluates polynomial fits of the LTC tables instead of sampling them\n"
+		<< "  --ltc-table <path>    LTC tables to load, e.g. resources/ltc/ggx32_f16.ltc or ggx64_f32.ltc\n"
+		<< "  --size <width>x<height>   resolution of the rendered image\n"
+		<< "  --frames <n>          number of frames to render (headless)\n"
+		<< "  --warmup <n>          render n more frames first and leave them out of the timings (headless)\n"
+		<< "  --dt <seconds>        animation time step per frame (headless)\n"
+		<< "  --seed <n>            seed of the random light motion (headless)\n"
+		<< "  --output <pattern>    write frames, e.g. frames/frame_%04d.png or .exr (headless)\n"
+		<< "  --csv <path>          write per-frame CPU and GPU times of each stage to a file instead of stdout (headless)\n"
+		<< "  --json <path>         also write the stage times with their min, average and 99th percentile as JSON (headless)\n"
+		<< "  --no-program-cache    always compile shaders, ignoring cached program binaries\n"
+		<< "  --no-mesh-cache       always import models with assimp, ignoring cached meshes\n"
+		<< "  --texture-budget <MB> memory kept for plane materials before unused ones are evicted\n"
+		<< "  --vertex-format <full|compact>  56-byte vertices, or 24-byte ones with a QTangent and half UVs\n"
+		<< "  --benchmark <name|list>  run a scripted benchmark scenario headless, or list them\n"
+		<< "  --baseline <path>     compare the benchmark with this baseline, failing on a regression\n"
+		<< "  --update-baseline     store the benchmark results in the baseline instead\n"
+		<< "  --tolerance <f>       relative slowdown accepted by the baseline comparison, default 0.1\n";
+}
+
+// returns the index of value in names, or -1
+inline GLint findName(const char* value, const char* const names[], GLint count)
+{
+	for (GLint i = 0; i < count; i++)
+		if (strcmp(value, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+inline bool parseCommandLine(int argc, char* argv[], HeadlessOptions& options)
+{
+	const char* lightNames[] = { "rect", "cylinder", "disk", "sphere" };
+	const char* planeNames[] = { "default", "stone", "marble", "wood", "diamond" };
+	const char* cullingNames[] = { "none", "cpu", "gpu" };
+	const char* vertexFormatNames[] = { "full", "compact" };
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool valid = true;
+
+		if (arg == "--headless")
+		{
+			options.headless = true;
+			continue;
+		}
+		else if (arg == "--no-program-cache")
+		{
+			options.programCache = false;
+			continue;
+		}
+		else if (arg == "--no-mesh-cache")
+		{
+			options.meshCache = false;
+			continue;
+		}
+		else if (arg == "--sphere-impostors")
+		{
+			options.sphereImpostors = true;
+			continue;
+		}
+		else if (arg == "--gpu-animation")
+		{
+			options.gpuAnimation = true;
+			continue;
+		}
+		else if (arg == "--separate-ltc")
+		{
+			options.separateLtc = true;
+			continue;
+		}
+		else if (arg == "--analytic-ltc")
+		{
+			options.analyticLtc = true;
+			continue;
+		}
+		else if (arg == "--update-baseline")
+		{
+			options.updateBaseline = true;
+			continue;
+		}
+		else if (arg == "--help" || arg == "-h")
+		{
+			printUsage(argv[0]);
+			return false;
+		}
+		else if (value == nullptr)
+			valid = false;
+		else if (arg == "--scene")
+		{
+			options.scene = atoi(value) - 1;
+			valid = options.scene == 0 || options.scene == 1;
+		}
+		else if (arg == "--light")
+			valid = (options.lightType = findName(value, lightNames, 4)) >= 0;
+		else if (arg == "--spheres")
+			valid = (options.numSphereLights = atoi(value)) >= 0;
+		else if (arg == "--plane")
+			valid = (options.planeType = findName(value, planeNames, 5)) >= 0;
+		else if (arg == "--culling")
+			valid = (options.lightCulling = findName(value, cullingNames, 3)) >= 0;
+		else if (arg == "--size")
+			valid = sscanf(value, "%ux%u", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+		else if (arg == "--frames")
+			valid = (options.frames = atoi(value)) > 0;
+		else if (arg == "--warmup")
+			valid = (options.warmupFrames = atoi(value)) >= 0;
+		else if (arg == "--dt")
+			valid = (options.timeStep = (GLfloat)atof(value)) > 0.0f;
+		else if (arg == "--seed")
+			options.seed = (GLuint)strtoul(value, nullptr, 10);
+		else if (arg == "--output")
+			options.outputPattern = value;
+		else if (arg == "--csv")
+			options.csvPath = value;
+		else if (arg == "--json")
+			options.jsonPath = value;
+		else if (arg == "--benchmark")
+			options.benchmark = value;
+		else if (arg == "--baseline")
+			options.baselinePath = value;
+		else if (arg == "--tolerance")
+			valid = (options.tolerance = (GLfloat)atof(value)) >= 0.0f;
+		else if (arg == "--ltc-table")
+			options.ltcTablePath = value;
+		else if (arg == "--texture-budget")
+			options.textureBudget = (GLuint)strtoul(value, nullptr, 10);
+		else if (arg == "--vertex-format")
+		{
+			auto format = findName(value, vertexFormatNames, 2);
+			options.compactVertices = format == 1;
+			valid = format >= 0;
+		}
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			std::cout << "Invalid argument: " << arg << (value ? std::string(" ") + value : "") << "\n";
+			printUsage(argv[0]);
+			return false;
+		}
+		i++;
+	}
+	return true;
+}
+
+class HeadlessContext
+{
+public:
+	// create the context, make it current and load the GL functions
+	bool create()
+	{
+#ifdef HEADLESS_EGL
+		// llvmpipe reports 4.5, the shaders only need what it already implements
+		setenv("MESA_GL_VERSION_OVERRIDE", "4.6", 0);
+		setenv("MESA_GLSL_VERSION_OVERRIDE", "460", 0);
+
+		auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		bool surfaceless = display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr);
+		if (!surfaceless)
+		{
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+			{
+				std::cout << "ERROR::EGL: no display available" << std::endl;
+				return false;
+			}
+		}
+		eglBindAPI(EGL_OPENGL_API);
+
+		// a 1x1 pbuffer when the display cannot make a context current without a surface
+		EGLConfig config = nullptr;
+		const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if (!surfaceless || !extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+		{
+			const EGLint configAttribs[] = {
+				EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+				EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_NONE
+			};
+			const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			EGLint numConfigs = 0;
+			if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+			{
+				std::cout << "ERROR::EGL: no pbuffer config available" << std::endl;
+				return false;
+			}
+			surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+		}
+
+		// 4.6 core, or 4.5 when the driver refuses the newer version
+		for (EGLint minor : { 6, 5 })
+		{
+			const EGLint contextAttribs[] = {
+				EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, minor,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+			};
+			context = eglCreateContext(display, config ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+			if (context != EGL_NO_CONTEXT)
+				break;
+		}
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+		{
+			std::cout << "ERROR::EGL: failed to create an OpenGL 4.5 core context" << std::endl;
+			return false;
+		}
+		GLADloadproc loader = (GLADloadproc)eglGetProcAddress;
+#else
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(1, 1, "Area Light Implementation", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Fail to create hidden glfw window\n";
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(window);
+		GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+#endif
+		if (!gladLoadGLLoader(loader))
+		{
+			std::cout << "Fail to load GLAD\n";
+			return false;
+		}
+		std::cout << "Headless context: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+		return true;
+	}
+
+	void destroy()
+	{
+#ifdef HEADLESS_EGL
+		if (display == EGL_NO_DISPLAY)
+			return;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+#else
+		if (window)
+			glfwDestroyWindow(window);
+		glfwTerminate();
+		window = NULL;
+#endif
+	}
+
+private:
+#ifdef HEADLESS_EGL
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	EGLSurface surface = EGL_NO_SURFACE;
+#else
+	GLFWwindow* window = NULL;
+#endif
+};
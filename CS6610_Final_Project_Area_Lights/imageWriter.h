@@ -0,0 +1,243 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Minimal PNG and OpenEXR writers for saving rendered frames.
+// PNG: 8-bit RGB with stored (uncompressed) deflate blocks.
+// EXR: 32-bit float RGB scanlines without compression.
+// Rows are given bottom-up, as glReadPixels returns them.
+// --------------------------------------------------------------------------------
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace imageWriter
+{
+	inline void putBE32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back(v >> 24);
+		out.push_back(v >> 16);
+		out.push_back(v >> 8);
+		out.push_back(v);
+	}
+
+	inline void putLE32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back(v);
+		out.push_back(v >> 8);
+		out.push_back(v >> 16);
+		out.push_back(v >> 24);
+	}
+
+	inline void putString(std::vector<uint8_t>& out, const char* s)
+	{
+		out.insert(out.end(), s, s + strlen(s) + 1);
+	}
+
+	inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		static uint32_t table[256];
+		if (table[1] == 0)
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+	{
+		putBE32(out, (uint32_t)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		putBE32(out, crc32(out.data() + start, out.size() - start));
+	}
+
+	inline bool writeFile(const std::string& path, const std::vector<uint8_t>& data)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "ERROR::IMAGE: cannot open " << path << std::endl;
+			return false;
+		}
+		file.write((const char*)data.data(), data.size());
+		return true;
+	}
+
+	inline bool writePNG(const std::string& path, GLuint width, GLuint height, const uint8_t* rgb)
+	{
+		const uint8_t signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		std::vector<uint8_t> out(signature, signature + 8);
+
+		std::vector<uint8_t> header;
+		putBE32(header, width);
+		putBE32(header, height);
+		header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit RGB, no interlace
+		putChunk(out, "IHDR", header);
+
+		// filter type 0 in front of every row, top row first
+		size_t rowSize = 3 * (size_t)width;
+		std::vector<uint8_t> raw;
+		raw.reserve((rowSize + 1) * height);
+		for (GLuint y = 0; y < height; y++)
+		{
+			const uint8_t* row = rgb + (height - 1 - y) * rowSize;
+			raw.push_back(0);
+			raw.insert(raw.end(), row, row + rowSize);
+		}
+
+		// zlib stream of stored blocks, at most 65535 bytes each
+		std::vector<uint8_t> zlib = { 0x78, 0x01 };
+		uint32_t a = 1, b = 0;
+		for (size_t offset = 0; offset < raw.size() || offset == 0; )
+		{
+			uint16_t size = (uint16_t)std::min<size_t>(raw.size() - offset, 65535);
+			uint16_t nsize = ~size;
+			bool last = offset + size == raw.size();
+			zlib.insert(zlib.end(), { (uint8_t)(last ? 1 : 0), (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)nsize, (uint8_t)(nsize >> 8) });
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+			for (size_t i = offset; i < offset + size; i++)
+			{
+				a = (a + raw[i]) % 65521;
+				b = (b + a) % 65521;
+			}
+			offset += size;
+			if (last)
+				break;
+		}
+		putBE32(zlib, (b << 16) | a);
+		putChunk(out, "IDAT", zlib);
+		putChunk(out, "IEND", {});
+
+		return writeFile(path, out);
+	}
+
+	inline bool writeEXR(const std::string& path, GLuint width, GLuint height, const float* rgb)
+	{
+		std::vector<uint8_t> out = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 };
+
+		// header attributes, channels are stored in alphabetical order
+		const char* channels[] = { "B", "G", "R" };
+		const int channelOffset[] = { 2, 1, 0 };
+		putString(out, "channels");
+		putString(out, "chlist");
+		putLE32(out, 3 * 18 + 1);
+		for (auto name : channels)
+		{
+			putString(out, name);
+			putLE32(out, 2); // FLOAT
+			putLE32(out, 0); // pLinear and reserved
+			putLE32(out, 1); // x sampling
+			putLE32(out, 1); // y sampling
+		}
+		out.push_back(0);
+
+		putString(out, "compression");
+		putString(out, "compression");
+		putLE32(out, 1);
+		out.push_back(0); // NO_COMPRESSION
+
+		for (auto name : { "dataWindow", "displayWindow" })
+		{
+			putString(out, name);
+			putString(out, "box2i");
+			putLE32(out, 16);
+			putLE32(out, 0);
+			putLE32(out, 0);
+			putLE32(out, width - 1);
+			putLE32(out, height - 1);
+		}
+
+		putString(out, "lineOrder");
+		putString(out, "lineOrder");
+		putLE32(out, 1);
+		out.push_back(0); // INCREASING_Y
+
+		float one = 1.0f;
+		uint32_t oneBits;
+		memcpy(&oneBits, &one, 4);
+		putString(out, "pixelAspectRatio");
+		putString(out, "float");
+		putLE32(out, 4);
+		putLE32(out, oneBits);
+
+		putString(out, "screenWindowCenter");
+		putString(out, "v2f");
+		putLE32(out, 8);
+		putLE32(out, 0);
+		putLE32(out, 0);
+
+		putString(out, "screenWindowWidth");
+		putString(out, "float");
+		putLE32(out, 4);
+		putLE32(out, oneBits);
+		out.push_back(0);
+
+		// line offset table, then one block per scanline
+		uint32_t lineSize = 3 * 4 * width;
+		uint64_t offset = out.size() + 8 * (uint64_t)height;
+		for (GLuint y = 0; y < height; y++, offset += 8 + lineSize)
+		{
+			putLE32(out, (uint32_t)offset);
+			putLE32(out, (uint32_t)(offset >> 32));
+		}
+		for (GLuint y = 0; y < height; y++)
+		{
+			const float* row = rgb + (size_t)(height - 1 - y) * 3 * width;
+			putLE32(out, y);
+			putLE32(out, lineSize);
+			for (int c = 0; c < 3; c++)
+			{
+				for (GLuint x = 0; x < width; x++)
+				{
+					uint32_t bits;
+					memcpy(&bits, &row[3 * x + channelOffset[c]], 4);
+					putLE32(out, bits);
+				}
+			}
+		}
+
+		return writeFile(path, out);
+	}
+
+	// read back the color attachment of a framebuffer and save it, the format follows the extension
+	inline bool saveFramebuffer(GLuint framebuffer, GLuint width, GLuint height, const std::string& path)
+	{
+		bool exr = path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		bool saved;
+		if (exr)
+		{
+			std::vector<float> pixels(3 * (size_t)width * height);
+			glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, pixels.data());
+			saved = writeEXR(path, width, height, pixels.data());
+		}
+		else
+		{
+			std::vector<uint8_t> pixels(3 * (size_t)width * height);
+			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			saved = writePNG(path, width, height, pixels.data());
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		return saved;
+	}
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Minimal KTX2 container support for 2D block compressed textures with mip chains.
+// Only the features written by Texture_Converter are handled: one layer, one face,
+// no supercompression. Level data is kept in memory largest level first.
+// --------------------------------------------------------------------------------
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+
+namespace ktx2
+{
+	// VkFormat values of the supported block formats
+	enum Format : uint32_t
+	{
+		BC1_RGB_UNORM = 131,
+		BC1_RGB_SRGB = 132,
+		BC4_UNORM = 139,
+		BC5_UNORM = 141,
+		BC7_UNORM = 145,
+		BC7_SRGB = 146
+	};
+
+	struct Level
+	{
+		uint32_t width, height;
+		size_t offset, size; // into Texture::data
+	};
+
+	struct Texture
+	{
+		uint32_t format = 0;
+		uint32_t width = 0, height = 0;
+		std::vector<Level> levels;
+		std::vector<unsigned char> data;
+	};
+
+	// bytes of one 4x4 block, 0 for unsupported formats
+	inline uint32_t blockBytes(uint32_t format)
+	{
+		switch (format)
+		{
+		case BC1_RGB_UNORM: case BC1_RGB_SRGB: case BC4_UNORM:
+			return 8;
+		case BC5_UNORM: case BC7_UNORM: case BC7_SRGB:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	inline GLenum glInternalFormat(uint32_t format)
+	{
+		switch (format)
+		{
+		case BC1_RGB_UNORM: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BC1_RGB_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+		case BC4_UNORM: return GL_COMPRESSED_RED_RGTC1;
+		case BC5_UNORM: return GL_COMPRESSED_RG_RGTC2;
+		case BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case BC7_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		default: return 0;
+		}
+	}
+
+	inline size_t levelBytes(uint32_t format, uint32_t width, uint32_t height)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	static const unsigned char IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// laid out as in the file, the identifier keeps the 64-bit fields aligned
+	struct Header
+	{
+		unsigned char identifier[12];
+		uint32_t vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth;
+		uint32_t layerCount, faceCount, levelCount, supercompressionScheme;
+		uint32_t dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength;
+		uint64_t sgdByteOffset, sgdByteLength;
+	};
+	static_assert(sizeof(Header) == 80, "Header must match the KTX2 file header");
+
+	struct LevelIndex
+	{
+		uint64_t byteOffset, byteLength, uncompressedByteLength;
+	};
+
+	inline bool read(const std::string& path, Texture& texture)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (bytes.size() < sizeof(Header))
+			return false;
+
+		Header header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		if (memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0 || blockBytes(header.vkFormat) == 0
+			|| header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.levelCount == 0)
+			return false;
+		size_t indexOffset = sizeof(Header);
+		if (bytes.size() < indexOffset + header.levelCount * sizeof(LevelIndex))
+			return false;
+
+		texture.format = header.vkFormat;
+		texture.width = header.pixelWidth;
+		texture.height = header.pixelHeight;
+		texture.levels.clear();
+		texture.data.clear();
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			LevelIndex index;
+			memcpy(&index, bytes.data() + indexOffset + i * sizeof(LevelIndex), sizeof(index));
+			Level level;
+			level.width = std::max(1u, texture.width >> i);
+			level.height = std::max(1u, texture.height >> i);
+			level.offset = texture.data.size();
+			level.size = (size_t)index.byteLength;
+			if (level.size != levelBytes(texture.format, level.width, level.height) || index.byteOffset + index.byteLength > bytes.size())
+				return false;
+			texture.data.insert(texture.data.end(), bytes.begin() + (size_t)index.byteOffset, bytes.begin() + (size_t)(index.byteOffset + index.byteLength));
+			texture.levels.push_back(level);
+		}
+		return true;
+	}
+
+	// data format descriptor of a block compressed format
+	inline std::vector<uint32_t> makeDescriptor(uint32_t format)
+	{
+		// KHR_DF_MODEL_BC1A, BC4, BC5, BC7
+		uint32_t model = format == BC4_UNORM ? 131 : format == BC5_UNORM ? 132 : format == BC7_UNORM || format == BC7_SRGB ? 134 : 128;
+		uint32_t transfer = format == BC1_RGB_SRGB || format == BC7_SRGB ? 2 : 1; // sRGB or linear
+		uint32_t bytes = blockBytes(format);
+		uint32_t numSamples = format == BC5_UNORM ? 2 : 1;
+		uint32_t blockSize = 24 + 16 * numSamples;
+
+		std::vector<uint32_t> words;
+		words.push_back(4 + blockSize); // total size
+		words.push_back(0); // vendor Khronos, basic descriptor type
+		words.push_back(2 | blockSize << 16); // version 2
+		words.push_back(model | 1 << 8 | transfer << 16); // BT.709 primaries, straight alpha
+		words.push_back(3 | 3 << 8); // 4x4 texel block
+		words.push_back(bytes); // bytesPlane0
+		words.push_back(0);
+		for (uint32_t s = 0; s < numSamples; s++)
+		{
+			uint32_t bitLength = numSamples == 2 ? 64 : bytes * 8;
+			words.push_back(s * 64 | (bitLength - 1) << 16 | s << 24); // offset, length, channel
+			words.push_back(0); // sample position
+			words.push_back(0); // lower
+			words.push_back(0xFFFFFFFF); // upper
+		}
+		return words;
+	}
+
+	// write with the levels stored smallest first and aligned to the block size.
+	// orientation is the KTXorientation value, "ru" for bottom-up rows as OpenGL uploads them
+	inline bool write(const std::string& path, const Texture& texture, const std::string& orientation = "ru")
+	{
+		auto descriptor = makeDescriptor(texture.format);
+		std::vector<unsigned char> keyValues;
+		auto addKeyValue = [&keyValues](const std::string& key, const std::string& value)
+		{
+			uint32_t length = (uint32_t)(key.size() + 1 + value.size() + 1);
+			keyValues.insert(keyValues.end(), (unsigned char*)&length, (unsigned char*)&length + 4);
+			keyValues.insert(keyValues.end(), key.begin(), key.end());
+			keyValues.push_back(0);
+			keyValues.insert(keyValues.end(), value.begin(), value.end());
+			keyValues.push_back(0);
+			keyValues.resize((keyValues.size() + 3) & ~(size_t)3);
+		};
+		addKeyValue("KTXorientation", orientation);
+		addKeyValue("KTXwriter", "Texture_Converter");
+
+		uint32_t levelCount = (uint32_t)texture.levels.size();
+		Header header = {};
+		memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+		header.vkFormat = texture.format;
+		header.typeSize = 1;
+		header.pixelWidth = texture.width;
+		header.pixelHeight = texture.height;
+		header.faceCount = 1;
+		header.levelCount = levelCount;
+		header.dfdByteOffset = (uint32_t)(sizeof(Header) + levelCount * sizeof(LevelIndex));
+		header.dfdByteLength = (uint32_t)(descriptor.size() * 4);
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = (uint32_t)keyValues.size();
+
+		size_t alignment = blockBytes(texture.format);
+		size_t offset = header.kvdByteOffset + header.kvdByteLength;
+		std::vector<LevelIndex> indices(levelCount);
+		for (uint32_t i = levelCount; i-- > 0;)
+		{
+			offset = (offset + alignment - 1) / alignment * alignment;
+			indices[i].byteOffset = offset;
+			indices[i].byteLength = texture.levels[i].size;
+			indices[i].uncompressedByteLength = texture.levels[i].size;
+			offset += texture.levels[i].size;
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)indices.data(), indices.size() * sizeof(LevelIndex));
+		file.write((const char*)descriptor.data(), descriptor.size() * 4);
+		file.write((const char*)keyValues.data(), keyValues.size());
+		size_t position = header.kvdByteOffset + header.kvdByteLength;
+		for (uint32_t i = levelCount; i-- > 0;)
+		{
+			static const char zeros[16] = {};
+			file.write(zeros, (size_t)indices[i].byteOffset - position);
+			file.write((const char*)texture.data.data() + texture.levels[i].offset, texture.levels[i].size);
+			position = (size_t)(indices[i].byteOffset + indices[i].byteLength);
+		}
+		return (bool)file;
+	}
+}
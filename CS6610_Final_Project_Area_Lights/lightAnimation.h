@@ -0,0 +1,177 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "shader.h"
+#include "model.h"
+#include "lightBuffer.h"
+#include "lightProxies.h"
+#include "lightSimulation.h"
+
+// An orbiting light of scene 2, animated by lightAnimation.comp.
+// Mirrors the std430 "OrbitLight" struct in lightAnimation.comp, so keep both in sync.
+struct GPUOrbitLight
+{
+	glm::vec4 orbit; // xyz: orbit center, w: orbit radius
+	glm::vec4 rotation; // xyz: self rotation axis, w: self rotation speed in degrees per second
+	glm::vec4 color; // rgb: color, w: intensity
+	glm::vec4 colorFrequency; // rgb: angular frequencies of a cycling color, zero keeps the color
+	glm::vec4 size; // sphere: semi-axes, rectangle and disk: half sizes, cylinder: length and radius
+	GLfloat orbitSpeed; // radians per second
+	GLint type; // LightType
+	GLint record; // index of its light record, set by LightAnimation::configure
+	GLint proxy; // index of its proxy instance, set by LightAnimation::configure
+};
+static_assert(sizeof(GPUOrbitLight) == 96, "GPUOrbitLight must match the std430 layout in lightAnimation.comp");
+
+// A moving sphere light, the fields of one index of the LightSimulation arrays.
+// Mirrors the std430 "MovingLight" struct in lightAnimation.comp.
+struct GPUMovingLight
+{
+	glm::vec4 shape; // x: radius, y: speed, z: bounce height, w: intensity
+	glm::vec4 color; // rgb: color, w: unused
+	glm::vec4 run; // xy: origin of the current run (x, z), zw: its direction
+	glm::vec4 state; // x: seconds since the start of the run, y: hop phase, z: direction the phase advances
+	glm::vec4 center; // xyz: center, w: half size of the square of LTC points
+};
+static_assert(sizeof(GPUMovingLight) == 80, "GPUMovingLight must match the std430 layout in lightAnimation.comp");
+
+// Compute path of the scene 2 light animation.
+// The light parameters and the animation state stay in GPU buffers. Each frame one dispatch
+// advances the orbiting and the moving sphere lights and writes their LTC points and bounds into
+// the LightBuffer records and their transforms into the LightProxies instances, so besides the
+// time uniforms nothing is sent to the GPU. The layout of the records and instances is set by
+// configure() and only changes with the number of lights or the proxy models.
+class LightAnimation
+{
+public:
+	// binding points, 0 is the light buffer as in the shading pass
+	static const GLuint PROXY_BINDING = 4;
+	static const GLuint ORBIT_BINDING = 5;
+	static const GLuint MOVING_BINDING = 6;
+
+	GLuint orbitSSBO, movingSSBO;
+	Shader shader;
+
+	LightAnimation() : shader("lightAnimation.comp"), numOrbitLights(0), numMovingLights(0),
+		time(shader.uniform("time")), deltaTime(shader.uniform("deltaTime")), influenceCutoff(shader.uniform("influenceCutoff"))
+	{
+		glGenBuffers(1, &orbitSSBO);
+		glGenBuffers(1, &movingSSBO);
+	}
+
+	// copy the state of all lights of a CPU simulation, e.g. when the compute path is switched on
+	void upload(const LightSimulation& lights)
+	{
+		std::vector<GPUMovingLight> states(lights.size());
+		for (size_t i = 0; i < states.size(); i++)
+		{
+			auto& state = states[i];
+			state.shape = glm::vec4(lights.radius[i], lights.speed[i], lights.bounceHeight[i], lights.intensity[i]);
+			state.color = glm::vec4(lights.color(i), 0.0f);
+			state.run = glm::vec4(lights.originX[i], lights.originZ[i], lights.dirX[i], lights.dirZ[i]);
+			state.state = glm::vec4(lights.time[i], lights.phase[i], lights.phaseSign[i], 0.0f);
+			state.center = glm::vec4(lights.center(i), lights.extent[i]);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, movingSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUMovingLight) * std::max<size_t>(states.size(), 1), states.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// copy the animation state back, so the CPU simulation continues where the GPU stopped
+	void download(LightSimulation& lights) const
+	{
+		std::vector<GPUMovingLight> states(lights.size());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, movingSSBO);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GPUMovingLight) * states.size(), states.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		for (size_t i = 0; i < states.size(); i++)
+		{
+			auto& state = states[i];
+			lights.originX[i] = state.run.x;
+			lights.originZ[i] = state.run.y;
+			lights.dirX[i] = state.run.z;
+			lights.dirZ[i] = state.run.w;
+			lights.time[i] = state.state.x;
+			lights.phase[i] = state.state.y;
+			lights.phaseSign[i] = state.state.z;
+			lights.centerX[i] = state.center.x;
+			lights.centerY[i] = state.center.y;
+			lights.centerZ[i] = state.center.z;
+			lights.extent[i] = state.center.w;
+		}
+	}
+
+	// lay out the records and proxies of the orbiting lights, drawn with orbitModels, and of the
+	// first numMovingLights moving lights, drawn with movingModel (nullptr: sphere impostors).
+	// The records are grouped by type as LightBuffer::groupByType() does.
+	void configure(std::vector<GPUOrbitLight> orbitLights, const std::vector<const Model*>& orbitModels, GLint numMovingLights,
+		const Model* movingModel, LightBuffer& lightBuffer, LightProxies& proxies)
+	{
+		const auto sphere = static_cast<GLint>(LightType::Sphere);
+		GLint typeCounts[LightBuffer::NUM_LIGHT_TYPES] = {};
+		for (const auto& light : orbitLights)
+			typeCounts[light.type]++;
+		typeCounts[sphere] += numMovingLights;
+		lightBuffer.allocate(typeCounts);
+
+		GLint next[LightBuffer::NUM_LIGHT_TYPES];
+		for (GLint type = 0; type < LightBuffer::NUM_LIGHT_TYPES; type++)
+			next[type] = lightBuffer.typeRanges[type].x;
+		for (auto& light : orbitLights)
+			light.record = next[light.type]++;
+
+		std::vector<GLuint> orbitProxies(orbitLights.size());
+		proxies.clear();
+		for (size_t i = 0; i < orbitLights.size(); i++)
+			orbitProxies[i] = proxies.reserve(orbitModels[i], 1);
+		auto movingProxy = proxies.reserve(movingModel, numMovingLights);
+		proxies.upload();
+		for (size_t i = 0; i < orbitLights.size(); i++)
+			orbitLights[i].proxy = proxies.firstInstance(orbitModels[i]) + orbitProxies[i];
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, orbitSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUOrbitLight) * std::max<size_t>(orbitLights.size(), 1), orbitLights.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		numOrbitLights = (GLint)orbitLights.size();
+		this->numMovingLights = numMovingLights;
+		shader.uniform("boundary").set(LightSimulation::BOUNDARY);
+		shader.uniform("numOrbitLights").set(numOrbitLights);
+		shader.uniform("numMovingLights").set(numMovingLights);
+		shader.uniform("firstMovingRecord").set(next[sphere]);
+		shader.uniform("firstMovingProxy").set((GLint)(proxies.firstInstance(movingModel) + movingProxy));
+	}
+
+	// advance all lights to currentTime, timeStep after the previous dispatch
+	void dispatch(GLfloat currentTime, GLfloat timeStep, GLfloat cutoff, const LightBuffer& lightBuffer, const LightProxies& proxies)
+	{
+		lightBuffer.bind(0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PROXY_BINDING, proxies.VBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ORBIT_BINDING, orbitSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MOVING_BINDING, movingSSBO);
+
+		time.set(currentTime);
+		deltaTime.set(timeStep);
+		influenceCutoff.set(cutoff);
+		shader.use();
+		glDispatchCompute((numOrbitLights + numMovingLights + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteBuffers(1, &orbitSSBO);
+		glDeleteBuffers(1, &movingSSBO);
+		shader.deleteProgram();
+	}
+
+private:
+	GLint numOrbitLights, numMovingLights;
+	Uniform time, deltaTime, influenceCutoff;
+};
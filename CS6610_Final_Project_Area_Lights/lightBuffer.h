@@ -0,0 +1,272 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "polyLight.h"
+#include "lightSimulation.h"
+
+// One light record in the shader storage buffer.
+// Mirrors the std430 "Light" struct in ltcAll.frag, so keep both in sync.
+struct GPULight
+{
+	glm::vec4 points[4]; // xyz: LTC points, w: unused
+	glm::vec4 boundingSphere; // xyz: center, w: radius of the influence region
+	glm::vec3 lightColor;
+	GLfloat intensity;
+	GLint type; // LightType
+	GLfloat radius; // only for cylinder light
+	GLfloat range; // influence range around the light shape
+	GLfloat padding;
+};
+static_assert(sizeof(GPULight) == 112, "GPULight must match the std430 layout in ltcAll.frag");
+
+// Packed light records for all lights in the scene, uploaded once per frame.
+// Records of AreaLights whose version did not change are reused from the previous frame,
+// and only the records that changed are uploaded.
+class LightBuffer
+{
+public:
+	static const GLint NUM_LIGHT_TYPES = 4;
+
+	GLuint SSBO;
+	std::vector<GPULight> records;
+	std::vector<LightBounds> bounds; // CPU-side only, for light culling
+	// smallest contribution worth shading, lights are culled at the distance where they fall below it
+	GLfloat influenceCutoff;
+	// x: first record, y: number of records of each LightType, set by groupByType()
+	glm::ivec2 typeRanges[NUM_LIGHT_TYPES];
+
+	LightBuffer() : SSBO(0), influenceCutoff(0.005f), capacity(0), deviceRecords(0), uploadedSize(-1)
+	{
+		glGenBuffers(1, &SSBO);
+		for (auto& range : typeRanges)
+			range = glm::ivec2(0);
+	}
+
+	void clear()
+	{
+		records.clear();
+		bounds.clear();
+		dirty.clear();
+		deviceRecords = 0;
+	}
+
+	// the record of light, reused when the light added at this position in the previous frame
+	// was the same one with the same version and settings
+	void add(const AreaLight& light, GLfloat radius = 0.0f)
+	{
+		auto slot = records.size();
+		if (slot < cache.size())
+		{
+			const auto& cached = cache[slot];
+			if (cached.light == &light && cached.version == light.version && cached.radius == radius && cached.cutoff == influenceCutoff)
+			{
+				records.push_back(cached.record);
+				bounds.push_back(cached.bounds);
+				dirty.push_back(false);
+				return;
+			}
+		}
+
+		GPULight record{};
+		for (size_t i = 0; i < std::min<size_t>(light.points.size(), 4); i++)
+			record.points[i] = glm::vec4(light.points[i], 1.0f);
+		record.lightColor = light.color;
+		record.intensity = light.intensity;
+		record.type = static_cast<GLint>(light.type);
+		record.radius = radius;
+
+		// the irradiance of a small emitter falls off as intensity * area / (pi * d^2)
+		auto power = light.intensity * std::max(light.color.r, std::max(light.color.g, light.color.b)) * light.getArea();
+		record.range = sqrt(std::max(power, 0.0f) / (3.14159265f * influenceCutoff));
+
+		auto lightBounds = light.getBounds(record.range);
+		record.boundingSphere = glm::vec4(lightBounds.center, glm::length(lightBounds.axes[0]));
+		for (int i = 1; i < 3; i++)
+			record.boundingSphere.w = std::max(record.boundingSphere.w, glm::length(lightBounds.axes[i]));
+
+		records.push_back(record);
+		bounds.push_back(lightBounds);
+		dirty.push_back(true);
+		cache.resize(std::max(cache.size(), slot + 1));
+		cache[slot] = CachedRecord{ &light, light.version, radius, influenceCutoff, record, lightBounds };
+	}
+
+	// the first count lights of a simulation, written without SphereLight objects.
+	// Same records as add() gives for a sphere light with axis aligned semi-axes of the light's radius.
+	void addSpheres(const LightSimulation& lights, size_t count)
+	{
+		count = std::min(count, lights.size());
+		records.reserve(records.size() + count);
+		bounds.reserve(bounds.size() + count);
+		glm::vec3 points[4];
+		for (size_t i = 0; i < count; i++)
+		{
+			GPULight record{};
+			lights.points(i, points);
+			for (int k = 0; k < 4; k++)
+				record.points[k] = glm::vec4(points[k], 1.0f);
+			record.lightColor = lights.color(i);
+			record.intensity = lights.intensity[i];
+			record.type = static_cast<GLint>(LightType::Sphere);
+
+			// as in add() with an area of pi r^2
+			auto r = lights.radius[i];
+			auto power = record.intensity * std::max(record.lightColor.r, std::max(record.lightColor.g, record.lightColor.b)) * 3.14159265f * r * r;
+			record.range = sqrt(std::max(power, 0.0f) / (3.14159265f * influenceCutoff));
+			record.boundingSphere = glm::vec4(lights.center(i), r + record.range);
+
+			records.push_back(record);
+			bounds.push_back(AreaLight::sphereBounds(lights.center(i), r + record.range));
+		}
+		dirty.resize(records.size(), true);
+	}
+
+	GLint size() const
+	{
+		return static_cast<GLint>(records.size()) + deviceRecords;
+	}
+
+	// make room for records written on the GPU, typeCounts[i] lights of LightType i grouped by type.
+	// Nothing is uploaded and there are no CPU-side bounds; size() and the type ranges describe
+	// these records until the next clear().
+	void allocate(const GLint typeCounts[NUM_LIGHT_TYPES])
+	{
+		clear();
+		for (GLint type = 0; type < NUM_LIGHT_TYPES; type++)
+		{
+			typeRanges[type] = glm::ivec2(deviceRecords, typeCounts[type]);
+			deviceRecords += typeCounts[type];
+		}
+		uploadedSize = -1; // the GPU overwrites what upload() left
+		if ((size_t)deviceRecords > capacity)
+		{
+			capacity = std::max((size_t)deviceRecords, 2 * capacity);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPULight) * capacity, NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+	}
+
+	// reorder the records so that the lights of each type are contiguous (stable counting sort),
+	// then a shader can run one specialized loop per type instead of branching per light
+	void groupByType()
+	{
+		GLint offset = 0;
+		for (GLint type = 0; type < NUM_LIGHT_TYPES; type++)
+			typeRanges[type] = glm::ivec2(0);
+		for (const auto& record : records)
+			typeRanges[record.type].y++;
+		for (auto& range : typeRanges)
+		{
+			range.x = offset;
+			offset += range.y;
+			range.y = 0;
+		}
+
+		sortedRecords.resize(records.size());
+		sortedBounds.resize(bounds.size());
+		sortedDirty.resize(dirty.size());
+		positions.resize(records.size(), -1);
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			auto& range = typeRanges[records[i].type];
+			GLint position = range.x + range.y++;
+			sortedRecords[position] = records[i];
+			sortedBounds[position] = bounds[i];
+			// a reused record is only still in the buffer when it did not move
+			sortedDirty[position] = dirty[i] || positions[i] != position;
+			positions[i] = position;
+		}
+		records.swap(sortedRecords);
+		bounds.swap(sortedBounds);
+		dirty.swap(sortedDirty);
+	}
+
+	// bit i is set when lights of LightType i are present, valid after groupByType()
+	GLint typeMask() const
+	{
+		GLint mask = 0;
+		for (GLint type = 0; type < NUM_LIGHT_TYPES; type++)
+			if (typeRanges[type].y > 0)
+				mask |= 1 << type;
+		return mask;
+	}
+
+	// Upload the records that changed since the last upload. When the layout changed or most records
+	// did, all of them are uploaded with one call, orphaning the old storage to avoid a sync with the GPU;
+	// otherwise the changed runs are written in place, and nothing is written when no record changed.
+	void upload()
+	{
+		auto changed = std::count(dirty.begin(), dirty.end(), char(1));
+		auto sameLayout = uploadedSize == size() && records.size() <= capacity;
+		for (GLint type = 0; type < NUM_LIGHT_TYPES; type++)
+			sameLayout = sameLayout && uploadedRanges[type] == typeRanges[type];
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
+		if (!sameLayout || 2 * (size_t)changed > records.size())
+		{
+			if (records.size() > capacity)
+				capacity = std::max(records.size(), 2 * capacity);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPULight) * std::max<size_t>(capacity, 1), NULL, GL_DYNAMIC_DRAW);
+			if (!records.empty())
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GPULight) * records.size(), records.data());
+		}
+		else
+		{
+			for (size_t begin = 0; begin < records.size(); begin++)
+			{
+				if (!dirty[begin])
+					continue;
+				auto end = begin + 1;
+				while (end < records.size() && dirty[end])
+					end++;
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GPULight) * begin, sizeof(GPULight) * (end - begin), &records[begin]);
+				begin = end;
+			}
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		uploadedSize = size();
+		for (GLint type = 0; type < NUM_LIGHT_TYPES; type++)
+			uploadedRanges[type] = typeRanges[type];
+	}
+
+	void bind(GLuint binding) const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, SSBO);
+	}
+
+	void deleteBuffer()
+	{
+		glDeleteBuffers(1, &SSBO);
+	}
+
+private:
+	size_t capacity;
+	GLint deviceRecords; // records written on the GPU, see allocate()
+	std::vector<GPULight> sortedRecords;
+	std::vector<LightBounds> sortedBounds;
+
+	// a record differs from the uploaded one at its position, valid when the layout is the uploaded one
+	std::vector<char> dirty, sortedDirty;
+	std::vector<GLint> positions; // position of each added record after the last groupByType()
+	GLint uploadedSize; // -1: the buffer content is unknown
+	glm::ivec2 uploadedRanges[NUM_LIGHT_TYPES];
+
+	// the record add() made at each position in the previous frames
+	struct CachedRecord
+	{
+		const AreaLight* light;
+		GLuint version;
+		GLfloat radius, cutoff;
+		GPULight record;
+		LightBounds bounds;
+	};
+	std::vector<CachedRecord> cache;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "shader.h"
+#include "model.h"
+
+// Per-instance attributes of a light proxy.
+// Mirrors the instance inputs of polyLight.vert and sphereImpostor.vert (locations 5 to 9).
+struct ProxyInstance
+{
+	glm::mat4 model;
+	glm::vec4 color; // xyz: light color, w: unused
+};
+static_assert(sizeof(ProxyInstance) == 80, "ProxyInstance must match the instance attributes of polyLight.vert");
+
+// Light models drawn with one instanced draw per proxy mesh.
+// Proxies are collected every frame, grouped by model, and uploaded into one instance buffer;
+// each group is then drawn with glDrawElementsInstancedBaseInstance.
+// Sphere proxies can instead be drawn as ray-traced impostors on camera facing quads,
+// which costs 4 vertices per sphere however finely the sphere model is tessellated.
+// Instances can also be reserved and filled on the GPU, see LightAnimation.
+class LightProxies
+{
+public:
+	// first attribute location of the instance data, after the vertex attributes of both vertex formats
+	static const GLuint INSTANCE_LOCATION = 5;
+
+	GLuint VBO;
+
+	LightProxies() : VBO(0), impostorVAO(0), capacity(0)
+	{
+		glGenBuffers(1, &VBO);
+		glGenVertexArrays(1, &impostorVAO);
+		glBindVertexArray(impostorVAO);
+		setupInstanceAttributes();
+		glBindVertexArray(0);
+	}
+
+	void clear()
+	{
+		for (auto& batch : batches)
+			batch.instances.clear();
+	}
+
+	// add a proxy of model, or an analytic sphere impostor when model is nullptr.
+	// Impostors take the center from the translation and the radius from the length of the first column.
+	void add(const Model* model, const glm::mat4& transform, const glm::vec3& color)
+	{
+		batch(model).instances.push_back({ transform, glm::vec4(color, 1.0f) });
+	}
+
+	// add count instances of model that are written on the GPU after upload(),
+	// returns the index of the first one within the batch of model
+	GLuint reserve(const Model* model, GLuint count)
+	{
+		auto& instances = batch(model).instances;
+		auto first = (GLuint)instances.size();
+		instances.resize(instances.size() + count, ProxyInstance{ glm::mat4(1.0f), glm::vec4(0.0f) });
+		return first;
+	}
+
+	// index in the instance buffer of the first instance of model, valid after upload()
+	GLuint firstInstance(const Model* model)
+	{
+		return batch(model).first;
+	}
+
+	// upload the instances of all batches with one call, orphaning the old storage
+	void upload()
+	{
+		instances.clear();
+		for (auto& batch : batches)
+		{
+			batch.first = (GLuint)instances.size();
+			instances.insert(instances.end(), batch.instances.begin(), batch.instances.end());
+		}
+		if (instances.size() > capacity)
+			capacity = std::max(instances.size(), 2 * capacity);
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(ProxyInstance) * std::max<size_t>(capacity, 1), NULL, GL_STREAM_DRAW);
+		if (!instances.empty())
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(ProxyInstance) * instances.size(), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// draw the model batches with shader and the impostor batch with impostorShader
+	void draw(Shader& shader, Shader& impostorShader)
+	{
+		for (auto& batch : batches)
+		{
+			auto count = (GLsizei)batch.instances.size();
+			if (count == 0)
+				continue;
+			if (!batch.model)
+			{
+				impostorShader.use();
+				glBindVertexArray(impostorVAO);
+				glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, count, batch.first);
+				continue;
+			}
+
+			shader.use();
+			for (auto& mesh : batch.model->meshes)
+			{
+				glBindVertexArray(mesh.VAO);
+				if (std::find(instancedVAOs.begin(), instancedVAOs.end(), mesh.VAO) == instancedVAOs.end())
+				{
+					setupInstanceAttributes();
+					instancedVAOs.push_back(mesh.VAO);
+				}
+				glDrawElementsInstancedBaseInstance(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, 0, count, batch.first);
+			}
+		}
+		glBindVertexArray(0);
+	}
+
+	// number of instanced draws issued by draw()
+	GLint drawCalls() const
+	{
+		GLint calls = 0;
+		for (auto& batch : batches)
+			if (!batch.instances.empty())
+				calls += batch.model ? (GLint)batch.model->meshes.size() : 1;
+		return calls;
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteBuffers(1, &VBO);
+		glDeleteVertexArrays(1, &impostorVAO);
+	}
+
+private:
+	struct Batch
+	{
+		const Model* model = nullptr;
+		std::vector<ProxyInstance> instances;
+		GLuint first = 0; // base instance in the buffer, set by upload()
+	};
+
+	GLuint impostorVAO; // instance attributes only, the quad corners come from gl_VertexID
+	size_t capacity;
+	std::vector<Batch> batches;
+	std::vector<ProxyInstance> instances;
+	std::vector<GLuint> instancedVAOs; // mesh VAOs that already have the instance attributes
+
+	Batch& batch(const Model* model)
+	{
+		auto batch = std::find_if(batches.begin(), batches.end(), [model](const Batch& b) { return b.model == model; });
+		if (batch != batches.end())
+			return *batch;
+		batches.push_back(Batch());
+		batches.back().model = model;
+		return batches.back();
+	}
+
+	// instance attributes of the bound VAO. The buffer is orphaned, never recreated,
+	// so the pointers stay valid across uploads.
+	void setupInstanceAttributes()
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(ProxyInstance),
+				(void*)(offsetof(ProxyInstance, model) + sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(INSTANCE_LOCATION + column, 1);
+		}
+		glEnableVertexAttribArray(INSTANCE_LOCATION + 4);
+		glVertexAttribPointer(INSTANCE_LOCATION + 4, 3, GL_FLOAT, GL_FALSE, sizeof(ProxyInstance), (void*)offsetof(ProxyInstance, color));
+		glVertexAttribDivisor(INSTANCE_LOCATION + 4, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Animation of the moving sphere lights of scene 2.
+// The state of every light lives in structure-of-arrays form, one float array per
+// field, and is advanced SIMD-width lights at a time with the kernels of simd.h.
+// Large counts are split into chunks that run on a thread pool.
+//
+// Random parameters come from a counter-based generator: the value of a parameter
+// depends only on the seed, the light index and the parameter, so lights can be
+// created in any order and a seed always gives the same scene.
+//
+// A light bounces between the plane borders along a straight line while hopping
+// up and down; its LTC points are the square around the center that
+// SphereLight::updatePoints computes for a sphere lit from the plane below it.
+// --------------------------------------------------------------------------------
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <future>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "simd.h"
+#include "threadPool.h"
+
+namespace simulation
+{
+#if defined(SIMD_HAS_AVX2)
+	typedef simd::avx2::ISA ISA;
+#elif defined(SIMD_HAS_NEON)
+	typedef simd::neon::ISA ISA;
+#elif defined(SIMD_HAS_SSE4)
+	typedef simd::sse4::ISA ISA;
+#else
+	typedef simd::scalar::ISA ISA;
+#endif
+
+	// uniform float in [0, 1) for parameter stream of light counter (SplitMix64 finalizer)
+	inline float counterRandom(uint32_t seed, uint32_t counter, uint32_t stream)
+	{
+		uint64_t x = ((uint64_t)seed << 32 | counter) + (stream + 1) * 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return (float)(x >> 40) * (1.0f / 16777216.0f);
+	}
+
+	inline float counterRandom(uint32_t seed, uint32_t counter, uint32_t stream, float min, float max)
+	{
+		return min + (max - min) * counterRandom(seed, counter, stream);
+	}
+}
+
+class LightSimulation
+{
+public:
+	typedef simulation::ISA ISA;
+
+	// lights turn around when their center reaches this distance from the plane center
+	static constexpr float BOUNDARY = 29.5f;
+	// lights processed by one pool task
+	static const size_t CHUNK_SIZE = 8192;
+
+	// fixed per light
+	std::vector<float> radius, speed, bounceHeight, intensity;
+	std::vector<float> colorR, colorG, colorB;
+	// animation state
+	std::vector<float> originX, originZ; // start of the current straight run
+	std::vector<float> dirX, dirZ; // unit direction of the run
+	std::vector<float> time; // seconds since the start of the run
+	std::vector<float> phase, phaseSign; // argument of the hop and the direction it advances
+	// derived by update()
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extent; // half size of the square of LTC points
+
+	// parameters of count lights drawn from seed, arrays are padded to the SIMD width
+	LightSimulation(size_t count, uint32_t seed) : count(count)
+	{
+		auto padded = (count + ISA::width - 1) / ISA::width * ISA::width;
+		for (auto array : arrays())
+			array->resize(padded);
+
+		using simulation::counterRandom;
+		for (uint32_t i = 0; i < padded; i++)
+		{
+			auto r = counterRandom(seed, i, 0, 0.3f, 0.4f);
+			auto dir = glm::normalize(glm::vec2(counterRandom(seed, i, 3, -1.0f, 1.0f), counterRandom(seed, i, 4, -1.0f, 1.0f)));
+			radius[i] = r;
+			originX[i] = centerX[i] = counterRandom(seed, i, 1, -25.0f, 25.0f);
+			originZ[i] = centerZ[i] = counterRandom(seed, i, 2, -25.0f, 25.0f);
+			centerY[i] = r + 0.1f;
+			dirX[i] = dir.x;
+			dirZ[i] = dir.y;
+			speed[i] = counterRandom(seed, i, 5, 1.0f, 2.0f);
+			bounceHeight[i] = counterRandom(seed, i, 6, 1.0f, 2.0f);
+			colorR[i] = counterRandom(seed, i, 7, 0.3f, 1.0f);
+			colorG[i] = counterRandom(seed, i, 8, 0.3f, 1.0f);
+			colorB[i] = counterRandom(seed, i, 9, 0.3f, 1.0f);
+			intensity[i] = counterRandom(seed, i, 10, 1.0f, 5.0f);
+			time[i] = 0.0f;
+			phase[i] = 0.0f;
+			phaseSign[i] = 1.0f;
+			extent[i] = r * sqrt(1.0f - (r / centerY[i]) * (r / centerY[i]));
+		}
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	// advance the first numLights lights by deltaTime, in parallel on pool when given
+	void update(float deltaTime, size_t numLights, ThreadPool* pool = nullptr)
+	{
+		numLights = std::min(numLights, count);
+		auto padded = (numLights + ISA::width - 1) / ISA::width * ISA::width;
+		if (!pool || padded <= CHUNK_SIZE)
+		{
+			updateRange(deltaTime, 0, padded);
+			return;
+		}
+
+		// the calling thread takes the first chunk instead of waiting idle
+		std::vector<std::future<void>> chunks;
+		for (size_t begin = CHUNK_SIZE; begin < padded; begin += CHUNK_SIZE)
+		{
+			auto end = std::min(begin + CHUNK_SIZE, padded);
+			chunks.push_back(pool->submit([this, deltaTime, begin, end] { updateRange(deltaTime, begin, end); }));
+		}
+		updateRange(deltaTime, 0, CHUNK_SIZE);
+		for (auto& chunk : chunks)
+			chunk.wait();
+	}
+
+	glm::vec3 center(size_t i) const
+	{
+		return glm::vec3(centerX[i], centerY[i], centerZ[i]);
+	}
+
+	glm::vec3 color(size_t i) const
+	{
+		return glm::vec3(colorR[i], colorG[i], colorB[i]);
+	}
+
+	// the LTC points of light i, in the order of SphereLight::points
+	void points(size_t i, glm::vec3 points[4]) const
+	{
+		auto c = center(i);
+		auto e = extent[i];
+		points[0] = c + glm::vec3(-e, 0.0f, e);
+		points[1] = c + glm::vec3(e, 0.0f, e);
+		points[2] = c + glm::vec3(e, 0.0f, -e);
+		points[3] = c + glm::vec3(-e, 0.0f, -e);
+	}
+
+private:
+	size_t count;
+
+	std::vector<std::vector<float>*> arrays()
+	{
+		return { &radius, &speed, &bounceHeight, &intensity, &colorR, &colorG, &colorB, &originX, &originZ, &dirX, &dirZ,
+			&time, &phase, &phaseSign, &centerX, &centerY, &centerZ, &extent };
+	}
+
+	// lights [begin, end), both multiples of the SIMD width
+	void updateRange(float deltaTime, size_t begin, size_t end)
+	{
+		typedef ISA::Float Float;
+		Float dt(deltaTime), boundary(BOUNDARY), one(1.0f);
+
+		for (size_t i = begin; i < end; i += ISA::width)
+		{
+			Float ox = ISA::load(&originX[i]), oz = ISA::load(&originZ[i]);
+			Float dx = ISA::load(&dirX[i]), dz = ISA::load(&dirZ[i]);
+			Float v = ISA::load(&speed[i]);
+			Float t = ISA::load(&time[i]) + dt;
+			Float sign = ISA::load(&phaseSign[i]);
+			Float s = ISA::load(&phase[i]) + sign * dt;
+
+			// at a border the run restarts from the last center in the opposite direction,
+			// and the hop turns back so that its phase stays where it was
+			Float x = ox + v * dx * t, z = oz + v * dz * t;
+			auto bounce = (abs(x) >= boundary) | (abs(z) >= boundary);
+			ox = select(bounce, ISA::load(&centerX[i]), ox);
+			oz = select(bounce, ISA::load(&centerZ[i]), oz);
+			dx = select(bounce, -dx, dx);
+			dz = select(bounce, -dz, dz);
+			sign = select(bounce, -sign, sign);
+			s = select(bounce, s + sign * dt, s);
+			t = select(bounce, dt, t);
+			x = ox + v * dx * t;
+			z = oz + v * dz * t;
+
+			// half size of the disk facing the point below the center, see SphereLight::updatePoints
+			Float r = ISA::load(&radius[i]);
+			Float y = r + ISA::load(&bounceHeight[i]) * abs(simd::sin(s)) + Float(0.1f);
+			Float q = r / y;
+
+			store(&originX[i], ox);
+			store(&originZ[i], oz);
+			store(&dirX[i], dx);
+			store(&dirZ[i], dz);
+			store(&time[i], t);
+			store(&phase[i], s);
+			store(&phaseSign[i], sign);
+			store(&centerX[i], x);
+			store(&centerY[i], y);
+			store(&centerZ[i], z);
+			store(&extent[i], r * sqrt(one - q * q));
+		}
+	}
+};
@@ -1,7 +1,11 @@
 ﻿#version 460 core
 
 layout (location = 0) in vec3 aPos;
+#ifdef COMPACT_VERTEX
+layout (location = 1) in vec4 aQTangent; // CompactVertex in mesh.h
+#else
 layout (location = 1) in vec3 aNormal;
+#endif
 layout (location = 2) in vec2 aTexCoords;
 
 // world space
@@ -16,8 +20,20 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#ifdef COMPACT_VERTEX
+// third column of the quaternion's rotation
+vec3 QTangentNormal(vec4 q)
+{
+	q = normalize(q);
+	return vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+}
+#endif
+
 void main()
 {
+#ifdef COMPACT_VERTEX
+	vec3 aNormal = QTangentNormal(aQTangent);
+#endif
 	vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
 	vs_out.normal = mat3(transpose(inverse(model))) * aNormal;
 	vs_out.texCoords = aTexCoords;
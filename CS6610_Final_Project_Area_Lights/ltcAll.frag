@@ -1,8 +1,16 @@
 ﻿#version 460 core
 
-#define NUM_LIGHTS 4
 #define NUM_POINTS 4
-#define MAX_SPHERE_LIGHTS 100 
+
+// specialization, injected by the application (see ShaderDefines).
+// PLANE_TYPE and DITHERING turn their uniforms into constants, LIGHT_TYPES is a bit mask
+// of the light types that can occur, GROUP_BY_TYPE runs one loop per type over lightTypeRanges.
+// SEPARATE_LTC evaluates diffuse and specular with one evaluator call each instead of the
+// fused evaluators, to compare the two. LTC_ANALYTIC replaces the LTC table fetches by
+// polynomial fits of the tables, trading texture bandwidth for ALU.
+#ifndef LIGHT_TYPES
+#define LIGHT_TYPES 15
+#endif
 
 out vec4 fragColor;
 
@@ -12,25 +20,34 @@ in ES_OUT
 	vec3 normal;
 	vec2 texCoords;
 	mat3 TBN;
+	vec3 viewDir; // tangent space, not normalized
 } fs_in;
 
+// std430 light record, mirrors GPULight in lightBuffer.h
 struct Light
 {
-    int type; // 0: sphere, 1: rectangle, 2: disk, 3: cylinder
-    float radius; // only for cylinder light
-    float intensity;
+    vec4 points[NUM_POINTS]; // xyz: LTC points
+    vec4 boundingSphere; // xyz: center, w: radius of the influence region
 	vec3 lightColor;
-    vec3 points[NUM_POINTS];
+    float intensity;
+    int type; // 0: rectangle, 1: cylinder, 2: disk, 3: sphere
+    float radius; // only for cylinder light
+    float range; // influence range around the light shape
+};
+layout (std430, binding = 0) readonly buffer LightBuffer
+{
+    Light lights[];
 };
-uniform Light lights[NUM_LIGHTS];
 
-struct SphereLight
+// per-cluster light lists, see clusteredLights.h
+layout (std430, binding = 1) readonly buffer ClusterGrid
 {
-    float intensity;
-    vec3 lightColor;
-    vec3 points[4];
+    uvec2 clusters[]; // x: offset, y: count
+};
+layout (std430, binding = 2) readonly buffer ClusterIndices
+{
+    uint lightIndices[];
 };
-uniform SphereLight sphereLights[MAX_SPHERE_LIGHTS];
 
 struct Material
 {
@@ -48,17 +65,188 @@ uniform Material material;
 
 uniform sampler2D LTC1; // for inverse M
 uniform sampler2D LTC2; // GGX norm, fresnel, 0(unused), sphere
+#ifdef PLANE_TYPE
+const int planeType = PLANE_TYPE;
+#else
 uniform int planeType; // 0: Default, 1: stone, 2: marble, 3: wood, 4: diamond plate
-uniform vec3 cameraPos;
-uniform int numSphereLights;
+#endif
+uniform int numLights;
+uniform ivec2 lightTypeRanges[4]; // x: first light, y: count, lights are grouped by type
+#ifdef DITHERING
+const bool dithering = DITHERING != 0;
+#else
 uniform bool dithering;
+#endif
 uniform mat4 normalMapRot;
-
-const float LUT_SIZE  = 64.0; // ltc_texture size 
+uniform mat4 view;
+
+// clustered light culling
+#define CLUSTER_GRID uvec3(16, 9, 24)
+uniform bool clustered;
+uniform vec2 clusterTileSize; // in pixels
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+#ifndef LTC_LUT_SIZE
+#define LTC_LUT_SIZE 64 // texels per side of the LTC tables, injected by the application
+#endif
+const float LUT_SIZE  = float(LTC_LUT_SIZE); // ltc_texture size
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
 const float LUT_BIAS  = 0.5/LUT_SIZE;
 const float PI = 3.14159265;
 
+#ifdef LTC_ANALYTIC
+// generated by LTC_Approximation from LTC.h
+const int LTC_FIT_DEGREE = 6;
+const vec4 LTC1_FIT[28] = vec4[](
+    vec4(1.06395781, -0.0115029393, 0.0373958685, 2.08692956),
+    vec4(-1.24138677, -0.655098557, -0.688793004, -0.828455865),
+    vec4(-0.291450828, -1.49610674, 1.08293366, -1.90883422),
+    vec4(8.70102024, 7.79254246, 4.80584574, 3.14359713),
+    vec4(4.3209424, -9.94857693, 4.50237608, 15.6581573),
+    vec4(-1.66934252, -4.78490114, 0.676159859, 3.55694556),
+    vec4(-29.6657906, -30.569416, -17.2017269, -6.27386999),
+    vec4(-16.13937, 24.7826157, -19.1350517, -42.3419113),
+    vec4(-8.59981441, 21.0915489, -7.59039164, -50.2427101),
+    vec4(1.33649814, 12.8205566, -2.14576173, -10.6505365),
+    vec4(52.9439583, 54.52351, 32.6667137, 6.28204727),
+    vec4(18.5728855, -28.9499817, 37.9823341, 53.2683563),
+    vec4(29.3281975, -31.3774643, 21.3294945, 85.8231354),
+    vec4(2.65384912, -13.3757191, 2.41203809, 65.072937),
+    vec4(-2.43815088, -13.410471, 0.416319638, 5.16761446),
+    vec4(-47.0512733, -45.6418533, -30.4450684, -6.5263586),
+    vec4(-1.9048121, 32.0914955, -39.5729179, -31.5366879),
+    vec4(-23.7833233, 5.41999388, -14.0682516, -40.5666389),
+    vec4(-17.47052, 14.6077089, -11.3221579, -78.781456),
+    vec4(5.3509407, -0.421789616, 3.7307241, -31.7306328),
+    vec4(2.82763004, 11.8277731, -0.846262038, 4.00842333),
+    vec4(16.3067093, 14.5768661, 10.8367853, 3.25529838),
+    vec4(-5.03009844, -16.6140461, 15.4495745, 6.74271822),
+    vec4(6.46475983, 9.39694786, -1.78396046, 1.75611937),
+    vec4(9.80846882, -9.97624779, 12.5058174, 26.4025459),
+    vec4(0.188570052, 2.59968352, -3.3819356, 18.7928219),
+    vec4(-2.74446201, 0.465133995, -0.885997415, 4.37547445),
+    vec4(-0.831831098, -4.80051327, 0.690912664, -2.39578629));
+const vec2 LTC2_FIT[28] = vec2[](
+    vec2(1.01633143, -0.00452955533),
+    vec2(-0.33956334, 0.00536644785),
+    vec2(0.118875198, 0.21202752),
+    vec2(2.1294415, 0.124198616),
+    vec2(-1.66963685, -0.0682204887),
+    vec2(-0.16802907, -2.580091),
+    vec2(-3.42768836, -1.05966914),
+    vec2(2.37571335, 4.74997044),
+    vec2(9.09908295, -7.75839376),
+    vec2(-2.30280137, 14.7347612),
+    vec2(-3.4603548, 1.49178052),
+    vec2(5.64109373, -4.55939627),
+    vec2(-33.7021828, -4.23297262),
+    vec2(2.23074126, 21.4998608),
+    vec2(4.32300425, -34.6567688),
+    vec2(6.97302723, -0.00930730905),
+    vec2(-8.48709393, -6.07450724),
+    vec2(22.1437435, 27.2305984),
+    vec2(32.3179932, -31.3105507),
+    vec2(-22.5276508, -3.5581224),
+    vec2(-0.995341778, 31.9775963),
+    vec2(-2.59537888, -0.521471858),
+    vec2(2.61527395, 4.88019943),
+    vec2(-2.71097708, -8.80145741),
+    vec2(-14.5948076, -6.68729353),
+    vec2(-4.9243803, 25.0044327),
+    vec2(12.8231869, -11.3160896),
+    vec2(-1.00930619, -8.67063141));
+const int SPHERE_FIT_DEGREE = 5;
+const float SPHERE_FIT[21] = float[](
+    0.0179505832,
+    0.499752432,
+    0.8070997,
+    1.13170576,
+    0.00202129246,
+    -3.30972171,
+    -0.000397621072,
+    -3.32147193,
+    -0.00511084078,
+    8.83996487,
+    0.104481302,
+    0.00106826797,
+    4.4558177,
+    0.00511480169,
+    -10.5826073,
+    -3.35030086e-06,
+    -0.058267422,
+    -0.00068591343,
+    -2.27294827,
+    -0.00177054433,
+    4.69606781);
+
+// polynomial fits of LTC1 and LTC2.xy at (roughness, sqrt(1 - cos_theta)), roughness >= 0.1
+void LTC_Lookup(vec2 uv, out vec4 t1, out vec4 t2)
+{
+    float x[LTC_FIT_DEGREE + 1], y[LTC_FIT_DEGREE + 1];
+    x[0] = 1.0;
+    y[0] = 1.0;
+    for (int i = 1; i <= LTC_FIT_DEGREE; i++)
+    {
+        x[i] = x[i - 1]*uv.x;
+        y[i] = y[i - 1]*uv.y;
+    }
+    t1 = vec4(0.0);
+    vec2 norms = vec2(0.0);
+    int k = 0;
+    for (int d = 0; d <= LTC_FIT_DEGREE; d++)
+    {
+        for (int j = 0; j <= d; j++, k++)
+        {
+            float m = x[d - j]*y[j];
+            t1 += LTC1_FIT[k]*m;
+            norms += LTC2_FIT[k]*m;
+        }
+    }
+    t1.yw *= uv.x*uv.x; // fitted divided by alpha
+    t2 = vec4(norms, 0.0, 0.0);
+}
+
+// horizon-clipped sphere scale of form factor len in direction z
+float SphereScale(float z, float len)
+{
+    // entirely above or below the horizon
+    if (z*z >= len)
+        return max(z, 0.0);
+
+    float x[SPHERE_FIT_DEGREE + 1], y[SPHERE_FIT_DEGREE + 1];
+    x[0] = 1.0;
+    y[0] = 1.0;
+    for (int i = 1; i <= SPHERE_FIT_DEGREE; i++)
+    {
+        x[i] = x[i - 1]*z;
+        y[i] = y[i - 1]*len;
+    }
+    float scale = 0.0;
+    int k = 0;
+    for (int d = 0; d <= SPHERE_FIT_DEGREE; d++)
+        for (int j = 0; j <= d; j++, k++)
+            scale += SPHERE_FIT[k]*x[d - j]*y[j];
+    return max(scale, 0.0);
+}
+#else
+// LTC1 (inverse M) and LTC2 (norm, Fresnel) at (roughness, sqrt(1 - cos_theta))
+void LTC_Lookup(vec2 uv, out vec4 t1, out vec4 t2)
+{
+    uv = uv*LUT_SCALE + LUT_BIAS;
+    t1 = texture(LTC1, uv);
+    t2 = texture(LTC2, uv);
+}
+
+// tabulated horizon-clipped sphere scale of form factor len in direction z
+float SphereScale(float z, float len)
+{
+    vec2 uv = vec2(z*0.5 + 0.5, len); // range [0, 1]
+    uv = uv*LUT_SCALE + LUT_BIAS;
+    return texture(LTC2, uv).w;
+}
+#endif
+
 
 // -----------------------------------------------------
 // utility functions
@@ -126,9 +314,11 @@ float I_ltc_line(vec3 p1, vec3 p2, mat3 Minv)
     vec3 p2o = Minv * p2;
     float I_diffuse = I_diffuse_line(p1o, p2o);
 
-    // width factor
+    // width factor 1/|inverse(transpose(Minv)) * ortho|, where
+    // inverse(transpose(Minv)) = cofactor / det, without inverting the matrix
+    mat3 cofactor = mat3(cross(Minv[1], Minv[2]), cross(Minv[2], Minv[0]), cross(Minv[0], Minv[1]));
     vec3 ortho = normalize(cross(p1, p2));
-    float w =  1.0 / length(inverse(transpose(Minv)) * ortho);
+    float w = abs(dot(Minv[0], cofactor[0])) / length(cofactor * ortho);
 
     return w * I_diffuse;
 }
@@ -221,27 +411,9 @@ vec3 SolveCubic(vec4 Coefficient)
 // -----------------------------------------------------
 // 2D polygon light LTC (rectangle & star)
 // -----------------------------------------------------
-vec3 LTC_Evaluate_Polygon(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4])
+// form factor of the polygon L, given in the cosine distribution's space
+float PolygonFormFactor(vec3 L[4], bool behind)
 {
-    // construct orthonormal basis around N
-    vec3 T1, T2;
-    T1 = normalize(V - N * dot(V, N));
-    T2 = cross(N, T1);
-
-    Minv = Minv * transpose(mat3(T1, T2, N)); 
-
-    vec3 L[5];
-    L[0] = Minv * (points[0] - P); 
-    L[1] = Minv * (points[1] - P);
-    L[2] = Minv * (points[2] - P);
-    L[3] = Minv * (points[3] - P);
-
-    float sum = 0.0;
-
-    vec3 dir = points[0] - P; 
-    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
-    bool behind = (dot(dir, lightNormal) < 0.0); 
-
     L[0] = normalize(L[0]);
     L[1] = normalize(L[1]);
     L[2] = normalize(L[2]);
@@ -261,67 +433,82 @@ vec3 LTC_Evaluate_Polygon(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4])
     if (behind)
         z = -z;
     
-    vec2 uv = vec2(z*0.5 + 0.5, len); // range [0, 1]
-    uv = uv*LUT_SCALE + LUT_BIAS;
-    
-    float scale = texture(LTC2, uv).w;
-    sum = len*scale;       
+    float scale = SphereScale(z, len);
+    return len*scale;
+}
+
+// R rotates world space offsets into the LTC shading frame of the fragment, see main
+vec3 LTC_Evaluate_Polygon(mat3 R, vec3 P, mat3 Minv, vec3 points[4])
+{
+    Minv = Minv * R;
+
+    vec3 L[4];
+    L[0] = Minv * (points[0] - P); 
+    L[1] = Minv * (points[1] - P);
+    L[2] = Minv * (points[2] - P);
+    L[3] = Minv * (points[3] - P);
+
+    vec3 dir = points[0] - P; 
+    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
+    bool behind = (dot(dir, lightNormal) < 0.0); 
+
+    float sum = PolygonFormFactor(L, behind);
     vec3 Lo_i = vec3(sum, sum, sum);
 
     return Lo_i;
 }
 
+// x: diffuse, y: specular; the basis, the points and the behind test are shared by both
+vec2 LTC_Evaluate_Polygon_Fused(mat3 R, vec3 P, mat3 Minv, vec3 points[4])
+{
+    // the diffuse distribution is the cosine one, so its points need no further transform
+    vec3 L[4];
+    L[0] = R * (points[0] - P);
+    L[1] = R * (points[1] - P);
+    L[2] = R * (points[2] - P);
+    L[3] = R * (points[3] - P);
+
+    vec3 dir = points[0] - P;
+    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
+    bool behind = (dot(dir, lightNormal) < 0.0);
+
+    vec3 Ls[4] = vec3[](Minv * L[0], Minv * L[1], Minv * L[2], Minv * L[3]);
+    return vec2(PolygonFormFactor(L, behind), PolygonFormFactor(Ls, behind));
+}
+
 
 // -----------------------------------------------------
 // line light LTC (cylinder)
 // -----------------------------------------------------
-vec3 LTC_Evaluate_Line(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[2], float radius)
+vec3 LTC_Evaluate_Line(mat3 R, vec3 P, mat3 Minv, vec3 points[2], float radius)
 {
-    // construct orthonormal basis around N
-    vec3 T1, T2;
-    T1 = normalize(V - N*dot(V, N));
-    T2 = cross(N, T1);
-
-    mat3 B = transpose(mat3(T1, T2, N));
-
-    vec3 p1 = B * (points[0] - P);
-    vec3 p2 = B * (points[1] - P);
+    vec3 p1 = R * (points[0] - P);
+    vec3 p2 = R * (points[1] - P);
 
     float Iline = radius * I_ltc_line(p1, p2, Minv);
 
     return vec3(min(1.0, Iline));
 }
 
-
-// -----------------------------------------------------
-// disk light LTC (disk & sphere)
-// -----------------------------------------------------
-vec3 LTC_Evaluate_Disk(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4])
+// x: diffuse, y: specular
+vec2 LTC_Evaluate_Line_Fused(mat3 R, vec3 P, mat3 Minv, vec3 points[2], float radius)
 {
-    // construct orthonormal basis around N
-    vec3 T1, T2;
-    T1 = normalize(V - N*dot(V, N));
-    T2 = cross(N, T1);
+    vec3 p1 = R * (points[0] - P);
+    vec3 p2 = R * (points[1] - P);
 
-    // rotate area light in (T1, T2, N) basis
-    mat3 R = transpose(mat3(T1, T2, N));
+    // the width factor of the cosine distribution is 1
+    vec2 Iline = radius * vec2(I_diffuse_line(p1, p2), I_ltc_line(p1, p2, Minv));
 
-    // 3 of the 4 vertices around disk
-    vec3 L_[3];
-    L_[0] = R * (points[0] - P);
-    L_[1] = R * (points[1] - P);
-    L_[2] = R * (points[2] - P);
+    return min(vec2(1.0), Iline);
+}
 
-    // init ellipse
-    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
-    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
-    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
-
-    // back to cosine distribution, but V1 and V2 no longer ortho.
-    C  = Minv * C;
-    V1 = Minv * V1;
-    V2 = Minv * V2;
 
+// -----------------------------------------------------
+// disk light LTC (disk & sphere)
+// -----------------------------------------------------
+// form factor of the ellipse with center C and axes V1, V2, given in the cosine distribution's space
+float DiskFormFactor(vec3 C, vec3 V1, vec3 V2)
+{
     // compute eigenvectors of ellipse
     float a, b;
     float d11 = dot(V1, V1); // q11
@@ -334,7 +521,8 @@ vec3 LTC_Evaluate_Disk(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4])
 
         // use sqrt matrix to solve for eigenvalues
         det = sqrt(det);
-        float u = 0.5*sqrt(tr - 2.0*det);
+        // tr - 2*det without the cancellation that leaves nothing of a near circle
+        float u = 0.5*sqrt(((d11 - d22)*(d11 - d22) + 4.0*d12*d12)/(tr + 2.0*det));
         float v = 0.5*sqrt(tr + 2.0*det);
         float e_max = (u + v) * (u + v); // e2
         float e_min = (u - v) * (u - v); // e1
@@ -408,17 +596,118 @@ vec3 LTC_Evaluate_Disk(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4])
     // projected solid angle E, like the length(F) in rectangle light
     float formFactor = L1*L2*inversesqrt((1.0 + L1*L1)*(1.0 + L2*L2));
 
-    // use tabulated horizon-clipped sphere
-    vec2 uv = vec2(avgDir.z*0.5 + 0.5, formFactor);
-    uv = uv*LUT_SCALE + LUT_BIAS;
-    float scale = texture(LTC2, uv).w;
+    // horizon-clipped sphere
+    float scale = SphereScale(avgDir.z, formFactor);
+
+    return formFactor*scale;
+}
 
-    float spec = formFactor*scale;
+vec3 LTC_Evaluate_Disk(mat3 R, vec3 P, mat3 Minv, vec3 points[4])
+{
+    // 3 of the 4 vertices around disk
+    vec3 L_[3];
+    L_[0] = R * (points[0] - P);
+    L_[1] = R * (points[1] - P);
+    L_[2] = R * (points[2] - P);
+
+    // init ellipse
+    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
+    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
+    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
+
+    // back to cosine distribution, but V1 and V2 no longer ortho.
+    C  = Minv * C;
+    V1 = Minv * V1;
+    V2 = Minv * V2;
+
+    float spec = DiskFormFactor(C, V1, V2);
     vec3 Lo_i = vec3(spec, spec, spec);
 
     return Lo_i;
 }
 
+// x: diffuse, y: specular; the basis and the ellipse are shared by both
+vec2 LTC_Evaluate_Disk_Fused(mat3 R, vec3 P, mat3 Minv, vec3 points[4])
+{
+    // 3 of the 4 vertices around disk
+    vec3 L_[3];
+    L_[0] = R * (points[0] - P);
+    L_[1] = R * (points[1] - P);
+    L_[2] = R * (points[2] - P);
+
+    // init ellipse
+    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
+    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
+    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
+
+    return vec2(DiskFormFactor(C, V1, V2), DiskFormFactor(Minv * C, Minv * V1, Minv * V2));
+}
+
+// index of the cluster the fragment falls in
+uint ClusterIndex(vec3 P)
+{
+    float depth = -(view * vec4(P, 1.0)).z;
+    uint slice = uint(clamp(log(depth) * clusterSliceScale + clusterSliceBias, 0.0, float(CLUSTER_GRID.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), CLUSTER_GRID.xy - 1);
+    return tile.x + CLUSTER_GRID.x * (tile.y + CLUSTER_GRID.y * slice);
+}
+
+// type is a constant in the grouped loops, so only one branch survives there
+vec3 EvaluateLight(int i, int type, mat3 R, vec3 P, mat3 Minv, vec4 t2, vec3 mDiffuse, vec3 mSpecular)
+{
+    vec3 lightPoints[4] = vec3[](lights[i].points[0].xyz, lights[i].points[1].xyz, lights[i].points[2].xyz, lights[i].points[3].xyz);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+#ifdef SEPARATE_LTC
+#if (LIGHT_TYPES & 1) != 0
+    if (type == 0)
+    {
+        diffuse += LTC_Evaluate_Polygon(R, P, mat3(1), lightPoints);
+        specular += LTC_Evaluate_Polygon(R, P, Minv, lightPoints);
+    }
+#endif
+#if (LIGHT_TYPES & 2) != 0
+    if (type == 1)
+    {
+        vec3 linePoints[2] = vec3[](lightPoints[0], lightPoints[1]);
+        diffuse += LTC_Evaluate_Line(R, P, mat3(1), linePoints, lights[i].radius);
+        specular += LTC_Evaluate_Line(R, P, Minv, linePoints, lights[i].radius);
+    }
+#endif
+#if (LIGHT_TYPES & 12) != 0
+    if (type == 2 || type == 3)
+    {
+        diffuse += LTC_Evaluate_Disk(R, P, mat3(1), lightPoints);
+        specular += LTC_Evaluate_Disk(R, P, Minv, lightPoints);
+    }
+#endif
+#else
+    vec2 Lo_i = vec2(0.0); // x: diffuse, y: specular
+#if (LIGHT_TYPES & 1) != 0
+    if (type == 0)
+        Lo_i = LTC_Evaluate_Polygon_Fused(R, P, Minv, lightPoints);
+#endif
+#if (LIGHT_TYPES & 2) != 0
+    if (type == 1)
+    {
+        vec3 linePoints[2] = vec3[](lightPoints[0], lightPoints[1]);
+        Lo_i = LTC_Evaluate_Line_Fused(R, P, Minv, linePoints, lights[i].radius);
+    }
+#endif
+#if (LIGHT_TYPES & 12) != 0
+    if (type == 2 || type == 3)
+        Lo_i = LTC_Evaluate_Disk_Fused(R, P, Minv, lightPoints);
+#endif
+    diffuse = vec3(Lo_i.x);
+    specular = vec3(Lo_i.y);
+#endif
+    // GGX BRDF shadowing and Fresnel
+    specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
+
+    vec3 color = lights[i].intensity * lights[i].lightColor * (specular + mDiffuse * diffuse);
+    return type == 1 ? color / (2.0 * PI) : color;
+}
+
 void main()
 {
     vec3 result = vec3(0.0);
@@ -433,38 +722,35 @@ void main()
     {
         mDiffuse = ToLinear(material.diffuse);
         mSpecular = ToLinear(material.specular);
-        normal = fs_in.normal;
-        N = normalize(normal);
+        N = vec3(0.0, 0.0, 1.0); // the geometric normal
         roughness = material.roughness;
     }
     // diffuse, normal, roughness map
     else 
     {
+        // sRGB texture, already linear
         vec3 basecolor = texture(material.texture_diffuse, texCoords).rgb;
         basecolor *= AO;
-        mDiffuse = ToLinear((1 - metallic) * basecolor);
-        mSpecular = ToLinear(metallic * basecolor);
-        normal = texture(material.texture_normal, texCoords).rgb; // [0, 1]
-        normal = normal * 2.0 - 1.0; // [-1, 1]
-        N = normalize(fs_in.TBN * normal);
-        //normal = fs_in.normal;
-        //N = normalize(normal);
+        mDiffuse = (1 - metallic) * basecolor;
+        mSpecular = metallic * basecolor;
+        // x and y only (BC5), z is rebuilt from the unit length
+        normal.xy = texture(material.texture_normal, texCoords).rg * 2.0 - 1.0; // [-1, 1]
+        normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
+        N = normalize(normal);
         roughness = texture(material.texture_roughness, texCoords).r;
         result += vec3(0.4) * mDiffuse * AO; // ambient 
     }
-    vec3 V = normalize(cameraPos - fs_in.fragPos);
+    // N and V are in tangent space, which the orthonormal TBN makes as good as world space for the tables
+    vec3 V = normalize(fs_in.viewDir);
     float NdotV = clamp(dot(N, V), 0.0, 1.0);
 
     // use roughness and sqrt(1-cos_theta) to sample M_texture
     roughness = max(0.1, roughness); // cannot < 0.08
     vec2 uv = vec2(roughness, sqrt(1.0 - NdotV));
-    uv = uv*LUT_SCALE + LUT_BIAS;   
-
-    // get 4 parameters for inverse_M
-    vec4 t1 = texture(LTC1, uv); 
 
-    // Get 2 parameters for Fresnel calculation
-    vec4 t2 = texture(LTC2, uv);
+    // t1: 4 parameters for inverse_M, t2: 2 parameters for Fresnel calculation
+    vec4 t1, t2;
+    LTC_Lookup(uv, t1, t2);
 
     mat3 Minv = mat3(
         vec3(t1.x, 0, t1.y),
@@ -472,42 +758,45 @@ void main()
         vec3(t1.z, 0, t1.w)
     );
 
+    // LTC shading frame around N, composed with TBN so that the evaluators take the light
+    // points from world space to it in one rotation, built once for all lights; a mirrored
+    // TBN (handedness -1) mirrors T2 as well, or the composition would be a reflection
+    vec3 T1 = normalize(V - N*dot(V, N));
+    vec3 T2 = cross(N, T1) * sign(determinant(fs_in.TBN));
+    mat3 R = transpose(fs_in.TBN * mat3(T1, T2, N));
+
     // Evaluate LTC shading
-    for (int i = 0; i < NUM_LIGHTS; i++)
+    if (clustered)
     {
-        int type = lights[i].type;
-        vec3 lightPoints[4] = lights[i].points;
-        vec3 diffuse = vec3(0.0);
-        vec3 specular = vec3(0.0);
-        if (type == 1)
-        {
-            diffuse += LTC_Evaluate_Polygon(N, V, fs_in.fragPos, mat3(1), lightPoints);
-            specular += LTC_Evaluate_Polygon(N, V, fs_in.fragPos, Minv, lightPoints);
-        }
-        else if (type == 3)
+        // only the lights assigned to this fragment's cluster
+        uvec2 cluster = clusters[ClusterIndex(fs_in.fragPos)];
+        for (uint k = cluster.x; k < cluster.x + cluster.y; k++)
         {
-            vec3 linePoints[2] = vec3[](lightPoints[0], lightPoints[1]);
-            diffuse += LTC_Evaluate_Line(N, V, fs_in.fragPos, mat3(1), linePoints, lights[i].radius);
-            specular += LTC_Evaluate_Line(N, V, fs_in.fragPos, Minv, linePoints, lights[i].radius);
+            int i = int(lightIndices[k]);
+            result += EvaluateLight(i, lights[i].type, R, fs_in.fragPos, Minv, t2, mDiffuse, mSpecular);
         }
-        else if (type == 0 || type == 2)
-        {
-            diffuse += LTC_Evaluate_Disk(N, V, fs_in.fragPos, mat3(1), lightPoints);
-            specular += LTC_Evaluate_Disk(N, V, fs_in.fragPos, Minv, lightPoints);
-        }
-        // GGX BRDF shadowing and Fresnel
-        specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
-
-        vec3 color = lights[i].intensity * lights[i].lightColor * (specular + mDiffuse * diffuse);
-        result += type == 3 ? color / (2.0 * PI) : color;
     }
-    for (int i = 0; i < numSphereLights; i++)
+    else
     {
-        vec3 diffuse = LTC_Evaluate_Disk(N, V, fs_in.fragPos, mat3(1), sphereLights[i].points);
-        vec3 specular = LTC_Evaluate_Disk(N, V, fs_in.fragPos, Minv, sphereLights[i].points);
-        // GGX BRDF shadowing and Fresnel
-        specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
-        result += sphereLights[i].intensity * sphereLights[i].lightColor * (specular + mDiffuse * diffuse);
+#ifdef GROUP_BY_TYPE
+        // one uniform loop per light type
+#if (LIGHT_TYPES & 1) != 0
+        for (int i = lightTypeRanges[0].x; i < lightTypeRanges[0].x + lightTypeRanges[0].y; i++)
+            result += EvaluateLight(i, 0, R, fs_in.fragPos, Minv, t2, mDiffuse, mSpecular);
+#endif
+#if (LIGHT_TYPES & 2) != 0
+        for (int i = lightTypeRanges[1].x; i < lightTypeRanges[1].x + lightTypeRanges[1].y; i++)
+            result += EvaluateLight(i, 1, R, fs_in.fragPos, Minv, t2, mDiffuse, mSpecular);
+#endif
+#if (LIGHT_TYPES & 12) != 0
+        // disk and sphere lights share the disk evaluator and are adjacent in the buffer
+        for (int i = lightTypeRanges[2].x; i < lightTypeRanges[3].x + lightTypeRanges[3].y; i++)
+            result += EvaluateLight(i, 2, R, fs_in.fragPos, Minv, t2, mDiffuse, mSpecular);
+#endif
+#else
+        for (int i = 0; i < numLights; i++)
+            result += EvaluateLight(i, lights[i].type, R, fs_in.fragPos, Minv, t2, mDiffuse, mSpecular);
+#endif
     }
 
     result += dithering ? ScreenSpaceDither(gl_FragCoord.xy) : vec3(0.0);
@@ -1,10 +1,16 @@
 ﻿#version 460 core
 
 layout (location = 0) in vec3 aPos;
+#ifdef COMPACT_VERTEX
+layout (location = 1) in vec4 aQTangent; // CompactVertex in mesh.h
+#else
 layout (location = 1) in vec3 aNormal;
+#endif
 layout (location = 2) in vec2 aTexCoords;
+#ifndef COMPACT_VERTEX
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+#endif
 
 out VS_OUT
 {
@@ -16,18 +22,37 @@ out VS_OUT
 
 uniform mat4 model;
 
+#ifdef COMPACT_VERTEX
+// first and third columns of the quaternion's rotation, the sign of w is the handedness
+void DecodeQTangent(vec4 q, out vec3 normal, out vec3 tangent, out float handedness)
+{
+	handedness = q.w < 0.0 ? -1.0 : 1.0;
+	q = normalize(q);
+	tangent = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+	normal = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+}
+#endif
+
 void main()
 {
+#ifdef COMPACT_VERTEX
+	vec3 aNormal, aTangent;
+	float handedness;
+	DecodeQTangent(aQTangent, aNormal, aTangent, handedness);
+#else
+	float handedness = dot(cross(aNormal, aTangent), aBitangent) < 0.0 ? -1.0 : 1.0;
+#endif
 	mat3 normalMatrix = transpose(inverse(mat3(model)));
 
 	vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
 	vs_out.texCoords = aTexCoords;
 	vs_out.normal = normalMatrix * aNormal;
 
+	// orthonormal, so that tangent space keeps the angles the LTC tables are indexed by
 	vec3 T = normalize(normalMatrix * aTangent);
-	vec3 N = vs_out.normal;
+	vec3 N = normalize(vs_out.normal);
 	T = normalize(T - dot(T, N) * N);
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * handedness;
 
 	mat3 TBN = mat3(T, B, N);
 	vs_out.TBN = TBN;
@@ -0,0 +1,733 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// CPU evaluation of the LTC area light integrals for batches of shading points,
+// a port of IntegrateEdgeVec / LTC_Evaluate_Polygon, I_ltc_line / I_diffuse_line
+// and LTC_Evaluate_Disk / SolveCubic from ltcAll.frag.
+// Used for offline baking, validating the shaders, and previews without a GPU.
+//
+// Shading points are passed in SoA layout and processed SIMD-width at a time.
+// The kernels are written once against simd.h and instantiated per backend.
+// projectEllipsoids computes the LTC points of sphere lights the same way, many
+// ellipsoids per call, with a closed-form 2x2 eigen decomposition.
+//
+//   ltc::Tables tables = { LTC1, LTC2, 64 }; // from LTC.h
+//   ltc::evaluate(tables, points, rectLight, result);
+//   color = intensity * lightColor * (result.specular * (F0 * result.norm + (1 - F0) * result.fresnel)
+//                                     + albedo * result.diffuse);
+// --------------------------------------------------------------------------------
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include "simd.h"
+
+namespace ltc
+{
+	// LTC1 (inverse M) and LTC2 (GGX norm, fresnel, 0, sphere) tables, size x size RGBA texels
+	struct Tables
+	{
+		const float* ltc1;
+		const float* ltc2;
+		int size;
+	};
+
+	// shading points in SoA layout, every array holds count values
+	struct ShadingPoints
+	{
+		size_t count;
+		const float* position[3];
+		const float* normal[3]; // normalized
+		const float* view[3]; // normalized, pointing towards the camera
+		const float* roughness;
+	};
+
+	// per point outputs, every array holds count values
+	struct ShadingResult
+	{
+		float* diffuse; // integral of the clamped cosine over the light
+		float* specular; // integral of the GGX LTC over the light
+		float* norm; // LTC2.x, GGX norm for the Fresnel term
+		float* fresnel; // LTC2.y
+	};
+
+	// rectangle light, points from RectDiskLight::points
+	struct PolygonLight
+	{
+		glm::vec3 points[4];
+		bool twoSided = true;
+	};
+
+	// cylinder light without end caps, points from CylinderLight::points
+	struct LineLight
+	{
+		glm::vec3 points[2];
+		float radius;
+	};
+
+	// disk and sphere light, points from RectDiskLight::points or SphereLight::points
+	struct DiskLight
+	{
+		glm::vec3 points[4];
+		bool twoSided = true;
+	};
+
+	// ellipsoids in SoA layout, every array holds count values
+	struct Ellipsoids
+	{
+		size_t count;
+		const float* center[3];
+		const float* origin[3]; // point the ellipsoid is seen from
+		const float* axis[3][3]; // axis[k][c]: component c of the direction of semi-axis k, orthogonal, normalized here
+		const float* length[3]; // semi-axis lengths
+	};
+
+	// half axes of the ellipse each ellipsoid projects to,
+	// the LTC points are center - ex - ey, center + ex - ey, center + ex + ey, center - ex + ey
+	struct Ellipses
+	{
+		float* ex[3]; // minor half axis
+		float* ey[3]; // major half axis
+	};
+
+	enum class Backend
+	{
+		Scalar,
+		SSE4,
+		AVX2,
+		NEON
+	};
+
+	inline const char* backendName(Backend backend)
+	{
+		switch (backend)
+		{
+		case Backend::SSE4: return "sse4";
+		case Backend::AVX2: return "avx2";
+		case Backend::NEON: return "neon";
+		default: return "scalar";
+		}
+	}
+
+	// whether the backend was compiled in, see simd.h
+	inline bool isAvailable(Backend backend)
+	{
+		switch (backend)
+		{
+#ifdef SIMD_HAS_SSE4
+		case Backend::SSE4: return true;
+#endif
+#ifdef SIMD_HAS_AVX2
+		case Backend::AVX2: return true;
+#endif
+#ifdef SIMD_HAS_NEON
+		case Backend::NEON: return true;
+#endif
+		case Backend::Scalar: return true;
+		default: return false;
+		}
+	}
+
+	inline Backend bestBackend()
+	{
+		if (isAvailable(Backend::AVX2))
+			return Backend::AVX2;
+		if (isAvailable(Backend::NEON))
+			return Backend::NEON;
+		if (isAvailable(Backend::SSE4))
+			return Backend::SSE4;
+		return Backend::Scalar;
+	}
+
+	namespace detail
+	{
+		const float PI = 3.14159265f;
+
+		template <class F>
+		struct Vec3
+		{
+			F x, y, z;
+			Vec3() = default;
+			Vec3(F x, F y, F z) : x(x), y(y), z(z) { }
+			explicit Vec3(const glm::vec3& v) : x(v.x), y(v.y), z(v.z) { }
+		};
+
+		template <class F> inline Vec3<F> operator+(const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(a.x + b.x, a.y + b.y, a.z + b.z); }
+		template <class F> inline Vec3<F> operator-(const Vec3<F>& a, const Vec3<F>& b) { return Vec3<F>(a.x - b.x, a.y - b.y, a.z - b.z); }
+		template <class F> inline Vec3<F> operator*(const Vec3<F>& a, F s) { return Vec3<F>(a.x * s, a.y * s, a.z * s); }
+		template <class F> inline Vec3<F> operator*(F s, const Vec3<F>& a) { return Vec3<F>(a.x * s, a.y * s, a.z * s); }
+		template <class F> inline Vec3<F> operator/(const Vec3<F>& a, F s) { return Vec3<F>(a.x / s, a.y / s, a.z / s); }
+		template <class F> inline F dot(const Vec3<F>& a, const Vec3<F>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		template <class F> inline Vec3<F> cross(const Vec3<F>& a, const Vec3<F>& b)
+		{
+			return Vec3<F>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		}
+		template <class F> inline F length(const Vec3<F>& a) { return sqrt(dot(a, a)); }
+		template <class F> inline Vec3<F> normalize(const Vec3<F>& a) { return a * (F(1.0f) / length(a)); }
+		template <class M, class F> inline Vec3<F> select(M m, const Vec3<F>& a, const Vec3<F>& b)
+		{
+			return Vec3<F>(select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z));
+		}
+
+		// inverse M from LTC1, same layout as the mat3 built in ltcAll.frag:
+		// | m00 0 m02 |
+		// |  0  1  0  |
+		// | m20 0 m22 |
+		template <class F>
+		struct Mat
+		{
+			F m00, m02, m20, m22;
+
+			static Mat identity() { return { F(1.0f), F(0.0f), F(0.0f), F(1.0f) }; }
+
+			Vec3<F> operator*(const Vec3<F>& v) const
+			{
+				return Vec3<F>(m00 * v.x + m02 * v.z, v.y, m20 * v.x + m22 * v.z);
+			}
+
+			// inverse(transpose(M)) * v
+			Vec3<F> inverseTranspose(const Vec3<F>& v) const
+			{
+				F invDet = F(1.0f) / (m00 * m22 - m02 * m20);
+				return Vec3<F>((m22 * v.x - m20 * v.z) * invDet, v.y, (m00 * v.z - m02 * v.x) * invDet);
+			}
+		};
+
+		template <class ISA>
+		struct Kernels
+		{
+			typedef typename ISA::Float Float;
+			typedef typename ISA::Int Int;
+			typedef Vec3<Float> Vec;
+			static const int width = ISA::width;
+
+			// bilinear sample of a table, matching the clamp-to-edge LINEAR texture lookup with LUT_SCALE / LUT_BIAS
+			struct Sample
+			{
+				Int index[4];
+				Float weight[4];
+			};
+
+			static Sample lookup(const Tables& tables, Float u, Float v)
+			{
+				Float last = Float((float)(tables.size - 1));
+				// min / max return the second operand for NaN, so degenerate inputs still stay inside the table
+				Float x = min(max(u * last, Float(0.0f)), last);
+				Float y = min(max(v * last, Float(0.0f)), last);
+				Float x0 = floor(x);
+				Float y0 = floor(y);
+				Float fx = x - x0;
+				Float fy = y - y0;
+
+				Int ix0 = toInt(x0);
+				Int iy0 = toInt(y0);
+				Int ix1 = min(ix0 + Int(1), Int(tables.size - 1));
+				Int iy1 = min(iy0 + Int(1), Int(tables.size - 1));
+				Int row0 = iy0 * Int(tables.size);
+				Int row1 = iy1 * Int(tables.size);
+
+				Sample s;
+				s.index[0] = (row0 + ix0) * Int(4);
+				s.index[1] = (row0 + ix1) * Int(4);
+				s.index[2] = (row1 + ix0) * Int(4);
+				s.index[3] = (row1 + ix1) * Int(4);
+				s.weight[0] = (Float(1.0f) - fx) * (Float(1.0f) - fy);
+				s.weight[1] = fx * (Float(1.0f) - fy);
+				s.weight[2] = (Float(1.0f) - fx) * fy;
+				s.weight[3] = fx * fy;
+				return s;
+			}
+
+			static Float fetch(const float* table, const Sample& s, int channel)
+			{
+				Float result = s.weight[0] * gather(table + channel, s.index[0]);
+				for (int i = 1; i < 4; i++)
+					result = result + s.weight[i] * gather(table + channel, s.index[i]);
+				return result;
+			}
+
+			// per point state shared by the diffuse and specular evaluation
+			struct Shading
+			{
+				Vec P, N, T1, T2;
+				Mat<Float> Minv;
+				Float norm, fresnel;
+
+				// rotate into the (T1, T2, N) basis around P
+				Vec toLocal(const glm::vec3& p) const
+				{
+					Vec d = Vec(p) - P;
+					return Vec(dot(T1, d), dot(T2, d), dot(N, d));
+				}
+			};
+
+			static Shading setup(const Tables& tables, const Vec& P, const Vec& N, const Vec& V, Float roughness)
+			{
+				Shading s;
+				s.P = P;
+				s.N = N;
+				// construct orthonormal basis around N
+				s.T1 = normalize(V - N * dot(V, N));
+				s.T2 = cross(N, s.T1);
+
+				// use roughness and sqrt(1-cos_theta) to sample the tables
+				Float NdotV = min(max(dot(N, V), Float(0.0f)), Float(1.0f));
+				Sample uv = lookup(tables, max(roughness, Float(0.1f)), sqrt(Float(1.0f) - NdotV));
+				s.Minv = { fetch(tables.ltc1, uv, 0), fetch(tables.ltc1, uv, 2), fetch(tables.ltc1, uv, 1), fetch(tables.ltc1, uv, 3) };
+				s.norm = fetch(tables.ltc2, uv, 0);
+				s.fresnel = fetch(tables.ltc2, uv, 1);
+				return s;
+			}
+
+			// --------------------------------------------------------------------------------
+			// polygon
+			// --------------------------------------------------------------------------------
+			static Vec integrateEdgeVec(const Vec& v1, const Vec& v2)
+			{
+				Float x = dot(v1, v2);
+				Float y = abs(x);
+
+				Float a = Float(0.8543985f) + (Float(0.4965155f) + Float(0.0145206f) * y) * y;
+				Float b = Float(3.4175940f) + (Float(4.1616724f) + y) * y;
+				Float v = a / b;
+
+				Float theta_sintheta = select(x > Float(0.0f), v, Float(0.5f) / sqrt(max(Float(1.0f) - x * x, Float(1e-7f))) - v);
+				return cross(v1, v2) * theta_sintheta;
+			}
+
+			template <class Mask>
+			static Float polygon(const Tables& tables, const Mat<Float>& Minv, const Vec local[4], Mask behind, bool twoSided)
+			{
+				Vec L[4];
+				for (int i = 0; i < 4; i++)
+					L[i] = normalize(Minv * local[i]);
+
+				Vec vsum = integrateEdgeVec(L[0], L[1]);
+				vsum = vsum + integrateEdgeVec(L[1], L[2]);
+				vsum = vsum + integrateEdgeVec(L[2], L[3]);
+				vsum = vsum + integrateEdgeVec(L[3], L[0]);
+
+				// form factor of the polygon in direction vsum
+				Float len = length(vsum);
+				Float z = vsum.z / len;
+				z = select(behind, -z, z);
+
+				Float sum = len * fetch(tables.ltc2, lookup(tables, z * Float(0.5f) + Float(0.5f), len), 3);
+				return twoSided ? sum : select(behind, sum, Float(0.0f));
+			}
+
+			static void shade(const Tables& tables, const Shading& s, const PolygonLight& light, Float& diffuse, Float& specular)
+			{
+				Vec local[4];
+				for (int i = 0; i < 4; i++)
+					local[i] = s.toLocal(light.points[i]);
+
+				Vec lightNormal = Vec(glm::cross(light.points[1] - light.points[0], light.points[3] - light.points[0]));
+				auto behind = dot(Vec(light.points[0]) - s.P, lightNormal) < Float(0.0f);
+
+				diffuse = polygon(tables, Mat<Float>::identity(), local, behind, light.twoSided);
+				specular = polygon(tables, s.Minv, local, behind, light.twoSided);
+			}
+
+			// --------------------------------------------------------------------------------
+			// line
+			// --------------------------------------------------------------------------------
+			static Float Fpo(Float d, Float l) { return l / (d * (d * d + l * l)) + simd::atan(l / d) / (d * d); }
+			static Float Fwt(Float d, Float l) { return l * l / (d * (d * d + l * l)); }
+
+			static Float diffuseLine(Vec p1, Vec p2)
+			{
+				Vec wt = normalize(p2 - p1);
+
+				// clip to the upper hemisphere
+				auto hidden = (p1.z <= Float(0.0f)) & (p2.z <= Float(0.0f));
+				p1 = select(p1.z < Float(0.0f), (p1 * p2.z - p2 * p1.z) / (p2.z - p1.z), p1);
+				p2 = select(p2.z < Float(0.0f), (p2 * p1.z - p1 * p2.z) / (p1.z - p2.z), p2);
+
+				Float l1 = dot(p1, wt);
+				Float l2 = dot(p2, wt);
+				Vec po = p1 - wt * l1;
+				Float d = length(po);
+
+				Float I = (Fpo(d, l2) - Fpo(d, l1)) * po.z + (Fwt(d, l2) - Fwt(d, l1)) * wt.z;
+				return select(hidden, Float(0.0f), I / Float(PI));
+			}
+
+			static Float line(const Mat<Float>& Minv, const Vec& p1, const Vec& p2, Float radius)
+			{
+				// transform to diffuse configuration
+				Float I = diffuseLine(Minv * p1, Minv * p2);
+
+				// width factor
+				Vec ortho = normalize(cross(p1, p2));
+				Float w = Float(1.0f) / length(Minv.inverseTranspose(ortho));
+				return min(radius * w * I, Float(1.0f));
+			}
+
+			static void shade(const Tables&, const Shading& s, const LineLight& light, Float& diffuse, Float& specular)
+			{
+				Vec p1 = s.toLocal(light.points[0]);
+				Vec p2 = s.toLocal(light.points[1]);
+
+				// ltcAll.frag scales cylinder lights by 1 / (2 pi), keep the outputs interchangeable
+				Float scale = Float(0.5f / PI);
+				diffuse = scale * line(Mat<Float>::identity(), p1, p2, Float(light.radius));
+				specular = scale * line(s.Minv, p1, p2, Float(light.radius));
+			}
+
+			// --------------------------------------------------------------------------------
+			// disk
+			// --------------------------------------------------------------------------------
+			static Vec solveCubic(Float c0, Float c1, Float c2, Float c3)
+			{
+				// normalize the polynomial and divide middle coefficients by three
+				Float A = c3;
+				Float B = c2 / c3 / Float(3.0f);
+				Float C = c1 / c3 / Float(3.0f);
+				Float D = c0 / c3;
+
+				// compute the Hessian and the discriminant
+				Vec Delta(-B * B + C, -C * B + D, B * D - C * C);
+				Float Discriminant = Float(4.0f) * Delta.x * Delta.z - Delta.y * Delta.y;
+				Float sqrtDiscriminant = sqrt(Discriminant);
+				const float third = 2.0f / 3.0f * PI;
+
+				// algorithm A
+				Float D_a = Float(-2.0f) * B * Delta.x + Delta.y;
+				Float theta_a = simd::atan2(sqrtDiscriminant, -D_a) / Float(3.0f);
+				Float r_a = Float(2.0f) * sqrt(-Delta.x);
+				Float x_1a = r_a * simd::cos(theta_a);
+				Float x_3a = r_a * simd::cos(theta_a + Float(third));
+				Float xl = select(x_1a + x_3a > Float(2.0f) * B, x_1a, x_3a);
+				Float xlc_x = xl - B, xlc_y = A;
+
+				// algorithm D
+				Float D_d = -D * Delta.y + Float(2.0f) * C * Delta.z;
+				Float theta_d = simd::atan2(D * sqrtDiscriminant, -D_d) / Float(3.0f);
+				Float r_d = Float(2.0f) * sqrt(-Delta.z);
+				Float x_1d = r_d * simd::cos(theta_d);
+				Float x_3d = r_d * simd::cos(theta_d + Float(third));
+				Float xs = select(x_1d + x_3d < Float(2.0f) * C, x_1d, x_3d);
+				Float xsc_x = -D, xsc_y = xs + C;
+
+				Float E = xlc_y * xsc_y;
+				Float F = -xlc_x * xsc_y - xlc_y * xsc_x;
+				Float G = xlc_x * xsc_x;
+				Float xmc_x = C * F - B * G, xmc_y = -B * F + C * E;
+
+				Vec root(xsc_x / xsc_y, xmc_x / xmc_y, xlc_x / xlc_y);
+				auto yxz = (root.x < root.y) & (root.x < root.z);
+				auto xzy = (!yxz) & (root.z < root.x) & (root.z < root.y);
+				return Vec(select(yxz, root.y, root.x), select(yxz, root.x, select(xzy, root.z, root.y)), select(xzy, root.y, root.z));
+			}
+
+			static Float disk(const Tables& tables, const Mat<Float>& Minv, const Vec local[3], bool twoSided)
+			{
+				// init ellipse, back to cosine distribution but V1 and V2 no longer ortho
+				Vec C = Minv * ((local[0] + local[2]) * Float(0.5f));
+				Vec V1 = Minv * ((local[1] - local[2]) * Float(0.5f));
+				Vec V2 = Minv * ((local[1] - local[0]) * Float(0.5f));
+				auto behind = dot(cross(V1, V2), C) >= Float(0.0f);
+
+				// compute eigenvectors of ellipse
+				Float d11 = dot(V1, V1);
+				Float d22 = dot(V2, V2);
+				Float d12 = dot(V1, V2);
+				auto skewed = abs(d12) / sqrt(d11 * d22) > Float(0.0001f);
+
+				// use sqrt matrix to solve for eigenvalues
+				Float tr = d11 + d22;
+				Float det = sqrt(d11 * d22 - d12 * d12);
+				Float u = Float(0.5f) * sqrt(tr - Float(2.0f) * det);
+				Float v = Float(0.5f) * sqrt(tr + Float(2.0f) * det);
+				Float e_max = (u + v) * (u + v);
+				Float e_min = (u - v) * (u - v);
+
+				auto q11 = d11 > d22;
+				Vec major = select(q11, V1, V2);
+				Vec minor = select(q11, V2, V1);
+				Float dMajor = select(q11, d11, d22);
+				Vec E2 = normalize(major * d12 + minor * (e_max - dMajor));
+				Vec E1 = normalize(major * d12 + minor * (e_min - dMajor));
+
+				// eigenvalues are the diagonals when the axes are already orthogonal
+				Float a = select(skewed, Float(1.0f) / e_max, Float(1.0f) / d11);
+				Float b = select(skewed, Float(1.0f) / e_min, Float(1.0f) / d22);
+				V1 = select(skewed, E2, V1 * sqrt(a));
+				V2 = select(skewed, E1, V2 * sqrt(b));
+
+				Vec V3 = cross(V1, V2);
+				V3 = select(dot(C, V3) < Float(0.0f), V3 * Float(-1.0f), V3);
+
+				Float L = dot(V3, C);
+				Float x0 = dot(V1, C) / L;
+				Float y0 = dot(V2, C) / L;
+				a = a * L * L;
+				b = b * L * L;
+
+				// 3D eigen-decomposition: need to solve a cubic function
+				Float c0 = a * b;
+				Float c1 = a * b * (Float(1.0f) + x0 * x0 + y0 * y0) - a - b;
+				Float c2 = Float(1.0f) - a * (Float(1.0f) + x0 * x0) - b * (Float(1.0f) + y0 * y0);
+				Vec roots = solveCubic(c0, c1, c2, Float(1.0f));
+				Float e1 = roots.x, e2 = roots.y, e3 = roots.z;
+
+				// direction to front-facing ellipse center
+				Vec avgDir = normalize(V1 * (a * x0 / (a - e2)) + V2 * (b * y0 / (b - e2)) + V3);
+
+				// extends of front-facing ellipse
+				Float L1 = sqrt(-e2 / e3);
+				Float L2 = sqrt(-e2 / e1);
+				Float formFactor = L1 * L2 / sqrt((Float(1.0f) + L1 * L1) * (Float(1.0f) + L2 * L2));
+
+				// use tabulated horizon-clipped sphere
+				Float spec = formFactor * fetch(tables.ltc2, lookup(tables, avgDir.z * Float(0.5f) + Float(0.5f), formFactor), 3);
+				return twoSided ? spec : select(behind, Float(0.0f), spec);
+			}
+
+			static void shade(const Tables& tables, const Shading& s, const DiskLight& light, Float& diffuse, Float& specular)
+			{
+				// 3 of the 4 vertices around the disk
+				Vec local[3];
+				for (int i = 0; i < 3; i++)
+					local[i] = s.toLocal(light.points[i]);
+
+				diffuse = disk(tables, Mat<Float>::identity(), local, light.twoSided);
+				specular = disk(tables, s.Minv, local, light.twoSided);
+			}
+
+			// --------------------------------------------------------------------------------
+			// batch driver
+			// --------------------------------------------------------------------------------
+			template <class Light>
+			static void run(const Tables& tables, const ShadingPoints& points, const Light& light, const ShadingResult& result)
+			{
+				const int numInputs = 10;
+				const float* inputs[numInputs] = {
+					points.position[0], points.position[1], points.position[2],
+					points.normal[0], points.normal[1], points.normal[2],
+					points.view[0], points.view[1], points.view[2],
+					points.roughness
+				};
+				float* outputs[4] = { result.diffuse, result.specular, result.norm, result.fresnel };
+				float tail[numInputs][width];
+
+				for (size_t begin = 0; begin < points.count; begin += width)
+				{
+					size_t n = std::min<size_t>(width, points.count - begin);
+
+					// the last partial block repeats its last point instead of reading past the arrays
+					Float in[numInputs];
+					for (int k = 0; k < numInputs; k++)
+					{
+						if (n == width)
+							in[k] = ISA::load(inputs[k] + begin);
+						else
+						{
+							for (int j = 0; j < width; j++)
+								tail[k][j] = inputs[k][begin + std::min<size_t>(j, n - 1)];
+							in[k] = ISA::load(tail[k]);
+						}
+					}
+
+					Shading s = setup(tables, Vec(in[0], in[1], in[2]), Vec(in[3], in[4], in[5]), Vec(in[6], in[7], in[8]), in[9]);
+					Float out[4];
+					shade(tables, s, light, out[0], out[1]);
+					out[2] = s.norm;
+					out[3] = s.fresnel;
+
+					for (int k = 0; k < 4; k++)
+					{
+						if (n == width)
+							store(outputs[k] + begin, out[k]);
+						else
+						{
+							store(tail[k], out[k]);
+							memcpy(outputs[k] + begin, tail[k], n * sizeof(float));
+						}
+					}
+				}
+			}
+		};
+
+		// Reference: Analytical calculation of the solid angle subtended by an arbitrarily positioned ellipsoid.
+		// Works in the frame of the ellipsoid axes, where M = diag(length): the ellipsoid maps to the unit sphere,
+		// the sphere to the disk it is seen as, and the disk back to an ellipse whose axes are the eigenvectors
+		// of the 2x2 Gram matrix of two orthogonal disk radii.
+		template <class ISA>
+		struct EllipsoidKernel
+		{
+			typedef typename ISA::Float Float;
+			typedef Vec3<Float> Vec;
+			static const int width = ISA::width;
+
+			static void project(const Vec& center, const Vec& origin, const Vec axis[3], const Float lengths[3], Vec& ex, Vec& ey)
+			{
+				Float zero(0.0f), one(1.0f);
+				Vec a[3] = { normalize(axis[0]), normalize(axis[1]), normalize(axis[2]) };
+
+				// center in sphere space, M^-1 (center - origin)
+				Vec local = center - origin;
+				Vec p(dot(a[0], local) / lengths[0], dot(a[1], local) / lengths[1], dot(a[2], local) / lengths[2]);
+				Float distance = length(p);
+
+				// radius of the disk the unit sphere is seen as, in sphere space: sqrt(1 - 1 / distance^2).
+				// From inside it would be empty, the whole cross section is used instead; its normal is up
+				// when the origin is at the center.
+				auto outside = distance > one;
+				Float radius = select(outside, sqrt(max(one - one / (distance * distance), zero)), one);
+				Vec n = select(distance > Float(1e-12f), p / max(distance, Float(1e-12f)), Vec(zero, zero, one));
+
+				// orthonormal basis around n, stable for every direction [Duff et al. 2017]
+				Float sign = select(n.z < zero, -one, one);
+				Float k = -one / (sign + n.z);
+				Float b = n.x * n.y * k;
+				Vec c1(one + sign * n.x * n.x * k, sign * b, -sign * n.x);
+				Vec c2(b, sign + n.y * n.y * k, -n.y);
+
+				// two orthogonal disk radii back in ellipsoid space, M * radius * c
+				Vec d1(lengths[0] * c1.x * radius, lengths[1] * c1.y * radius, lengths[2] * c1.z * radius);
+				Vec d2(lengths[0] * c2.x * radius, lengths[1] * c2.y * radius, lengths[2] * c2.z * radius);
+
+				// eigenvectors of the Gram matrix | q11 q12; q12 q22 | through the half angle of
+				// (cos 2phi, sin 2phi) = (q11 - q22, 2 q12) / h, a circle (h = 0) keeps d1 and d2
+				Float q11 = dot(d1, d1), q12 = dot(d1, d2), q22 = dot(d2, d2);
+				Float h = sqrt((q11 - q22) * (q11 - q22) + Float(4.0f) * q12 * q12);
+				auto circle = h <= Float(1e-6f) * (q11 + q22);
+				Float cos2phi = select(circle, one, (q11 - q22) / h);
+				Float cosphi = sqrt(max((one + cos2phi) * Float(0.5f), zero));
+				Float sinphi = sqrt(max((one - cos2phi) * Float(0.5f), zero));
+				sinphi = select(q12 < zero, -sinphi, sinphi);
+
+				// the combinations have length sqrt(eigenvalue), the half axes of the ellipse
+				Vec minor = d2 * cosphi - d1 * sinphi;
+				Vec major = d1 * cosphi + d2 * sinphi;
+				ex = a[0] * minor.x + a[1] * minor.y + a[2] * minor.z;
+				ey = a[0] * major.x + a[1] * major.y + a[2] * major.z;
+			}
+
+			static void run(const Ellipsoids& ellipsoids, const Ellipses& ellipses)
+			{
+				const int numInputs = 18;
+				const float* inputs[numInputs];
+				for (int c = 0; c < 3; c++)
+				{
+					inputs[c] = ellipsoids.center[c];
+					inputs[3 + c] = ellipsoids.origin[c];
+					for (int k = 0; k < 3; k++)
+						inputs[6 + 3 * k + c] = ellipsoids.axis[k][c];
+					inputs[15 + c] = ellipsoids.length[c];
+				}
+				float* outputs[6] = { ellipses.ex[0], ellipses.ex[1], ellipses.ex[2], ellipses.ey[0], ellipses.ey[1], ellipses.ey[2] };
+				float tail[numInputs][width];
+
+				for (size_t begin = 0; begin < ellipsoids.count; begin += width)
+				{
+					size_t n = std::min<size_t>(width, ellipsoids.count - begin);
+
+					// the last partial block repeats its last ellipsoid instead of reading past the arrays
+					Float in[numInputs];
+					for (int k = 0; k < numInputs; k++)
+					{
+						if (n == width)
+							in[k] = ISA::load(inputs[k] + begin);
+						else
+						{
+							for (int j = 0; j < width; j++)
+								tail[k][j] = inputs[k][begin + std::min<size_t>(j, n - 1)];
+							in[k] = ISA::load(tail[k]);
+						}
+					}
+
+					Vec axis[3] = { Vec(in[6], in[7], in[8]), Vec(in[9], in[10], in[11]), Vec(in[12], in[13], in[14]) };
+					Float lengths[3] = { in[15], in[16], in[17] };
+					Vec ex, ey;
+					project(Vec(in[0], in[1], in[2]), Vec(in[3], in[4], in[5]), axis, lengths, ex, ey);
+					Float out[6] = { ex.x, ex.y, ex.z, ey.x, ey.y, ey.z };
+
+					for (int k = 0; k < 6; k++)
+					{
+						if (n == width)
+							store(outputs[k] + begin, out[k]);
+						else
+						{
+							store(tail[k], out[k]);
+							memcpy(outputs[k] + begin, tail[k], n * sizeof(float));
+						}
+					}
+				}
+			}
+		};
+
+		// unavailable backends fall back to scalar
+		template <class Light>
+		inline void dispatch(const Tables& tables, const ShadingPoints& points, const Light& light, const ShadingResult& result, Backend backend)
+		{
+			switch (backend)
+			{
+#ifdef SIMD_HAS_AVX2
+			case Backend::AVX2:
+				Kernels<simd::avx2::ISA>::run(tables, points, light, result);
+				return;
+#endif
+#ifdef SIMD_HAS_SSE4
+			case Backend::SSE4:
+				Kernels<simd::sse4::ISA>::run(tables, points, light, result);
+				return;
+#endif
+#ifdef SIMD_HAS_NEON
+			case Backend::NEON:
+				Kernels<simd::neon::ISA>::run(tables, points, light, result);
+				return;
+#endif
+			default:
+				Kernels<simd::scalar::ISA>::run(tables, points, light, result);
+				return;
+			}
+		}
+	}
+
+	// ellipse axes of all ellipsoids, see EllipsoidKernel
+	inline void projectEllipsoids(const Ellipsoids& ellipsoids, const Ellipses& ellipses, Backend backend = bestBackend())
+	{
+		switch (backend)
+		{
+#ifdef SIMD_HAS_AVX2
+		case Backend::AVX2:
+			detail::EllipsoidKernel<simd::avx2::ISA>::run(ellipsoids, ellipses);
+			return;
+#endif
+#ifdef SIMD_HAS_SSE4
+		case Backend::SSE4:
+			detail::EllipsoidKernel<simd::sse4::ISA>::run(ellipsoids, ellipses);
+			return;
+#endif
+#ifdef SIMD_HAS_NEON
+		case Backend::NEON:
+			detail::EllipsoidKernel<simd::neon::ISA>::run(ellipsoids, ellipses);
+			return;
+#endif
+		default:
+			detail::EllipsoidKernel<simd::scalar::ISA>::run(ellipsoids, ellipses);
+			return;
+		}
+	}
+
+	// evaluate one light for all shading points
+	inline void evaluate(const Tables& tables, const ShadingPoints& points, const PolygonLight& light, const ShadingResult& result, Backend backend = bestBackend())
+	{
+		detail::dispatch(tables, points, light, result, backend);
+	}
+
+	inline void evaluate(const Tables& tables, const ShadingPoints& points, const LineLight& light, const ShadingResult& result, Backend backend = bestBackend())
+	{
+		detail::dispatch(tables, points, light, result, backend);
+	}
+
+	inline void evaluate(const Tables& tables, const ShadingPoints& points, const DiskLight& light, const ShadingResult& result, Backend backend = bestBackend())
+	{
+		detail::dispatch(tables, points, light, result, backend);
+	}
+}
@@ -32,7 +32,10 @@ uniform bool endCaps; // use endCaps?
 uniform sampler2D LTC1; // for inverse M
 uniform sampler2D LTC2; // GGX norm, fresnel, 0(unused), sphere
 
-const float LUT_SIZE  = 64.0; // ltc_texture size 
+#ifndef LTC_LUT_SIZE
+#define LTC_LUT_SIZE 64 // texels per side of the LTC tables, injected by the application
+#endif
+const float LUT_SIZE  = float(LTC_LUT_SIZE); // ltc_texture size
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
 const float LUT_BIAS  = 0.5/LUT_SIZE;
 const float PI = 3.14159265;
@@ -54,7 +57,7 @@ void buildOrthonormalBasis(in vec3 n, out vec3 b1, out vec3 b2)
     b2 = vec3(b, 1.0 - n.y*n.y*a, -n.y);
 }
 
-mat3 Minv;
+mat3 Minv = mat3(1.0); // distribution D() integrates, set in main()
 // TODO: ???
 float D(vec3 w)
 {
@@ -144,9 +147,11 @@ float I_ltc_line(vec3 p1, vec3 p2)
     vec3 p2o = Minv * p2;
     float I_diffuse = I_diffuse_line(p1o, p2o);
 
-    // width factor
+    // width factor 1/|inverse(transpose(Minv)) * ortho|, where
+    // inverse(transpose(Minv)) = cofactor / det, without inverting the matrix
+    mat3 cofactor = mat3(cross(Minv[1], Minv[2]), cross(Minv[2], Minv[0]), cross(Minv[0], Minv[1]));
     vec3 ortho = normalize(cross(p1, p2));
-    float w =  1.0 / length(inverse(transpose(Minv)) * ortho);
+    float w = abs(dot(Minv[0], cofactor[0])) / length(cofactor * ortho);
 
     return w * I_diffuse;
 }
@@ -223,6 +228,41 @@ vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P)
     }
 }
 
+// Diffuse (x) and specular (y) of LTC_Evaluate with mat3(1) and with the current Minv, sharing
+// the basis and the line end points. Leaves Minv at mat3(1).
+vec2 LTC_Evaluate_Fused(vec3 N, vec3 V, vec3 P)
+{
+    // construct orthonormal basis around N
+    vec3 T1, T2;
+    T1 = normalize(V - N*dot(V, N));
+    T2 = cross(N, T1);
+
+    mat3 B = transpose(mat3(T1, T2, N));
+
+    vec3 p1 = B * (light.points[0] - P);
+    vec3 p2 = B * (light.points[1] - P);
+
+    if (analytic) // analytic integration
+    {
+        // the width factor of the cosine distribution is 1
+        vec2 Iline = light.radius * vec2(I_diffuse_line(p1, p2), I_ltc_line(p1, p2));
+        vec2 Idisks = vec2(0.0);
+        if (endCaps)
+            Idisks.y = I_ltc_disks(p1, p2, light.radius);
+        Minv = mat3(1.0);
+        if (endCaps)
+            Idisks.x = I_ltc_disks(p1, p2, light.radius);
+        return min(vec2(1.0), Iline + Idisks);
+    }
+    else // numerical integration, D() needs each distribution in turn
+    {
+        float specular = I_cylinder_numerical(p1, p2, light.radius) + (endCaps ? I_disks_numerical(p1, p2, light.radius) : 0.0);
+        Minv = mat3(1.0);
+        float diffuse = I_cylinder_numerical(p1, p2, light.radius) + (endCaps ? I_disks_numerical(p1, p2, light.radius) : 0.0);
+        return vec2(diffuse, specular);
+    }
+}
+
 vec3 PowVec3(vec3 v, float p)
 {
     return vec3(pow(v.x, p), pow(v.y, p), pow(v.z, p));
@@ -259,6 +299,7 @@ void main()
         vec3(  0,  1,    0),
         vec3(t1.z, 0, t1.w)
     );
+#ifdef SEPARATE_LTC
     vec3 specular = LTC_Evaluate(N, V, fs_in.fragPos);
     // GGX BRDF shadowing and Fresnel
     specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
@@ -266,6 +307,14 @@ void main()
     // Evaluate LTC diffuse shading
     Minv = mat3(1.0);
     vec3 diffuse = LTC_Evaluate(N, V, fs_in.fragPos);
+#else
+    // and the diffuse shading with it
+    vec2 Lo_i = LTC_Evaluate_Fused(N, V, fs_in.fragPos);
+    vec3 specular = vec3(Lo_i.y);
+    // GGX BRDF shadowing and Fresnel
+    specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
+    vec3 diffuse = vec3(Lo_i.x);
+#endif
 
     result = light.intensity * light.lightColor * (specular + mDiffuse * diffuse);
     result /= 2.0 * PI;
@@ -30,7 +30,10 @@ uniform bool twoSided; // two Side lighting
 uniform sampler2D LTC1; // for inverse M
 uniform sampler2D LTC2; // GGX norm, fresnel, 0(unused), sphere
 
-const float LUT_SIZE  = 64.0; // ltc_texture size 
+#ifndef LTC_LUT_SIZE
+#define LTC_LUT_SIZE 64 // texels per side of the LTC tables, injected by the application
+#endif
+const float LUT_SIZE  = float(LTC_LUT_SIZE); // ltc_texture size
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
 const float LUT_BIAS  = 0.5/LUT_SIZE;
 const float PI = 3.14159265;
@@ -122,36 +125,12 @@ vec3 SolveCubic(vec4 Coefficient)
     return Root;
 }
 
-// P is fragPos in world space (LTC distribution)
-vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+// form factor of the ellipse with center C and axes V1, V2, given in the cosine distribution's space
+float DiskFormFactor(vec3 C, vec3 V1, vec3 V2, bool twoSided)
 {
-    // construct orthonormal basis around N
-    vec3 T1, T2;
-    T1 = normalize(V - N*dot(V, N));
-    T2 = cross(N, T1);
-
-    // rotate area light in (T1, T2, N) basis
-    mat3 R = transpose(mat3(T1, T2, N));
-
-    // 3 of the 4 vertices around disk
-    vec3 L_[3];
-    L_[0] = R * (points[0] - P);
-    L_[1] = R * (points[1] - P);
-    L_[2] = R * (points[2] - P);
-
-    // init ellipse
-    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
-    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
-    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
-
-    // back to cosine distribution, but V1 and V2 no longer ortho.
-    C  = Minv * C;
-    V1 = Minv * V1;
-    V2 = Minv * V2;
-
     // not two sided lighting AND shading point behind light
     if (!twoSided && dot(cross(V1, V2), C) >= 0.0)
-        return vec3(0.0);
+        return 0.0;
 
     // compute eigenvectors of ellipse
     float a, b;
@@ -165,7 +144,8 @@ vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSid
 
         // use sqrt matrix to solve for eigenvalues
         det = sqrt(det);
-        float u = 0.5*sqrt(tr - 2.0*det);
+        // tr - 2*det without the cancellation that leaves nothing of a near circle
+        float u = 0.5*sqrt(((d11 - d22)*(d11 - d22) + 4.0*d12*d12)/(tr + 2.0*det));
         float v = 0.5*sqrt(tr + 2.0*det);
         float e_max = (u + v) * (u + v); // e2
         float e_min = (u - v) * (u - v); // e1
@@ -244,12 +224,68 @@ vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSid
     uv = uv*LUT_SCALE + LUT_BIAS;
     float scale = texture(LTC2, uv).w;
 
-    float spec = formFactor*scale;
+    return formFactor*scale;
+}
+
+// P is fragPos in world space (LTC distribution)
+vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+{
+    // construct orthonormal basis around N
+    vec3 T1, T2;
+    T1 = normalize(V - N*dot(V, N));
+    T2 = cross(N, T1);
+
+    // rotate area light in (T1, T2, N) basis
+    mat3 R = transpose(mat3(T1, T2, N));
+
+    // 3 of the 4 vertices around disk
+    vec3 L_[3];
+    L_[0] = R * (points[0] - P);
+    L_[1] = R * (points[1] - P);
+    L_[2] = R * (points[2] - P);
+
+    // init ellipse
+    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
+    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
+    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
+
+    // back to cosine distribution, but V1 and V2 no longer ortho.
+    C  = Minv * C;
+    V1 = Minv * V1;
+    V2 = Minv * V2;
+
+    float spec = DiskFormFactor(C, V1, V2, twoSided);
     vec3 Lo_i = vec3(spec, spec, spec);
 
     return Lo_i;
 }
 
+// Diffuse (x) and specular (y) of LTC_Evaluate with mat3(1) and with Minv, sharing the basis
+// and the ellipse
+vec2 LTC_Evaluate_Fused(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+{
+    // construct orthonormal basis around N
+    vec3 T1, T2;
+    T1 = normalize(V - N*dot(V, N));
+    T2 = cross(N, T1);
+
+    // rotate area light in (T1, T2, N) basis, which is already the space of the diffuse distribution
+    mat3 R = transpose(mat3(T1, T2, N));
+
+    // 3 of the 4 vertices around disk
+    vec3 L_[3];
+    L_[0] = R * (points[0] - P);
+    L_[1] = R * (points[1] - P);
+    L_[2] = R * (points[2] - P);
+
+    // init ellipse
+    vec3 C  = 0.5 * (L_[0] + L_[2]); // center
+    vec3 V1 = 0.5 * (L_[1] - L_[2]); // axis 1
+    vec3 V2 = 0.5 * (L_[1] - L_[0]); // axis 2
+
+    return vec2(DiskFormFactor(C, V1, V2, twoSided), DiskFormFactor(Minv * C, Minv * V1, Minv * V2, twoSided));
+}
+
 vec3 PowVec3(vec3 v, float p)
 {
     return vec3(pow(v.x, p), pow(v.y, p), pow(v.z, p));
@@ -287,8 +323,14 @@ void main()
     );
 
     // Evaluate LTC shading
+#ifdef SEPARATE_LTC
     vec3 diffuse = LTC_Evaluate(N, V, fs_in.fragPos, mat3(1), light.points, twoSided);
     vec3 specular = LTC_Evaluate(N, V, fs_in.fragPos, Minv, light.points, twoSided);
+#else
+    vec2 Lo_i = LTC_Evaluate_Fused(N, V, fs_in.fragPos, Minv, light.points, twoSided);
+    vec3 diffuse = vec3(Lo_i.x);
+    vec3 specular = vec3(Lo_i.y);
+#endif
 
     // GGX BRDF shadowing and Fresnel
     specular *= mSpecular * t2.x + (1.0 - mSpecular) * t2.y;
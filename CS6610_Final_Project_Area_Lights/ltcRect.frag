@@ -30,7 +30,10 @@ uniform bool twoSided; // two Side lighting
 uniform sampler2D LTC1; // for inverse M
 uniform sampler2D LTC2; // GGX norm, fresnel, 0(unused), sphere
 
-const float LUT_SIZE  = 64.0; // ltc_texture size 
+#ifndef LTC_LUT_SIZE
+#define LTC_LUT_SIZE 64 // texels per side of the LTC tables, injected by the application
+#endif
+const float LUT_SIZE  = float(LTC_LUT_SIZE); // ltc_texture size
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
 const float LUT_BIAS  = 0.5/LUT_SIZE;
 
@@ -59,35 +62,9 @@ float IntegrateEdge(vec3 v1, vec3 v2)
 }
 
 
-// P is fragPos in world space (LTC distribution)
-vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+// form factor of the polygon L, given in the cosine distribution's space (Do)
+float PolygonFormFactor(vec3 L[4], bool behind)
 {
-    // construct orthonormal basis around N
-    vec3 T1, T2;
-    T1 = normalize(V - N * dot(V, N));
-    T2 = cross(N, T1);
-
-    // rotate area light in (T1, T2, N) basis
-    // TODO: Is this operation helps to set M_inverse into face's normal due to view direction???
-    Minv = Minv * transpose(mat3(T1, T2, N)); 
-
-    // polygon (allocate 5 vertices for clipping)
-    vec3 L[5];
-    // transform polygon from LTC back to origin Do (cosine weighted) 
-    L[0] = Minv * (points[0] - P); 
-    L[1] = Minv * (points[1] - P);
-    L[2] = Minv * (points[2] - P);
-    L[3] = Minv * (points[3] - P);
-
-    // integrate
-    float sum = 0.0;
-
-    // use tabulated horizon-clipped sphere
-    // check if the shading point is behind the light
-    vec3 dir = points[0] - P; // LTC space
-    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
-    bool behind = (dot(dir, lightNormal) < 0.0); 
-
     // cos weighted space
     L[0] = normalize(L[0]);
     L[1] = normalize(L[1]);
@@ -116,7 +93,36 @@ vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSid
     // TODO: ???
     float scale = texture(LTC2, uv).w;
     
-    sum = len*scale;
+    return len*scale;
+}
+
+// P is fragPos in world space (LTC distribution)
+vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+{
+    // construct orthonormal basis around N
+    vec3 T1, T2;
+    T1 = normalize(V - N * dot(V, N));
+    T2 = cross(N, T1);
+
+    // rotate area light in (T1, T2, N) basis
+    // TODO: Is this operation helps to set M_inverse into face's normal due to view direction???
+    Minv = Minv * transpose(mat3(T1, T2, N)); 
+
+    vec3 L[4];
+    // transform polygon from LTC back to origin Do (cosine weighted) 
+    L[0] = Minv * (points[0] - P); 
+    L[1] = Minv * (points[1] - P);
+    L[2] = Minv * (points[2] - P);
+    L[3] = Minv * (points[3] - P);
+
+    // use tabulated horizon-clipped sphere
+    // check if the shading point is behind the light
+    vec3 dir = points[0] - P; // LTC space
+    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
+    bool behind = (dot(dir, lightNormal) < 0.0); 
+
+    // integrate
+    float sum = PolygonFormFactor(L, behind);
     
     if (!behind && !twoSided)
         sum = 0.0;
@@ -127,6 +133,33 @@ vec3 LTC_Evaluate(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSid
     return Lo_i;
 }
 
+// Diffuse (x) and specular (y) of LTC_Evaluate with mat3(1) and with Minv, sharing the basis,
+// the rotated points and the behind test
+vec2 LTC_Evaluate_Fused(vec3 N, vec3 V, vec3 P, mat3 Minv, vec3 points[4], bool twoSided)
+{
+    vec3 dir = points[0] - P;
+    vec3 lightNormal = cross(points[1] - points[0], points[3] - points[0]);
+    bool behind = (dot(dir, lightNormal) < 0.0);
+    if (!behind && !twoSided)
+        return vec2(0.0);
+
+    // construct orthonormal basis around N
+    vec3 T1, T2;
+    T1 = normalize(V - N * dot(V, N));
+    T2 = cross(N, T1);
+
+    // rotate area light in (T1, T2, N) basis, which is already the space of the diffuse Do
+    mat3 R = transpose(mat3(T1, T2, N));
+    vec3 L[4];
+    L[0] = R * (points[0] - P);
+    L[1] = R * (points[1] - P);
+    L[2] = R * (points[2] - P);
+    L[3] = R * (points[3] - P);
+
+    vec3 Ls[4] = vec3[](Minv * L[0], Minv * L[1], Minv * L[2], Minv * L[3]);
+    return vec2(PolygonFormFactor(L, behind), PolygonFormFactor(Ls, behind));
+}
+
 vec3 PowVec3(vec3 v, float p)
 {
     return vec3(pow(v.x, p), pow(v.y, p), pow(v.z, p));
@@ -164,8 +197,14 @@ void main()
     );
 
     // Evaluate LTC shading
+#ifdef SEPARATE_LTC
     vec3 diffuse = LTC_Evaluate(N, V, fs_in.fragPos, mat3(1), light.points, twoSided);
     vec3 specular = LTC_Evaluate(N, V, fs_in.fragPos, Minv, light.points, twoSided);
+#else
+    vec2 Lo_i = LTC_Evaluate_Fused(N, V, fs_in.fragPos, Minv, light.points, twoSided);
+    vec3 diffuse = vec3(Lo_i.x);
+    vec3 specular = vec3(Lo_i.y);
+#endif
 
     // GGX BRDF shadowing and Fresnel
     // t2.x: shadowedF90 ??? (F90 normally it should be 1.0)
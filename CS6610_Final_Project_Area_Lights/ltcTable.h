@@ -0,0 +1,149 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// LTC lookup tables stored out of source, written by LTC_Table_Generator from LTC.h
+// or fitted for a BRDF by LTC_Fitter.
+// A table file is a header followed by the LTC1 and LTC2 texels, size x size RGBA each,
+// as 32 or 16 bit floats. The header names the BRDF the table was fitted for. It is memory mapped and the texels are uploaded as they are;
+// the shaders get the size through the LTC_LUT_SIZE define.
+// --------------------------------------------------------------------------------
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include "mappedFile.h"
+
+class LTCTable
+{
+public:
+	static const uint32_t VERSION = 2;
+
+	enum class Brdf : uint32_t
+	{
+		GGX,
+		Beckmann
+	};
+
+	uint32_t size = 0; // texels per side
+	bool halfFloat = false; // texels are 16 bit floats, otherwise 32 bit
+	Brdf brdf = Brdf::GGX;
+
+	bool load(const std::string& path)
+	{
+		size = 0;
+		if (!file.open(path) || file.size() < sizeof(Header))
+			return false;
+		Header header;
+		memcpy(&header, file.data(), sizeof(header));
+		if (memcmp(header.magic, "LTCT", 4) != 0 || header.version != VERSION || header.size < 2 || header.size > 1024
+			|| header.halfFloat > 1 || header.brdf > static_cast<uint32_t>(Brdf::Beckmann)
+			|| file.size() < fileBytes(header.size, header.halfFloat != 0))
+		{
+			file.close();
+			return false;
+		}
+		size = header.size;
+		halfFloat = header.halfFloat != 0;
+		brdf = static_cast<Brdf>(header.brdf);
+		return true;
+	}
+
+	// texels of LTC1 (index 0: inverse M) or LTC2 (index 1: BRDF norm, fresnel, 0, sphere), valid while loaded
+	const void* texels(GLint index) const
+	{
+		return file.data() + sizeof(Header) + index * tableBytes(size, halfFloat);
+	}
+
+	static const char* brdfName(Brdf brdf)
+	{
+		return brdf == Brdf::GGX ? "ggx" : "beckmann";
+	}
+
+	GLenum internalFormat() const
+	{
+		return halfFloat ? GL_RGBA16F : GL_RGBA32F;
+	}
+
+	GLenum type() const
+	{
+		return halfFloat ? GL_HALF_FLOAT : GL_FLOAT;
+	}
+
+	static size_t tableBytes(uint32_t size, bool halfFloat)
+	{
+		return (size_t)size * size * 4 * (halfFloat ? sizeof(uint16_t) : sizeof(float));
+	}
+
+	static size_t fileBytes(uint32_t size, bool halfFloat)
+	{
+		return sizeof(Header) + 2 * tableBytes(size, halfFloat);
+	}
+
+	// write both tables of size x size RGBA floats, packed to halves when halfFloat is set
+	static bool write(const std::string& path, uint32_t size, bool halfFloat, Brdf brdf, const float* ltc1, const float* ltc2)
+	{
+		std::ofstream out(path, std::ios::binary);
+		if (!out)
+			return false;
+		Header header = { { 'L', 'T', 'C', 'T' }, VERSION, size, halfFloat ? 1u : 0u, static_cast<uint32_t>(brdf) };
+		out.write((const char*)&header, sizeof(header));
+		for (auto table : { ltc1, ltc2 })
+		{
+			if (halfFloat)
+			{
+				std::vector<uint16_t> halves((size_t)size * size * 4);
+				for (size_t i = 0; i < halves.size(); i++)
+					halves[i] = glm::packHalf1x16(table[i]);
+				out.write((const char*)halves.data(), halves.size() * sizeof(uint16_t));
+			}
+			else
+				out.write((const char*)table, tableBytes(size, false));
+		}
+		return (bool)out;
+	}
+
+	// Bilinear resampling of a size x size RGBA table to newSize x newSize. Texel i of a table
+	// holds the fit at i / (size - 1), which is where the shaders' LUT_SCALE and LUT_BIAS sample it.
+	static std::vector<float> resample(const float* table, uint32_t size, uint32_t newSize)
+	{
+		std::vector<float> result((size_t)newSize * newSize * 4);
+		for (uint32_t y = 0; y < newSize; y++)
+		{
+			for (uint32_t x = 0; x < newSize; x++)
+			{
+				auto sx = x * (size - 1) / (float)(newSize - 1), sy = y * (size - 1) / (float)(newSize - 1);
+				auto x0 = std::min((uint32_t)sx, size - 2), y0 = std::min((uint32_t)sy, size - 2);
+				auto fx = sx - x0, fy = sy - y0;
+				for (int c = 0; c < 4; c++)
+				{
+					auto at = [&](uint32_t tx, uint32_t ty) { return table[4 * ((size_t)ty * size + tx) + c]; };
+					auto top = glm::mix(at(x0, y0), at(x0 + 1, y0), fx);
+					auto bottom = glm::mix(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx);
+					result[4 * ((size_t)y * newSize + x) + c] = glm::mix(top, bottom, fy);
+				}
+			}
+		}
+		return result;
+	}
+
+private:
+	struct Header
+	{
+		char magic[4]; // "LTCT"
+		uint32_t version;
+		uint32_t size;
+		uint32_t halfFloat;
+		uint32_t brdf; // Brdf
+	};
+
+	MappedFile file;
+};
@@ -10,15 +10,30 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <chrono>
 
 #include "shader.h"
+#include "shaderCache.h"
 #include "camera.h"
 #include "model.h"
-#include "LTC.h" // LTC1 and LTC2 
+#include "assetLoader.h"
+#include "materialLibrary.h"
+#include "ltcTable.h"
 #include "polyLight.h"
+#include "lightBuffer.h"
+#include "lightProxies.h"
+#include "lightSimulation.h"
+#include "lightAnimation.h"
+#include "clusteredLights.h"
 #include "GUI.h"
+#include "headless.h"
+#include "frameTimer.h"
+#include "benchmark.h"
+#include "imageWriter.h"
 
 const GLuint SCR_WIDTH = 1600;
 const GLuint SCR_HEIGHT = 900;
@@ -26,6 +41,7 @@ const GLuint TEXTURE_WIDTH = 1185;
 const GLuint TEXTURE_HEIGHT = 860;
 const char* GLSL_VERSION = "#version 460";
 const GLfloat PLANE_SCALER = 30.0f;
+const GLint MAX_MOVING_SPHERE_LIGHTS = 100000;
 
 // camera object
 Camera camera;
@@ -55,17 +71,12 @@ shared_ptr<SphereLight> sphereLight = make_shared<SphereLight>(
 vector<shared_ptr<AreaLight>> areaLights1 = { rectLight, cylinderLight, diskLight, sphereLight };
 vector<shared_ptr<AreaLight>> areaLights2 = { sphereLight, rectLight, diskLight, cylinderLight };
 
-// moving sphere light object
-struct MovingSphereLight
+// random parameters of an orbiting light of scene 2
+struct OrbitParameters
 {
-	SphereLight sphereLight;
-	glm::vec3 initCenter;
-	glm::vec3 movingDir;
-	GLfloat movingSpeed;
-	GLfloat bounceHeight;
-	GLint countBounceHit;
-	GLfloat t;
-	GLfloat s;
+	GLfloat orbitSpeed; // scale of the orbit speed
+	GLfloat selfRotSpeed; // scale of the rotation speed around rotAxis
+	glm::vec3 rotAxis;
 };
 
 // material object
@@ -79,11 +90,49 @@ struct Material
 	GLfloat roughness;
 } GGXMaterial{ diffuse, specular, roughness };
 
-// texture object
-struct TextureMap
+// samplers of the plane maps in ltcAll.frag, bound to consecutive texture units after LTC1 and LTC2
+const char* const PLANE_MAP_SAMPLERS[] = { "material.texture_diffuse", "material.texture_normal", "material.texture_roughness", "material.texture_AO", "dispMap" };
+const GLint NUM_PLANE_MAPS = 5;
+const GLint FIRST_PLANE_MAP_UNIT = 2;
+
+// sampler of a plane map named as in MaterialLibrary::add; ltcAll.frag reads the metallic map through texture_AO
+GLint planeMapSampler(const std::string& map)
 {
-	string name;
-	GLuint id;
+	const char* names[] = { "diffuse", "normal", "roughness", "AO", "displacement" };
+	for (GLint i = 0; i < NUM_PLANE_MAPS; i++)
+		if (map == names[i])
+			return i;
+	return map == "metallic" ? 3 : -1;
+}
+
+// uniforms set every frame, looked up once per program
+struct FrameUniforms
+{
+	Uniform model, view, projection, normalMapRot, cameraPos;
+	Uniform lightColor, lightIntensity, lightPoints;
+	Uniform materialDiffuse, materialSpecular, materialRoughness;
+	Uniform numLights, clustered, planeType, time, ripple;
+	Uniform lightTypeRanges;
+	Uniform ltc1, ltc2;
+	Uniform planeMaps[NUM_PLANE_MAPS];
+	ClusterUniforms cluster;
+
+	FrameUniforms() = default;
+	explicit FrameUniforms(const Shader& shader)
+		: model(shader.uniform("model")), view(shader.uniform("view")), projection(shader.uniform("projection")),
+		normalMapRot(shader.uniform("normalMapRot")), cameraPos(shader.uniform("cameraPos")),
+		lightColor(shader.uniform("light.lightColor")), lightIntensity(shader.uniform("light.intensity")),
+		lightPoints(shader.uniform("light.points")),
+		materialDiffuse(shader.uniform("material.diffuse")), materialSpecular(shader.uniform("material.specular")),
+		materialRoughness(shader.uniform("material.roughness")),
+		numLights(shader.uniform("numLights")), clustered(shader.uniform("clustered")),
+		planeType(shader.uniform("planeType")), time(shader.uniform("time")), ripple(shader.uniform("ripple")),
+		lightTypeRanges(shader.uniform("lightTypeRanges")),
+		ltc1(shader.uniform("LTC1")), ltc2(shader.uniform("LTC2")), cluster(shader)
+	{
+		for (GLint i = 0; i < NUM_PLANE_MAPS; i++)
+			planeMaps[i] = shader.uniform(PLANE_MAP_SAMPLERS[i]);
+	}
 };
 
 // scene constrol
@@ -95,17 +144,13 @@ GLfloat rotY = 0.0f, rotZ = 0.0f;
 
 using namespace std;
 
-inline GLfloat random(GLfloat min, GLfloat max)
-{
-	return min + (max - min) * (rand() / (RAND_MAX + 1.0f));
-}
-
-GLuint setLTCTexture(const float* LTC)
+// index 0: LTC1, 1: LTC2
+GLuint setLTCTexture(const LTCTable& table, GLint index)
 {
 	GLuint LTCTexMap;
 	glGenTextures(1, &LTCTexMap);
 	glBindTexture(GL_TEXTURE_2D, LTCTexMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_FLOAT, LTC);
+	glTexImage2D(GL_TEXTURE_2D, 0, table.internalFormat(), table.size, table.size, 0, GL_RGBA, table.type(), table.texels(index));
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -114,44 +159,6 @@ GLuint setLTCTexture(const float* LTC)
 	return LTCTexMap;
 }
 
-TextureMap loadTexture(const char* path, string typeName)
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format{};
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return TextureMap{ typeName, textureID };
-}
-
 void useDefault()
 {
 	// reset lights
@@ -179,14 +186,14 @@ void useDefault()
 	rotZ = 0.0f;
 }
 
-void createFBO(GLuint& framebuffer, GLuint& renderedTex)
+void createFBO(GLuint& framebuffer, GLuint& renderedTex, GLuint width, GLuint height, GLenum internalFormat = GL_RGBA)
 {
 	glGenFramebuffers(1, &framebuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
 	glGenTextures(1, &renderedTex);
 	glBindTexture(GL_TEXTURE_2D, renderedTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_WIDTH, TEXTURE_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderedTex, 0);
@@ -194,7 +201,7 @@ void createFBO(GLuint& framebuffer, GLuint& renderedTex)
 	GLuint renderbuffer;
 	glGenRenderbuffers(1, &renderbuffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, TEXTURE_WIDTH, TEXTURE_HEIGHT);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffer);
 
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
@@ -247,32 +254,65 @@ void cursor_pos_callback(GLFWwindow* window, double xPos, double yPos)
 
 int main(int argc, char* args[])
 {
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
-#endif
+	auto startTime = chrono::high_resolution_clock::now();
+	HeadlessOptions options;
+	if (!parseCommandLine(argc, args, options))
+		return -1;
 
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Area Light Implementation", NULL, NULL);
-	if (window == NULL)
+	// a benchmark scenario sets the scene options and runs headless
+	const BenchmarkScenario* benchmark = nullptr;
+	if (!options.benchmark.empty())
 	{
-		cout << "Fail to create glfw window\n";
-		glfwTerminate();
-		return -1;
+		benchmark = findScenario(options.benchmark);
+		if (!benchmark)
+		{
+			if (options.benchmark != "list")
+				cout << "Unknown benchmark " << options.benchmark << "\n";
+			cout << "Benchmark scenarios:\n";
+			for (auto& scenario : benchmarkScenarios())
+				cout << "  " << scenario.name << "\n";
+			return options.benchmark == "list" ? 0 : -1;
+		}
+		applyScenario(*benchmark, options);
 	}
-	glfwMakeContextCurrent(window);
-	glfwSwapInterval(0); // v-sync off
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, cursor_pos_callback);
+	auto headless = options.headless;
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	if (headless)
 	{
-		cout << "Fail to load GLAD\n";
-		return -1;
+		if (!headlessContext.create())
+			return -1;
+	}
+	else
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+#endif
+
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Area Light Implementation", NULL, NULL);
+		if (window == NULL)
+		{
+			cout << "Fail to create glfw window\n";
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(0); // v-sync off
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetCursorPosCallback(window, cursor_pos_callback);
+
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			cout << "Fail to load GLAD\n";
+			return -1;
+		}
 	}
 
 	// openGL configuration
@@ -285,7 +325,7 @@ int main(int argc, char* args[])
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 	ImGuiIO &io = ImGui::GetIO();
-	io.IniFilename = "editorConfig.ini";
+	io.IniFilename = headless ? NULL : "editorConfig.ini";
 
 	// setup Dear ImGui style
 	ImGui::StyleColorsDark();
@@ -294,7 +334,11 @@ int main(int argc, char* args[])
 	io.Fonts->AddFontFromFileTTF("resources/fonts/trebucbd.ttf", 16.0f);
 
 	// setup Platform/Renderer backends
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	// the GUI still runs headless, without a platform backend, so its widgets keep driving the scene state
+	if (headless)
+		io.DisplaySize = ImVec2(SCR_WIDTH, SCR_HEIGHT);
+	else
+		ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init(GLSL_VERSION);
 
 	// setup window flags
@@ -303,79 +347,157 @@ int main(int argc, char* args[])
 	window_flags |= ImGuiWindowFlags_NoResize;
 
 
+	// start loading assets on worker threads, shaders compile meanwhile
+	// -----------------------------------------------------
+	MeshCache::instance().enabled = options.meshCache;
+	AssetLoader assetLoader;
+	auto quadData = assetLoader.loadModel("resources/models/quad.obj");
+	auto cylinderData = assetLoader.loadModel("resources/models/cylinder.obj");
+	auto diskData = assetLoader.loadModel("resources/models/disk.obj");
+	auto sphereData = assetLoader.loadModel("resources/models/sphere.obj");
+
+	// plane materials, loaded the first time they are selected
+	// TODO: using tessellation to improve mapping quality
+	MaterialLibrary materials(assetLoader, (size_t)options.textureBudget << 20);
+	// the sampler of each map, resolved once so that the frame loop binds the maps by index
+	vector<vector<GLint>> materialSamplers;
+	auto addMaterial = [&](const string& name, const vector<pair<string, string>>& files)
+	{
+		materials.add(name, files);
+		vector<GLint> samplers;
+		for (auto& file : files)
+			samplers.push_back(planeMapSampler(file.second));
+		materialSamplers.push_back(samplers);
+	};
+	addMaterial("Default", { });
+	addMaterial("Stone", {
+		{ "resources/textures/tex1/PavingStones_Color.jpg", "diffuse" },
+		{ "resources/textures/tex1/PavingStones_Normal.jpg", "normal" },
+		{ "resources/textures/tex1/PavingStones_Roughness.jpg", "roughness" },
+		{ "resources/textures/tex1/PavingStones_AmbientOcclusion.jpg", "AO" },
+		{ "resources/textures/tex1/PavingStones_Displacement.jpg", "displacement" }
+	});
+	addMaterial("Marble", {
+		{ "resources/textures/tex2/Marble_Color.jpg", "diffuse" },
+		{ "resources/textures/tex2/Marble_Normal.jpg", "normal" },
+		{ "resources/textures/tex2/Marble_Roughness.jpg", "roughness" },
+		{ "resources/textures/tex2/Marble_Disp.jpg", "displacement" }
+	});
+	addMaterial("Wood", {
+		{ "resources/textures/tex3/WoodFloor_Color.jpg", "diffuse" },
+		{ "resources/textures/tex3/WoodFloor_Normal.jpg", "normal" },
+		{ "resources/textures/tex3/WoodFloor_Roughness.jpg", "roughness" },
+		{ "resources/textures/tex3/WoodFloor_AmbientOcclusion.jpg", "AO" },
+		{ "resources/textures/tex3/WoodFloor_Displacement.jpg", "displacement" }
+	});
+	addMaterial("Diamond Plate", {
+		{ "resources/textures/tex4/DiamondPlate_Color.jpg", "diffuse" },
+		{ "resources/textures/tex4/DiamondPlate_Normal.jpg", "normal" },
+		{ "resources/textures/tex4/DiamondPlate_Roughness.jpg", "roughness" },
+		{ "resources/textures/tex4/DiamondPlate_Metalness.jpg", "metallic" },
+		{ "resources/textures/tex4/DiamondPlate_Displacement.jpg", "displacement" }
+	});
+
 	// load shaders
 	// -----------------------------------------------------
+	auto shaderStart = chrono::high_resolution_clock::now();
+	ProgramBinaryCache::instance().enabled = options.programCache;
+	ShaderCache shaderCache;
 	Shader shader;
-	Shader rectShader("ltc.vert", "ltcRect.frag");
-	Shader cylinderShader("ltc.vert", "ltcCylinder.frag");
-	Shader diskShader("ltc.vert", "ltcDisk.frag");
+	auto vertexFormat = options.compactVertices ? VertexFormat::Compact : VertexFormat::Full;
+	ShaderDefines vertexDefines;
+	if (vertexFormat == VertexFormat::Compact)
+		vertexDefines["COMPACT_VERTEX"] = "1";
+	// the LTC shaders evaluate diffuse and specular together unless SEPARATE_LTC is set,
+	// and sample tables of the loaded size
+	LTCTable ltcTable;
+	if (!ltcTable.load(options.ltcTablePath))
+	{
+		cout << "Fail to load LTC table " << options.ltcTablePath << "\n";
+		return -1;
+	}
+	// the fits compiled into ltcAll.frag approximate the GGX table of LTC.h
+	if (options.analyticLtc && ltcTable.brdf != LTCTable::Brdf::GGX)
+	{
+		cout << "--analytic-ltc approximates the GGX tables, " << options.ltcTablePath << " is fitted for "
+			<< LTCTable::brdfName(ltcTable.brdf) << "\n";
+		return -1;
+	}
+	ShaderDefines ltcDefines = vertexDefines;
+	ltcDefines["LTC_LUT_SIZE"] = to_string(ltcTable.size);
+	if (options.separateLtc)
+		ltcDefines["SEPARATE_LTC"] = "1";
+	Shader rectShader = shaderCache.get("ltc.vert", "ltcRect.frag", nullptr, nullptr, nullptr, ltcDefines);
+	Shader cylinderShader = shaderCache.get("ltc.vert", "ltcCylinder.frag", nullptr, nullptr, nullptr, ltcDefines);
+	Shader diskShader = shaderCache.get("ltc.vert", "ltcDisk.frag", nullptr, nullptr, nullptr, ltcDefines);
 	vector<Shader> areaLightShaders = { rectShader, cylinderShader, diskShader, diskShader };
-	Shader polyLightShader("polyLight.vert", "polyLight.frag");
+	Shader polyLightShader = shaderCache.get("polyLight.vert", "polyLight.frag");
+	Shader sphereImpostorShader = shaderCache.get("sphereImpostor.vert", "sphereImpostor.frag");
+
+	// scene2, specialized per frame by plane type, dithering and the light types present;
+	// LTC_ANALYTIC replaces its table fetches by the fits of LTC_Approximation, which only match the GGX tables
+	ShaderDefines ltcAllDefines = ltcDefines;
+	if (options.analyticLtc)
+		ltcAllDefines["LTC_ANALYTIC"] = "1";
+	Shader ltcAllShader = shaderCache.get("ltcAll.vert", "ltcAll.frag", nullptr, "ltcAll.tesc", "ltcAll.tese", ltcAllDefines);
+	GLint ltcAllVariant = -1;
+	auto getLtcAllVariant = [&](GLint planeType, bool dithering, GLint lightTypes)
+	{
+		ShaderDefines defines = ltcAllDefines;
+		defines["PLANE_TYPE"] = to_string(planeType);
+		defines["DITHERING"] = dithering ? "1" : "0";
+		defines["LIGHT_TYPES"] = to_string(lightTypes);
+		defines["GROUP_BY_TYPE"] = "1";
+		return shaderCache.get("ltcAll.vert", "ltcAll.frag", nullptr, "ltcAll.tesc", "ltcAll.tese", defines);
+	};
+	getLtcAllVariant(0, false, 15); // default scene2 settings, compiled up front
+
+	// per-program uniform handles, created the first time a program is drawn with
+	unordered_map<GLuint, FrameUniforms> frameUniforms;
+	auto uniformsOf = [&](const Shader& program) -> FrameUniforms&
+	{
+		auto it = frameUniforms.find(program.ID);
+		if (it == frameUniforms.end())
+			it = frameUniforms.emplace(program.ID, FrameUniforms(program)).first;
+		return it->second;
+	};
+	auto& polyLightUniforms = uniformsOf(polyLightShader);
+	auto& sphereImpostorUniforms = uniformsOf(sphereImpostorShader);
 
-	Shader ltcAllShader("ltcAll.vert", "ltcAll.frag", nullptr, "ltcAll.tesc", "ltcAll.tese"); // scene2
+	LightBuffer lightBuffer; // scene2 light records
+	ClusteredLights clusteredLights; // scene2 light culling
+	LightProxies lightProxies; // light models, one instanced draw per model
+	LightAnimation lightAnimation; // scene2 light animation in a compute shader
+	ProgramBinaryCache::instance().report();
+	cout << "Shader loading: " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - shaderStart).count() << " ms" << endl;
 
-	// load models
+	// load models, the first frame needs them
 	// -----------------------------------------------------
-	Model quadModel = Model("resources/models/quad.obj");
-	Model tessQuadModel = Model("resources/models/quad.obj"); // use for tessellation plane
-	Model cylinderModel = Model("resources/models/cylinder.obj");
-	Model diskModel = Model("resources/models/disk.obj");
-	Model sphereModel = Model("resources/models/sphere.obj");
+	Model quadModel(quadData.get(), vertexFormat);
+	Model tessQuadModel(quadData.get(), vertexFormat); // use for tessellation plane
+	Model cylinderModel(cylinderData.get(), vertexFormat);
+	Model diskModel(diskData.get(), vertexFormat);
+	Model sphereModel(sphereData.get(), vertexFormat);
 	vector<Model> areaLightModels1 = { quadModel, cylinderModel, diskModel, sphereModel };
 	vector<Model> areaLightModels2 = { sphereModel, quadModel, diskModel, cylinderModel };
 
-	// load plane textures
-	// TODO: using tessellation to improve mapping quality
-	TextureMap stoneDiffuseMap = loadTexture("resources/textures/tex1/PavingStones_Color.jpg", "diffuse");
-	TextureMap stoneNormalMap = loadTexture("resources/textures/tex1/PavingStones_Normal.jpg", "normal");
-	TextureMap stoneRoughnessMap = loadTexture("resources/textures/tex1/PavingStones_Roughness.jpg", "roughness");
-	TextureMap stoneAOMap = loadTexture("resources/textures/tex1/PavingStones_AmbientOcclusion.jpg", "AO");
-	TextureMap stoneDispMap = loadTexture("resources/textures/tex1/PavingStones_Displacement.jpg", "displacement");
-
-	TextureMap marbleDiffuseMap = loadTexture("resources/textures/tex2/Marble_Color.jpg", "diffuse");
-	TextureMap marbleNormalMap = loadTexture("resources/textures/tex2/Marble_Normal.jpg", "normal");
-	TextureMap marbleRoughnessMap = loadTexture("resources/textures/tex2/Marble_Roughness.jpg", "roughness");
-	TextureMap marbleDispMap = loadTexture("resources/textures/tex2/Marble_Disp.jpg", "displacement");
-
-	TextureMap woodFloorDiffuseMap = loadTexture("resources/textures/tex3/WoodFloor_Color.jpg", "diffuse");
-	TextureMap woodFloorNormalMap = loadTexture("resources/textures/tex3/WoodFloor_Normal.jpg", "normal");
-	TextureMap woodFloorRoughnessMap = loadTexture("resources/textures/tex3/WoodFloor_Roughness.jpg", "roughness");
-	TextureMap woodFloorAOMap = loadTexture("resources/textures/tex3/WoodFloor_AmbientOcclusion.jpg", "AO");
-	TextureMap woodFloorDispMap = loadTexture("resources/textures/tex3/WoodFloor_Displacement.jpg", "displacement");
-
-	TextureMap diamondDiffuseMap = loadTexture("resources/textures/tex4/DiamondPlate_Color.jpg", "diffuse");
-	TextureMap diamondNormalMap = loadTexture("resources/textures/tex4/DiamondPlate_Normal.jpg", "normal");
-	TextureMap diamondRoughnessMap = loadTexture("resources/textures/tex4/DiamondPlate_Roughness.jpg", "roughness");
-	TextureMap diamondMetalMap = loadTexture("resources/textures/tex4/DiamondPlate_Metalness.jpg", "metallic");
-	TextureMap diamondDispMap = loadTexture("resources/textures/tex4/DiamondPlate_Displacement.jpg", "displacement");
-
-	vector<vector<TextureMap>> texMapList = {
-		{ }, 
-		{ stoneDiffuseMap, stoneNormalMap, stoneRoughnessMap, stoneAOMap, stoneDispMap },
-		{ marbleDiffuseMap, marbleNormalMap, marbleRoughnessMap, marbleDispMap },
-		{ woodFloorDiffuseMap, woodFloorNormalMap, woodFloorRoughnessMap, woodFloorAOMap, woodFloorDispMap},
-		{ diamondDiffuseMap, diamondNormalMap, diamondRoughnessMap, diamondMetalMap, diamondDispMap }
-	};
-
 	// create ltc1 and ltc2 texture 
-	GLuint LTC1TexMap = setLTCTexture(LTC1);
-	GLuint LTC2TexMap = setLTCTexture(LTC2);
+	GLuint LTC1TexMap = setLTCTexture(ltcTable, 0);
+	GLuint LTC2TexMap = setLTCTexture(ltcTable, 1);
 
-	// set FBO
+	// set FBO, a float target keeps the unclamped radiance for EXR output
+	GLuint renderWidth = options.width > 0 ? options.width : TEXTURE_WIDTH;
+	GLuint renderHeight = options.height > 0 ? options.height : TEXTURE_HEIGHT;
+	auto exrOutput = options.outputPattern.size() >= 4 && options.outputPattern.compare(options.outputPattern.size() - 4, 4, ".exr") == 0;
 	GLuint framebuffer, renderedTex;
-	createFBO(framebuffer, renderedTex);
+	createFBO(framebuffer, renderedTex, renderWidth, renderHeight, exrOutput ? GL_RGBA16F : GL_RGBA);
 
 	// set tessellation plane
-	GLuint tessQuadVAO = tessQuadModel.meshes[0].VAO;
-	GLuint tessQuadVBO = tessQuadModel.meshes[0].VBO;
-	auto tessQuadVertices = tessQuadModel.meshes[0].vertices;
+	auto tessQuadVertices = quadData.get().meshes[0].vertices;
 	vector<Vertex> newVertices = {
 		tessQuadVertices[2], tessQuadVertices[0], tessQuadVertices[3], tessQuadVertices[1]
 	};
-	glBindVertexArray(tessQuadVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, tessQuadVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)* newVertices.size(), newVertices.data(), GL_STATIC_DRAW);
-	glBindVertexArray(0);
+	tessQuadModel.meshes[0].setVertices(newVertices.data(), newVertices.size());
 
 	// ImGui demo setting
 	bool show_demo_window = false;
@@ -383,62 +505,211 @@ int main(int argc, char* args[])
 	// scene1 per-frame variables
 	auto areaLightModels = areaLightModels1;
 	auto areaLights = areaLights1;
-	auto areaLight = areaLights[0];
-	auto lightIndex = static_cast<int>(areaLight->type);
+	auto lightIndex = options.lightType;
+	auto areaLight = areaLights[lightIndex];
 	shader = areaLightShaders[lightIndex];
 	auto modelScaler = glm::vec3(1.0f);
 
 	// scene2 variables
-	time_t randomSeed = time(0);
-	GLint planeType = 0;
-	auto textureMaps = texMapList[planeType];
-	auto numSmallSphereLight = 0;
+	time_t randomSeed = headless ? options.seed : time(0);
+	GLint planeType = options.planeType;
+	vector<TextureMap> textureMaps;
+	auto numSmallSphereLight = std::min<GLint>(options.numSphereLights, MAX_MOVING_SPHERE_LIGHTS);
+	GLint lightCulling = options.lightCulling;
+	bool dithering = false;
+	bool sphereImpostors = options.sphereImpostors;
+	bool gpuAnimation = options.gpuAnimation;
+	bool ripple = false;
 	auto cameraRotation = 90.0f;
-	//if (scene == 1)
-	//{
-	//	shader = ltcAllShader;
-	//	areaLightModels = areaLightModels2;
-	//	areaLights = areaLights2;
-	//}
-
-	vector<MovingSphereLight> movingSphereLights;
-	for (int i = 0; i < 100; i++)
+
+	// switch shaders, models and camera to the current scene
+	auto setupScene = [&]()
+	{
+		useDefault();
+		ltcAllVariant = -1;
+		if (scene == 0)
+		{
+			shader = areaLightShaders[lightIndex];
+			areaLightModels = areaLightModels1;
+			areaLights = areaLights1;
+			areaLight = areaLights[lightIndex];
+
+			camera.yaw = 90.0f;
+			camera.pitch = 30.0f;
+			camera.radius = 6.0f;
+			camera.center = glm::vec3(0.0f);
+			camera.updateCameraVectors();
+		}
+		else
+		{
+			shader = ltcAllShader;
+			areaLightModels = areaLightModels2;
+			areaLights = areaLights2;
+
+			camera.yaw = 90.0f;
+			camera.pitch = 30.0f;
+			camera.radius = 35.0f;
+			camera.center = glm::vec3(0.0f, 0.0f, 0.0f);
+			camera.updateCameraVectors();
+		}
+	};
+	scene = options.scene;
+	setupScene();
+	if (benchmark)
 	{
-		auto r = random(0.3f, 0.4f);
-		auto initCenter = glm::vec3(random(-25.0f, 25.0f), r + 0.1f, random(-25.0f, 25.0f));
-		auto movingDir = glm::normalize(glm::vec3(random(-1.0f, 1.0f), 0.0f, random(-1.0f, 1.0f)));
-		auto movingSpeed = random(1.0f, 2.0f);
-		auto bounceHeight = random(1.0f, 2.0f);
-		auto color = glm::vec3(random(0.3f, 1.0f), random(0.3f, 1.0f), random(0.3f, 1.0f));
-		auto intensity = random(1.0f, 5.0f);
-
-		movingSphereLights.push_back({
-			SphereLight(color, initCenter, intensity, lightDirX, lightDirY, lightDirZ, r, r, r),
-			initCenter, movingDir, movingSpeed, bounceHeight, 0, 0.0f, 0.0f
-		});
+		GGXMaterial.roughness = benchmark->roughness;
+		ripple = benchmark->ripple;
 	}
 
+	// moving sphere lights, animated on worker threads
+	LightSimulation movingSphereLights(MAX_MOVING_SPHERE_LIGHTS, (uint32_t)randomSeed);
+	ThreadPool simulationPool;
+
+	// the orbiting lights, streams after the ones of the moving lights
+	const GLint numLight = 4;
+	OrbitParameters orbits[numLight];
+	for (uint32_t i = 0; i < numLight; i++)
+	{
+		using simulation::counterRandom;
+		orbits[i].orbitSpeed = counterRandom((uint32_t)randomSeed, i, 16, 0.5f, 1.0f);
+		orbits[i].selfRotSpeed = counterRandom((uint32_t)randomSeed, i, 17, 0.6f, 1.0f);
+		orbits[i].rotAxis = glm::vec3(counterRandom((uint32_t)randomSeed, i, 18, 0.1f, 1.0f),
+			counterRandom((uint32_t)randomSeed, i, 19, 0.1f, 1.0f), counterRandom((uint32_t)randomSeed, i, 20, 0.1f, 1.0f));
+	}
+
+	// random displacement and color for the orbiting lights, returns their model matrices
+	const GLfloat orbitSpeed = 0.5f;
+	const GLfloat selfRotSpeed = 30.0f;
+	const auto obitCenter = glm::vec3(0.0f, 10.0f, 0.0f);
+	auto animateOrbitLights = [&](GLfloat currentTime)
+	{
+		vector<glm::mat4> translateMatrice;
+		vector<glm::mat4> rotationMatrice;
+		vector<glm::mat4> modelMatrice;
+		GLfloat radius = 0.0f;
+		auto origin = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		auto model = mat4(1.0f);
+
+		for (int i = 0; i < numLight; i++, radius += 5.0f)
+		{
+			GLfloat angle = currentTime * orbitSpeed * orbits[i].orbitSpeed;
+			GLfloat x = sin(angle) * radius;
+			GLfloat y = 0.0f;
+			GLfloat z = cos(angle) * radius;
+			auto translate = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+			translate = glm::translate(translate, obitCenter);
+			translateMatrice.push_back(translate);
+
+			GLfloat selfRotAngle = currentTime * selfRotSpeed * orbits[i].selfRotSpeed;
+			auto rotAxis = orbits[i].rotAxis;
+			auto rotate = glm::rotate(glm::mat4(1.0f), glm::radians(selfRotAngle), rotAxis);
+			rotationMatrice.push_back(rotate);
+
+			model = glm::translate(model, glm::vec3(x, y, z));
+			model = glm::translate(model, obitCenter);
+			model = glm::rotate(model, glm::radians(selfRotAngle), rotAxis);
+			model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+			modelMatrice.push_back(model);
+			model = mat4(1.0f);
+		}
+
+		sphereLight->color = glm::vec3(
+			fabs(sin(0.3f * currentTime) / 2.0f + 0.5f), 
+			fabs(sin(0.7f * currentTime) / 2.0f + 0.5f),
+			fabs(sin(0.5f * currentTime) / 2.0f + 0.5f)
+		);
+		sphereLight->intensity = 10.0f;
+		sphereLight->lengthX = 2.0f;
+		sphereLight->lengthY = 2.0f;
+		sphereLight->lengthZ = 2.0f;
+		sphereLight->center = glm::vec3(translateMatrice[0] * origin);
+		modelMatrice[0] = glm::scale(modelMatrice[0], glm::vec3(sphereLight->lengthX, sphereLight->lengthY, sphereLight->lengthZ));
+		sphereLight->update();
+
+		rectLight->color = glm::vec3(1.0f, 0.0f, 0.0f);
+		rectLight->intensity = 8.0f;
+		rectLight->halfX = 1.0f;
+		rectLight->halfY = 1.0f;
+		rectLight->center = glm::vec3(translateMatrice[1] * origin);
+		rectLight->dirX = glm::vec3(rotationMatrice[1] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
+		rectLight->dirY = glm::vec3(rotationMatrice[1] * glm::vec4(glm::vec3(0.0f, 1.0f, 0.0f), 1.0f));
+		modelMatrice[1] = glm::scale(modelMatrice[1], glm::vec3(rectLight->halfX, 1.0f, rectLight->halfY));
+		rectLight->update();
+
+		diskLight->color = glm::vec3(0.0f, 1.0f, 0.0f);
+		diskLight->intensity = 8.0f;
+		diskLight->halfX = 1.0f;
+		diskLight->halfY = 1.0f;
+		diskLight->center = glm::vec3(translateMatrice[2] * origin);
+		diskLight->dirX = glm::vec3(rotationMatrice[2] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
+		diskLight->dirY = glm::vec3(rotationMatrice[2] * glm::vec4(glm::vec3(0.0f, 1.0f, 0.0f), 1.0f));
+		modelMatrice[2] = glm::scale(modelMatrice[2], glm::vec3(diskLight->halfX, 1.0f, diskLight->halfY));
+		diskLight->update();
+
+		cylinderLight->color = glm::vec3(0.0f, 0.0f, 1.0f);
+		cylinderLight->intensity = 20.0f;
+		cylinderLight->length = 2.0f;
+		cylinderLight->radius = 0.05f;
+		cylinderLight->center = glm::vec3(translateMatrice[3] * origin);
+		cylinderLight->tangent = glm::vec3(rotationMatrice[3] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
+		modelMatrice[3] = glm::scale(modelMatrice[3], glm::vec3(cylinderLight->length / 2.0f, cylinderLight->radius, cylinderLight->radius));
+		cylinderLight->update();
+		return modelMatrice;
+	};
+
+	// the orbiting lights as lightAnimation.comp animates them, with the shapes set by animateOrbitLights
+	auto gpuOrbitLights = [&]()
+	{
+		animateOrbitLights(0.0f);
+		vector<GPUOrbitLight> lights(numLight);
+		for (int i = 0; i < numLight; i++)
+		{
+			lights[i].orbit = glm::vec4(obitCenter, 5.0f * i);
+			lights[i].orbitSpeed = orbitSpeed * orbits[i].orbitSpeed;
+			lights[i].rotation = glm::vec4(orbits[i].rotAxis, selfRotSpeed * orbits[i].selfRotSpeed);
+			lights[i].color = glm::vec4(areaLights2[i]->color, areaLights2[i]->intensity);
+			lights[i].type = static_cast<GLint>(areaLights2[i]->type);
+		}
+		lights[0].colorFrequency = glm::vec4(0.3f, 0.7f, 0.5f, 0.0f);
+		lights[0].size = glm::vec4(sphereLight->lengthX, sphereLight->lengthY, sphereLight->lengthZ, 0.0f);
+		lights[1].size = glm::vec4(rectLight->halfX, rectLight->halfY, 0.0f, 0.0f);
+		lights[2].size = glm::vec4(diskLight->halfX, diskLight->halfY, 0.0f, 0.0f);
+		lights[3].size = glm::vec4(cylinderLight->length, cylinderLight->radius, 0.0f, 0.0f);
+		return lights;
+	};
+	bool animationOnGPU = false; // the GPU buffers hold the current state of the moving lights
+	GLint animationLayout = -1; // light count and proxy model the compute path was configured for, -1: none
+
 
 	// FPS 
 	GLfloat accuTime = 0.0f;
 	GLint numFrames = 0;
 	GLint FPS = 0;
+	FrameTimer frameTimer(headless ? 0 : 256);
+	bool showProfiler = false;
+	GLint frame = 0;
 
-	// shader pre-configuration
-	// -----------------------------------------------------
-	shader.use();
-	shader.setInt("LTC1", 0);
-	shader.setInt("LTC2", 1);
+	const size_t TEXTURE_UPLOADS_PER_FRAME = 2;
+	bool firstFrame = true;
 
-	while (!glfwWindowShouldClose(window))
+	while (headless ? frame < options.warmupFrames + options.frames : !glfwWindowShouldClose(window))
 	{
 		// TODO: F5 reload shader
 		// -----------------------------------------------------
-
-		// per-frame animation
-		GLfloat currentTime = glfwGetTime();
+		if (headless && frame == options.warmupFrames && frame > 0)
+			frameTimer.reset();
+		frameTimer.begin();
+		frameTimer.beginStage("assets");
+		assetLoader.update(TEXTURE_UPLOADS_PER_FRAME);
+		frameTimer.endStage();
+
+		// per-frame animation, with a fixed time step when headless so runs are reproducible
+		GLfloat currentTime = headless ? frame * options.timeStep : glfwGetTime();
 		deltaTime = currentTime - lastTime;
 		lastTime = currentTime;
+		if (benchmark)
+			benchmark->cameraAt(currentTime, camera);
 		accuTime += deltaTime;
 		numFrames++;
 
@@ -450,11 +721,16 @@ int main(int argc, char* args[])
 		}
 
 		// poll and handle events
-		glfwPollEvents();
+		if (!headless)
+			glfwPollEvents();
 
 		// start the Dear ImGui frame
+		frameTimer.beginStage("imgui");
 		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
+		if (headless)
+			io.DeltaTime = options.timeStep;
+		else
+			ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
 
@@ -465,6 +741,9 @@ int main(int argc, char* args[])
 			ImGui::Begin("Configuration", NULL, window_flags);
 
 			ImGui::Text("FPS: %u (%.2f ms/frame)", FPS, (GLfloat)deltaTime * 1000.0f);
+			if (auto timing = frameTimer.latest())
+				ImGui::Text("CPU: %.2f ms, GPU: %.2f ms", timing->cpuMs, timing->gpuMs);
+			ImGui::Checkbox("Profiler", &showProfiler);
 			ImGui::Text("");
 
 			ImGui::Text("Scenes");
@@ -475,34 +754,7 @@ int main(int argc, char* args[])
 				ImGui::RadioButton("Scene2", &scene, 1);
 
 				if (prevScene != scene)
-				{
-					useDefault();
-					if (scene == 0)
-					{
-						shader = areaLightShaders[lightIndex];
-						areaLightModels = areaLightModels1;
-						areaLights = areaLights1;
-						areaLight = areaLights[lightIndex];
-						
-						camera.yaw = 90.0f;
-						camera.pitch = 30.0f;
-						camera.radius = 6.0f;
-						camera.center = glm::vec3(0.0f);
-						camera.updateCameraVectors();
-					}
-					else
-					{
-						shader = ltcAllShader;
-						areaLightModels = areaLightModels2;
-						areaLights = areaLights2;
-
-						camera.yaw = 90.0f;
-						camera.pitch = 30.0f;
-						camera.radius = 35.0f;
-						camera.center = glm::vec3(0.0f, 0.0f, 0.0f);
-						camera.updateCameraVectors();
-					}
-				}
+					setupScene();
 			}
 			ImGui::Text("");
 			
@@ -609,8 +861,8 @@ int main(int argc, char* args[])
 						// set scale factors for drawing light object
 						modelScaler = glm::vec3(currentLight->lengthX, currentLight->lengthY, currentLight->lengthZ);
 					}
-					// call update function in light. TODO: only call it when changed
-					areaLight->updatePoints();
+					// recompute the light points when the shape changed
+					areaLight->update();
 				}
 			}
 			else // scene2 GUI
@@ -618,13 +870,27 @@ int main(int argc, char* args[])
 				{
 					const char* types[] = { "Default", "Stone", "Marble", "Wood", "Diamond Plate" };
 					ImGui::Combo("Plane textures", &planeType, types, IM_ARRAYSIZE(types));
+					GLint textureBudget = (GLint)(materials.budget >> 20);
+					if (ImGui::SliderInt("Texture budget (MB)", &textureBudget, 0, 1024))
+						materials.budget = (size_t)textureBudget << 20;
+					ImGui::SameLine(); HelpMarker("Materials are loaded when first selected. Beyond this budget the least recently used ones are unloaded.");
+					ImGui::Text("Resident textures: %d MB", (int)(materials.residentBytes() >> 20));
+
+					ImGui::SliderInt("Sphere Lights", &numSmallSphereLight, 0, MAX_MOVING_SPHERE_LIGHTS);
+					ImGui::Checkbox("Sphere Impostors", &sphereImpostors);
+					ImGui::SameLine(); HelpMarker("Draw the sphere lights as ray traced spheres on quads instead of sphere meshes.");
+					ImGui::Checkbox("GPU Animation", &gpuAnimation);
+					ImGui::SameLine(); HelpMarker("Animate the lights in a compute shader that writes the light buffer and the proxies in GPU memory. CPU light culling then runs on the GPU, as the CPU has no light bounds.");
+
+					const char* cullingModes[] = { "None", "Clustered (CPU)", "Clustered (GPU)" };
+					ImGui::Combo("Light Culling", &lightCulling, cullingModes, IM_ARRAYSIZE(cullingModes));
+					if (lightCulling != static_cast<GLint>(LightCulling::None))
+					{
+						ImGui::SliderFloat("Cutoff", &lightBuffer.influenceCutoff, 0.0005f, 0.05f, "%.4f", ImGuiSliderFlags_Logarithmic);
+						ImGui::SameLine(); HelpMarker("Lights are culled at the distance where their contribution falls below this value.");
+					}
 
-					ImGui::SliderInt("Sphere Lights", &numSmallSphereLight, 0, 100);
-
-					static bool dithering = false;
 					ImGui::Checkbox("Dithering", &dithering);
-					shader.use();
-					shader.setBool("dithering", dithering);
 
 					static bool autoRotation = false;
 					ImGui::Checkbox("Auto-Rotate", &autoRotation);
@@ -635,21 +901,19 @@ int main(int argc, char* args[])
 						camera.updateCameraVectors();
 					}
 
-					static bool ripple = false;
 					ImGui::Checkbox("Ripple", &ripple);
-					shader.use();
-					shader.setBool("ripple", ripple);
 				}
-				// update plane texture maps
-				textureMaps = texMapList[planeType];
 			}
 
 			ImGui::End();
 		}
+		if (showProfiler)
+			ProfilerWindow(frameTimer, &showProfiler);
+		frameTimer.endStage();
 
 		// 1. render the scene into texture
 		// -----------------------------------------------------
-		glViewport(0, 0, TEXTURE_WIDTH, TEXTURE_HEIGHT);
+		glViewport(0, 0, renderWidth, renderHeight);
 		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 		glEnable(GL_DEPTH_TEST);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -664,28 +928,34 @@ int main(int argc, char* args[])
 			auto model = glm::mat4(1.0f);
 			model = glm::scale(model, glm::vec3(PLANE_SCALER));
 			auto view = camera.getViewMatrix();
-			auto projection = glm::perspective(glm::radians(45.0f), (float)TEXTURE_WIDTH / (float)TEXTURE_HEIGHT, 0.1f, 100.0f);
+			auto projection = glm::perspective(glm::radians(45.0f), (float)renderWidth / (float)renderHeight, 0.1f, 100.0f);
 
 			// draw plane
+			frameTimer.beginStage("upload");
+			auto& uniforms = uniformsOf(shader);
 			shader.use();
-			shader.setMat4("model", model);
-			shader.setMat4("view", view);
-			shader.setMat4("projection", projection);
-			shader.setVec3("cameraPos", camera.position);
-			shader.setVec3("light.lightColor", areaLight->color);
-			shader.setFloat("light.intensity", areaLight->intensity);
+			uniforms.ltc1.set(0);
+			uniforms.ltc2.set(1);
+			uniforms.model.set(model);
+			uniforms.view.set(view);
+			uniforms.projection.set(projection);
+			uniforms.cameraPos.set(camera.position);
+			uniforms.lightColor.set(areaLight->color);
+			uniforms.lightIntensity.set(areaLight->intensity);
 			for (int i = 0; i < areaLight->points.size(); i++)
-				shader.setVec3("light.points[" + to_string(i) + "]", areaLight->points[i]);
-			shader.setVec3("material.diffuse", GGXMaterial.diffuse);
-			shader.setVec3("material.specular", GGXMaterial.specular);
-			shader.setFloat("material.roughness", GGXMaterial.roughness);
-
+				uniforms.lightPoints[i].set(areaLight->points[i]);
+			uniforms.materialDiffuse.set(GGXMaterial.diffuse);
+			uniforms.materialSpecular.set(GGXMaterial.specular);
+			uniforms.materialRoughness.set(GGXMaterial.roughness);
+			frameTimer.endStage();
 
+			frameTimer.beginStage("plane");
 			glActiveTexture(GL_TEXTURE0);
 			glBindTexture(GL_TEXTURE_2D, LTC1TexMap);
 			glActiveTexture(GL_TEXTURE1);
 			glBindTexture(GL_TEXTURE_2D, LTC2TexMap);
 			quadModel.draw(shader);
+			frameTimer.endStage();
 
 			// draw light model
 			model = glm::mat4(1.0f);
@@ -695,219 +965,193 @@ int main(int argc, char* args[])
 			model = glm::scale(model, modelScaler);
 			model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
+			frameTimer.beginStage("upload");
+			lightProxies.clear();
+			lightProxies.add(&areaLightModels[lightIndex], model, areaLight->color);
+			lightProxies.upload();
+			animationLayout = -1; // scene 2 lays out its proxies again
 			polyLightShader.use();
-			polyLightShader.setMat4("model", model);
-			polyLightShader.setMat4("view", view);
-			polyLightShader.setMat4("projection", projection);
-			polyLightShader.setVec3("lightColor", areaLight->color);
+			polyLightUniforms.view.set(view);
+			polyLightUniforms.projection.set(projection);
+			frameTimer.endStage();
 
-			areaLightModels[lightIndex].draw(polyLightShader);
+			FrameTimer::Scope scope(frameTimer, "proxies");
+			lightProxies.draw(polyLightShader, sphereImpostorShader);
 		}
 		else
 		{
 			// rendering scene 2
 			// -----------------------------------------------------
 
-			// random small moving sphere lights
-			for (int i = 0; i < numSmallSphereLight; i++)
+			// the plane shows the default material until all maps of the selected one are uploaded,
+			// headless runs wait for them so every captured frame has the same material
+			auto ready = materials.use(planeType);
+			if (!ready && headless)
 			{
-				auto& movingSphereLight = movingSphereLights[i];
-				movingSphereLight.t += deltaTime;
-				movingSphereLight.s += movingSphereLight.countBounceHit % 2 == 0 ? deltaTime : -deltaTime;
-
-				// changes over time
-				auto posXZ = movingSphereLight.movingSpeed * movingSphereLight.movingDir * movingSphereLight.t;
-				auto posY = movingSphereLight.bounceHeight * fabs(sin(movingSphereLight.s));
-				auto center = movingSphereLight.initCenter + glm::vec3(posXZ.x, 0.0f, posXZ.z);
-				center.y = movingSphereLight.sphereLight.lengthY + posY + 0.1f;
-
-				// bounce back if hit the plane boundary
-				if (fabs(center.x) >= 29.5f || fabs(center.z >= 29.5f))
-				{
-					movingSphereLight.initCenter = movingSphereLight.sphereLight.center;
-
-					movingSphereLight.t = deltaTime;
-					movingSphereLight.movingDir = -movingSphereLight.movingDir;
-					posXZ = movingSphereLight.movingSpeed * movingSphereLight.movingDir * movingSphereLight.t;
-
-					movingSphereLight.countBounceHit++;
-					movingSphereLight.s += movingSphereLight.countBounceHit % 2 == 0 ? deltaTime : -deltaTime;
-					posY = movingSphereLight.bounceHeight * fabs(sin(movingSphereLight.s));
-
-					center = movingSphereLight.initCenter + glm::vec3(posXZ.x, 0.0f, posXZ.z);
-					center.y = movingSphereLight.sphereLight.lengthY + posY + 0.1f;
-				}
-				movingSphereLight.sphereLight.center = center;
-
-				// update points
-				movingSphereLight.sphereLight.updatePoints();
+				assetLoader.finish();
+				ready = materials.use(planeType);
 			}
+			auto shownPlaneType = ready ? planeType : 0;
+			textureMaps = materials.textures(shownPlaneType);
+			materials.evict();
 
-
-			// random displacement and color for lights
-			vector<glm::mat4> translateMatrice;
-			vector<glm::mat4> rotationMatrice;
+			// animate the lights on the GPU, which writes the light records and proxies itself,
+			// or on the CPU, keeping both states in step when the path is switched
 			vector<glm::mat4> modelMatrice;
-			srand(randomSeed);
-			GLfloat radius = 0.0f;
-			GLfloat orbitSpeed = 0.5f;
-			GLfloat selfRotSpeed = 30.0f;
-			GLint numLight = 4;
-			auto obitCenter = glm::vec3(0.0f, 10.0f, 0.0f);
-			auto origin = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-			auto model = mat4(1.0f);
-
-			for (int i = 0; i < numLight; i++, radius += 5.0f)
+			frameTimer.beginStage("simulation");
+			if (gpuAnimation)
 			{
-				GLfloat angle = currentTime * orbitSpeed * random(0.5f, 1.0f);
-				GLfloat x = sin(angle) * radius;
-				GLfloat y = 0.0f;
-				GLfloat z = cos(angle) * radius;
-				auto translate = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
-				translate = glm::translate(translate, obitCenter);
-				translateMatrice.push_back(translate);
-
-				GLfloat selfRotAngle = currentTime * selfRotSpeed * random(0.6f, 1.0f);
-				auto rotAxis = glm::vec3(random(0.1f, 1.0f), random(0.1f, 1.0f), random(0.1f, 1.0f));
-				auto rotate = glm::rotate(glm::mat4(1.0f), glm::radians(selfRotAngle), rotAxis);
-				rotationMatrice.push_back(rotate);
-
-				model = glm::translate(model, glm::vec3(x, y, z));
-				model = glm::translate(model, obitCenter);
-				model = glm::rotate(model, glm::radians(selfRotAngle), rotAxis);
-				model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-
-				modelMatrice.push_back(model);
-				model = mat4(1.0f);
+				if (!animationOnGPU)
+				{
+					lightAnimation.upload(movingSphereLights);
+					animationOnGPU = true;
+				}
+				auto layout = numSmallSphereLight * 2 + (sphereImpostors ? 1 : 0);
+				if (layout != animationLayout)
+				{
+					animationLayout = layout;
+					vector<const Model*> orbitModels;
+					for (int i = 0; i < numLight; i++)
+						orbitModels.push_back(&areaLightModels[i]);
+					lightAnimation.configure(gpuOrbitLights(), orbitModels, numSmallSphereLight, sphereImpostors ? nullptr : &sphereModel, lightBuffer, lightProxies);
+				}
+				lightAnimation.dispatch(currentTime, deltaTime, lightBuffer.influenceCutoff, lightBuffer, lightProxies);
+				frameTimer.endStage();
+			}
+			else
+			{
+				if (animationOnGPU)
+				{
+					lightAnimation.download(movingSphereLights);
+					animationOnGPU = false;
+					animationLayout = -1;
+				}
+				movingSphereLights.update(deltaTime, numSmallSphereLight, &simulationPool);
+				modelMatrice = animateOrbitLights(currentTime);
+
+				// pack all lights into the storage buffer with a single upload, grouped by type
+				lightBuffer.clear();
+				for (int i = 0; i < numLight; i++)
+					lightBuffer.add(*areaLights[i], areaLights[i]->type == LightType::Cylinder ? cylinderLight->radius : 0.0f);
+				lightBuffer.addSpheres(movingSphereLights, numSmallSphereLight);
+				lightBuffer.groupByType();
+				frameTimer.endStage();
+
+				FrameTimer::Scope scope(frameTimer, "upload");
+				lightBuffer.upload();
 			}
-
-			sphereLight->color = glm::vec3(
-				fabs(sin(0.3f * currentTime) / 2.0f + 0.5f), 
-				fabs(sin(0.7f * currentTime) / 2.0f + 0.5f),
-				fabs(sin(0.5f * currentTime) / 2.0f + 0.5f)
-			);
-			sphereLight->intensity = 10.0f;
-			sphereLight->lengthX = 2.0f;
-			sphereLight->lengthY = 2.0f;
-			sphereLight->lengthZ = 2.0f;
-			sphereLight->center = glm::vec3(translateMatrice[0] * origin);
-			modelMatrice[0] = glm::scale(modelMatrice[0], glm::vec3(sphereLight->lengthX, sphereLight->lengthY, sphereLight->lengthZ));
-			sphereLight->updatePoints();
-
-			rectLight->color = glm::vec3(1.0f, 0.0f, 0.0f);
-			rectLight->intensity = 8.0f;
-			rectLight->halfX = 1.0f;
-			rectLight->halfY = 1.0f;
-			rectLight->center = glm::vec3(translateMatrice[1] * origin);
-			rectLight->dirX = glm::vec3(rotationMatrice[1] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
-			rectLight->dirY = glm::vec3(rotationMatrice[1] * glm::vec4(glm::vec3(0.0f, 1.0f, 0.0f), 1.0f));
-			modelMatrice[1] = glm::scale(modelMatrice[1], glm::vec3(rectLight->halfX, 1.0f, rectLight->halfY));
-			rectLight->updatePoints();
-
-			diskLight->color = glm::vec3(0.0f, 1.0f, 0.0f);
-			diskLight->intensity = 8.0f;
-			diskLight->halfX = 1.0f;
-			diskLight->halfY = 1.0f;
-			diskLight->center = glm::vec3(translateMatrice[2] * origin);
-			diskLight->dirX = glm::vec3(rotationMatrice[2] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
-			diskLight->dirY = glm::vec3(rotationMatrice[2] * glm::vec4(glm::vec3(0.0f, 1.0f, 0.0f), 1.0f));
-			modelMatrice[2] = glm::scale(modelMatrice[2], glm::vec3(diskLight->halfX, 1.0f, diskLight->halfY));
-			diskLight->updatePoints();
-
-			cylinderLight->color = glm::vec3(0.0f, 0.0f, 1.0f);
-			cylinderLight->intensity = 20.0f;
-			cylinderLight->length = 2.0f;
-			cylinderLight->radius = 0.05f;
-			cylinderLight->center = glm::vec3(translateMatrice[3] * origin);
-			cylinderLight->tangent = glm::vec3(rotationMatrice[3] * glm::vec4(glm::vec3(1.0f, 0.0f, 0.0f), 1.0f));
-			modelMatrice[3] = glm::scale(modelMatrice[3], glm::vec3(cylinderLight->length / 2.0f, cylinderLight->radius, cylinderLight->radius));
-			cylinderLight->updatePoints();
-
 
 			// configure transforms
-			model = glm::mat4(1.0f);
+			auto model = glm::mat4(1.0f);
 			model = glm::scale(model, glm::vec3(PLANE_SCALER));
 			auto view = camera.getViewMatrix();
-			auto projection = glm::perspective(glm::radians(45.0f), (float)TEXTURE_WIDTH / (float)TEXTURE_HEIGHT, 0.1f, 100.0f);
+			auto projection = glm::perspective(glm::radians(45.0f), (float)renderWidth / (float)renderHeight, 0.1f, 100.0f);
 			auto normalMapRot = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
-			// set shader uniforms
-			shader.use();
-			shader.setMat4("model", model);
-			shader.setMat4("view", view);
-			shader.setMat4("projection", projection);
-			shader.setMat4("normalMapRot", normalMapRot);
-			shader.setVec3("cameraPos", camera.position);
-			for (int i = 0; i < numLight; i++)
+			// pick the program specialized for the current settings
+			auto variant = shownPlaneType | (dithering ? 8 : 0) | (lightBuffer.typeMask() << 4);
+			if (variant != ltcAllVariant)
 			{
-				shader.setInt("lights[" + to_string(i) + "].type", i);
-				shader.setFloat("lights[" + to_string(i) + "].intensity", areaLights[i]->intensity);
-				shader.setVec3("lights[" + to_string(i) + "].lightColor", areaLights[i]->color);
-				for (int j = 0; j < areaLights[i]->points.size(); j++)
-					shader.setVec3("lights[" + to_string(i) + "].points[" + to_string(j) + "]", areaLights[i]->points[j]); // lights[i].points[j]
+				ltcAllVariant = variant;
+				shader = getLtcAllVariant(shownPlaneType, dithering, lightBuffer.typeMask());
 			}
-			shader.setFloat("lights[3].radius", cylinderLight->radius);
-			for (int i = 0; i < numSmallSphereLight; i++)
+
+			// set shader uniforms
+			frameTimer.beginStage("upload");
+			auto& uniforms = uniformsOf(shader);
+			shader.use();
+			uniforms.ltc1.set(0);
+			uniforms.ltc2.set(1);
+			uniforms.model.set(model);
+			uniforms.view.set(view);
+			uniforms.projection.set(projection);
+			uniforms.normalMapRot.set(normalMapRot);
+			uniforms.cameraPos.set(camera.position);
+			frameTimer.endStage();
+
+			// build the per-cluster light lists, the CPU has no light bounds when the GPU animates the lights
+			if (lightCulling != static_cast<GLint>(LightCulling::None))
 			{
-				shader.setFloat("sphereLights[" + to_string(i) + "].intensity", movingSphereLights[i].sphereLight.intensity);
-				shader.setVec3("sphereLights[" + to_string(i) + "].lightColor", movingSphereLights[i].sphereLight.color);
-				for (int j = 0; j < movingSphereLights[i].sphereLight.points.size(); j++)
-					shader.setVec3("sphereLights[" + to_string(i) + "].points[" + to_string(j) + "]", movingSphereLights[i].sphereLight.points[j]); // lights[i].points[j]
+				FrameTimer::Scope scope(frameTimer, "culling");
+				clusteredLights.setup(projection);
+				if (lightCulling == static_cast<GLint>(LightCulling::ClusteredCPU) && !gpuAnimation)
+					clusteredLights.buildCPU(lightBuffer, view);
+				else
+					clusteredLights.buildGPU(lightBuffer, view);
+				clusteredLights.bind();
 			}
-			shader.setVec3("material.diffuse", GGXMaterial.diffuse);
-			shader.setVec3("material.specular", GGXMaterial.specular);
-			shader.setFloat("material.roughness", GGXMaterial.roughness);
-			shader.setInt("planeType", planeType);
-			shader.setInt("numSphereLights", numSmallSphereLight);
-			shader.setFloat("time", currentTime);
 
+			frameTimer.beginStage("upload");
+			shader.use();
+			lightBuffer.bind(0);
+			uniforms.numLights.set((GLint)lightBuffer.size());
+			uniforms.clustered.set(lightCulling != static_cast<GLint>(LightCulling::None));
+			clusteredLights.setUniforms(uniforms.cluster, renderWidth, renderHeight);
+			uniforms.materialDiffuse.set(GGXMaterial.diffuse);
+			uniforms.materialSpecular.set(GGXMaterial.specular);
+			uniforms.materialRoughness.set(GGXMaterial.roughness);
+			uniforms.planeType.set(shownPlaneType);
+			uniforms.time.set(currentTime);
+			uniforms.ripple.set(ripple);
+			for (int i = 0; i < LightBuffer::NUM_LIGHT_TYPES; i++)
+				uniforms.lightTypeRanges[i].set(lightBuffer.typeRanges[i]);
+			frameTimer.endStage();
+
+			frameTimer.beginStage("plane");
 			glActiveTexture(GL_TEXTURE0);
 			glBindTexture(GL_TEXTURE_2D, LTC1TexMap);
 			glActiveTexture(GL_TEXTURE1);
 			glBindTexture(GL_TEXTURE_2D, LTC2TexMap);
-			for (int i = 0; i < textureMaps.size(); i++)
+			for (GLint i = 0; i < NUM_PLANE_MAPS; i++)
+				uniforms.planeMaps[i].set(FIRST_PLANE_MAP_UNIT + i);
+			for (size_t i = 0; i < textureMaps.size(); i++)
 			{
-				glActiveTexture(GL_TEXTURE2 + i);
-				string name = textureMaps[i].name;
-				name = name == "displacement" ? "dispMap" : "material.texture_" + name;
-				shader.setInt(name, 2 + i);
+				auto sampler = materialSamplers[shownPlaneType][i];
+				if (sampler < 0)
+					continue;
+				glActiveTexture(GL_TEXTURE0 + FIRST_PLANE_MAP_UNIT + sampler);
 				glBindTexture(GL_TEXTURE_2D, textureMaps[i].id);
 			}
 			glBindVertexArray(tessQuadModel.meshes[0].VAO);
 			glDrawArrays(GL_PATCHES, 0, 4);
 			glBindVertexArray(0);
+			frameTimer.endStage();
 
-			// draw light model
-			polyLightShader.use();
-			polyLightShader.setMat4("view", view);
-			polyLightShader.setMat4("projection", projection);
-
-			for (int i = 0; i < numLight; i++)
+			// draw light models, one instanced draw per model
+			frameTimer.beginStage("upload");
+			if (!gpuAnimation)
 			{
-				model = modelMatrice[i] ;
-				polyLightShader.setMat4("model", model);
-				polyLightShader.setVec3("lightColor", areaLights[i]->color);
-
-				areaLightModels[i].draw(polyLightShader);
+				lightProxies.clear();
+				for (int i = 0; i < numLight; i++)
+					lightProxies.add(&areaLightModels[i], modelMatrice[i], areaLights[i]->color);
+				for (int i = 0; i < numSmallSphereLight; i++)
+				{
+					model = mat4(1.0f);
+					model = glm::translate(model, movingSphereLights.center(i));
+					model = glm::scale(model, glm::vec3(movingSphereLights.radius[i]));
+					lightProxies.add(sphereImpostors ? nullptr : &sphereModel, model, movingSphereLights.color(i));
+				}
+				lightProxies.upload();
 			}
-			for (int i = 0; i < numSmallSphereLight; i++)
-			{
-				model = mat4(1.0f);
-				model = glm::translate(model, movingSphereLights[i].sphereLight.center);
-				model = glm::scale(model, glm::vec3(movingSphereLights[i].sphereLight.lengthX));
-				polyLightShader.setMat4("model", model);
-				polyLightShader.setVec3("lightColor", movingSphereLights[i].sphereLight.color);
 
-				sphereModel.draw(polyLightShader);
-			}
+			polyLightShader.use();
+			polyLightUniforms.view.set(view);
+			polyLightUniforms.projection.set(projection);
+			sphereImpostorShader.use();
+			sphereImpostorUniforms.view.set(view);
+			sphereImpostorUniforms.projection.set(projection);
+			frameTimer.endStage();
+
+			FrameTimer::Scope scope(frameTimer, "proxies");
+			lightProxies.draw(polyLightShader, sphereImpostorShader);
 		}
 
-
 		// 2. output rendering result
 		// ----------------------------------------------------
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glDisable(GL_DEPTH_TEST);
 
+		frameTimer.beginStage("imgui");
 		{
 			ImGui::Begin("Scene Window", NULL, window_flags);
 			ImVec2 screenPos = ImGui::GetCursorScreenPos();
@@ -919,26 +1163,94 @@ int main(int argc, char* args[])
 
 		// render Dear ImGui into screen
 		ImGui::Render();
+		if (firstFrame)
+			cout << "First frame after " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count() << " ms" << endl;
+		firstFrame = false;
+		if (headless)
+		{
+			frameTimer.endStage();
+			frameTimer.end();
+
+			// save the rendered texture instead of presenting it
+			if (!options.outputPattern.empty())
+			{
+				char path[1024];
+				snprintf(path, sizeof(path), options.outputPattern.c_str(), frame);
+				imageWriter::saveFramebuffer(framebuffer, renderWidth, renderHeight, path);
+			}
+			frame++;
+			continue;
+		}
 		int display_w, display_h;
 		glfwGetFramebufferSize(window, &display_w, &display_h);
 		glViewport(0, 0, display_w, display_h);
 		glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
 		glClear(GL_COLOR_BUFFER_BIT);
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		frameTimer.endStage();
 		
 
 		// swap buffer
 		// -----------------------------------------------------
+		frameTimer.beginStage("swap");
 		glfwSwapBuffers(window);
+		frameTimer.endStage();
+		frameTimer.end();
+	}
+
+	// per-frame timings of the headless run, benchmarks print a summary instead
+	auto exitCode = 0;
+	if (headless)
+	{
+		frameTimer.finish();
+		if (benchmark)
+		{
+			if (options.updateBaseline && !options.baselinePath.empty())
+				exitCode = updateBaseline(options.baselinePath, benchmark->name, frameTimer) ? 0 : 1;
+			else
+				exitCode = reportBenchmark(benchmark->name, frameTimer, options.baselinePath, options.tolerance) ? 0 : 1;
+		}
+		if (options.csvPath.empty() && !benchmark)
+			frameTimer.writeCSV(cout);
+		else if (!options.csvPath.empty())
+		{
+			ofstream csv(options.csvPath);
+			if (csv)
+				frameTimer.writeCSV(csv);
+			else
+				cout << "Fail to open " << options.csvPath << endl;
+		}
+		if (!options.jsonPath.empty())
+		{
+			ofstream json(options.jsonPath);
+			if (json)
+				frameTimer.writeJSON(json);
+			else
+				cout << "Fail to open " << options.jsonPath << endl;
+		}
 	}
 
 	// cleanup
+	frameTimer.deleteQueries();
+	materials.deleteTextures();
+	assetLoader.deleteBuffers();
+	shaderCache.deletePrograms();
+	lightBuffer.deleteBuffer();
+	clusteredLights.deleteBuffers();
+	lightProxies.deleteBuffers();
+	lightAnimation.deleteBuffers();
 	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
+	if (!headless)
+		ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (headless)
+		headlessContext.destroy();
+	else
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 
-	return 0;
+	return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <chrono>
+#include <iostream>
+
+#include "assetLoader.h"
+
+// Texture sets of the plane materials, loaded the first time they are used.
+// Sets stay resident while they fit in the memory budget; beyond it the least
+// recently used ones are deleted and loaded again if they are selected later.
+class MaterialLibrary
+{
+public:
+	size_t budget; // bytes of texture memory kept for materials
+
+	MaterialLibrary(AssetLoader& loader, size_t budget) : budget(budget), loader(loader), useCount(0)
+	{
+	}
+
+	// register a material with its texture files and sampler names, nothing is loaded yet
+	size_t add(const string& name, const vector<pair<string, string>>& files)
+	{
+		MaterialSet set;
+		set.name = name;
+		set.files = files;
+		sets.push_back(set);
+		return sets.size() - 1;
+	}
+
+	// mark a material as used now and start loading it if it is not resident.
+	// Returns true when all of its maps are uploaded.
+	bool use(size_t index)
+	{
+		auto& set = sets[index];
+		set.lastUse = ++useCount;
+		if (!set.requested)
+		{
+			set.requested = true;
+			set.reported = false;
+			set.start = std::chrono::high_resolution_clock::now();
+			for (auto& file : set.files)
+				set.textures.push_back(loader.loadTexture(file.first, file.second, file.second == "diffuse"));
+		}
+		if (!loader.isReady(set.textures))
+			return false;
+		if (!set.reported)
+		{
+			set.reported = true;
+			if (!set.files.empty())
+				std::cout << "Loaded material " << set.name << " (" << (residentBytes(set) >> 20) << " MB) in "
+					<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - set.start).count() << " ms" << std::endl;
+		}
+		return true;
+	}
+
+	// the maps of a material, valid once use() returned true
+	vector<TextureMap> textures(size_t index) const
+	{
+		vector<TextureMap> maps;
+		for (auto texture : sets[index].textures)
+			maps.push_back(loader.texture(texture));
+		return maps;
+	}
+
+	bool isResident(size_t index) const
+	{
+		return sets[index].requested;
+	}
+
+	size_t residentBytes() const
+	{
+		size_t bytes = 0;
+		for (auto& set : sets)
+			bytes += residentBytes(set);
+		return bytes;
+	}
+
+	// delete least recently used materials until the budget is met.
+	// The material used last and materials still loading are kept.
+	void evict()
+	{
+		auto bytes = residentBytes();
+		while (bytes > budget)
+		{
+			MaterialSet* oldest = nullptr;
+			for (auto& set : sets)
+				if (set.requested && set.lastUse != useCount && loader.isReady(set.textures) && !set.textures.empty()
+					&& (!oldest || set.lastUse < oldest->lastUse))
+					oldest = &set;
+			if (!oldest)
+				return;
+			bytes -= residentBytes(*oldest);
+			unload(*oldest);
+		}
+	}
+
+	void deleteTextures()
+	{
+		for (auto& set : sets)
+			if (loader.isReady(set.textures))
+				unload(set);
+	}
+
+private:
+	struct MaterialSet
+	{
+		string name;
+		vector<pair<string, string>> files; // path, sampler name
+		vector<size_t> textures; // AssetLoader indices while requested
+		bool requested = false;
+		bool reported = false;
+		GLuint lastUse = 0;
+		std::chrono::high_resolution_clock::time_point start;
+	};
+
+	AssetLoader& loader;
+	vector<MaterialSet> sets;
+	GLuint useCount;
+
+	size_t residentBytes(const MaterialSet& set) const
+	{
+		size_t bytes = 0;
+		for (auto texture : set.textures)
+			bytes += loader.textureBytes(texture);
+		return bytes;
+	}
+
+	void unload(MaterialSet& set)
+	{
+		for (auto texture : set.textures)
+			loader.deleteTexture(texture);
+		set.textures.clear();
+		set.requested = false;
+	}
+};
@@ -3,9 +3,12 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <vector>
 #include <string>
+#include <cmath>
 
 #include "shader.h"
 
@@ -20,6 +23,53 @@ struct Vertex
 	glm::vec3 Bitangent;
 };
 
+// GPU vertex layouts, Compact needs shaders built with COMPACT_VERTEX
+enum class VertexFormat { Full, Compact };
+
+// 24 bytes instead of 56: the tangent frame as one quaternion (QTangent) and half precision UVs
+struct CompactVertex
+{
+	glm::vec3 Position;
+	GLshort QTangent[4]; // snorm16 x, y, z, w of the rotation to (T, B, N), w < 0 flips the bitangent
+	GLushort TexCoords[2]; // half floats
+};
+static_assert(sizeof(CompactVertex) == 24, "CompactVertex must stay tightly packed");
+
+inline CompactVertex compressVertex(const Vertex& vertex)
+{
+	CompactVertex compact;
+	compact.Position = vertex.Position;
+	compact.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+	compact.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+
+	// orthonormal frame, with any tangent when the mesh has none
+	glm::vec3 N = glm::length(vertex.Normal) > 0.0f ? glm::normalize(vertex.Normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+	glm::vec3 T = vertex.Tangent - N * glm::dot(N, vertex.Tangent);
+	if (glm::length(T) < 1e-6f)
+		T = glm::cross(N, std::abs(N.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+	T = glm::normalize(T);
+	glm::vec3 B = glm::cross(N, T);
+	bool flipped = glm::dot(B, vertex.Bitangent) < 0.0f;
+
+	glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(T, B, N)));
+	if (q.w < 0.0f)
+		q = -q;
+	// keep w away from zero so its sign survives quantization
+	const float bias = 1.0f / 32767.0f;
+	if (q.w < bias)
+	{
+		float scale = std::sqrt(1.0f - bias * bias);
+		q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+	}
+	if (flipped)
+		q = -q;
+
+	const float components[4] = { q.x, q.y, q.z, q.w };
+	for (int i = 0; i < 4; i++)
+		compact.QTangent[i] = (GLshort)std::round(glm::clamp(components[i], -1.0f, 1.0f) * 32767.0f);
+	return compact;
+}
+
 struct Texture
 {
 	GLuint id; // texture unit id
@@ -30,26 +80,42 @@ struct Texture
 class Mesh
 {
 public:
-	vector<Vertex> vertices;
-	vector<GLuint> indices;
+	GLsizei numIndices;
 	vector<Texture> textures;
 	vector<glm::vec3> materialComponent;
 	GLfloat shininess;
 	// render data
 	GLuint VAO, VBO, EBO;
 
-	Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures, vector<glm::vec3> materialComponent,
-		GLfloat shininess = 32.0f)
-		: vertices(vertices), indices(indices), textures(textures), materialComponent(materialComponent), shininess(shininess)
+	VertexFormat format;
+
+	// vertices and indices are only read while the buffers are created
+	Mesh(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, vector<Texture> textures,
+		vector<glm::vec3> materialComponent, GLfloat shininess = 32.0f, VertexFormat format = VertexFormat::Full)
+		: numIndices((GLsizei)numIndices), textures(textures), materialComponent(materialComponent), shininess(shininess), format(format)
 	{
-		setupMesh();
+		setupMesh(vertices, numVertices, indices);
 	}
 	void draw(Shader& shader);
+	// replace the vertex buffer contents, converted to the mesh's format
+	void setVertices(const Vertex* vertices, size_t numVertices);
+	// bytes of the vertex buffer
+	size_t vertexBytes() const
+	{
+		return numVertices * (format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex));
+	}
 private:
-	void setupMesh();
+	size_t numVertices = 0;
+
+	// sampler uniforms of the textures, resolved for the last program drawn with
+	GLuint samplerProgram = 0;
+	vector<Uniform> samplerUniforms;
+
+	void setupMesh(const Vertex* vertices, size_t numVertices, const GLuint* indices);
+	void bindSamplers(const Shader& shader);
 };
 
-void Mesh::setupMesh()
+void Mesh::setupMesh(const Vertex* vertices, size_t numVertices, const GLuint* indices)
 {
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
@@ -57,11 +123,23 @@ void Mesh::setupMesh()
 
 	glBindVertexArray(VAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	setVertices(vertices, numVertices);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * numIndices, indices, GL_STATIC_DRAW);
+
+	if (format == VertexFormat::Compact)
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)0);
+		// tangent frame, decoded in the vertex shader
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, QTangent));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords));
+		glBindVertexArray(0);
+		return;
+	}
 
 	// vertex position
 	glEnableVertexAttribArray(0);
@@ -86,16 +164,32 @@ void Mesh::setupMesh()
 	glBindVertexArray(0);
 }
 
-void Mesh::draw(Shader& shader)
+void Mesh::setVertices(const Vertex* vertices, size_t numVertices)
 {
-	// bind appropriate textures
+	this->numVertices = numVertices;
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	if (format == VertexFormat::Compact)
+	{
+		vector<CompactVertex> compact(numVertices);
+		for (size_t i = 0; i < numVertices; i++)
+			compact[i] = compressVertex(vertices[i]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex) * numVertices, compact.data(), GL_STATIC_DRAW);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * numVertices, vertices, GL_STATIC_DRAW);
+}
+
+void Mesh::bindSamplers(const Shader& shader)
+{
+	samplerProgram = shader.ID;
+	samplerUniforms.clear();
+
 	unsigned int diffuseNr = 1;
 	unsigned int specularNr = 1;
 	unsigned int normalNr = 1;
 	unsigned int heightNr = 1;
 	for (unsigned int i = 0; i < textures.size(); i++)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 		// retrieve texture number (the N in diffuse_textureN)
 		string number;
 		string name = textures[i].type;
@@ -107,16 +201,27 @@ void Mesh::draw(Shader& shader)
 			number = std::to_string(normalNr++); // transfer unsigned int to stream
 		else if (name == "texture_height")
 			number = std::to_string(heightNr++); // transfer unsigned int to stream
+		samplerUniforms.push_back(shader.uniform(name + number));
+	}
+}
 
+void Mesh::draw(Shader& shader)
+{
+	// bind appropriate textures
+	if (samplerProgram != shader.ID)
+		bindSamplers(shader);
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 		// now set the sampler to the correct texture unit
-		glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+		samplerUniforms[i].set((GLint)i);
 		// and finally bind the texture
 		glBindTexture(GL_TEXTURE_2D, textures[i].id);
 	}
 
 	// draw mesh
 	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
 	glBindVertexArray(0);
 
 	// set back to default
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "modelData.h"
+#include "mappedFile.h"
+
+// On-disk cache of imported models, so warm starts skip assimp.
+// A cache file holds the vertices, indices, bounding boxes and materials of every mesh;
+// it is memory mapped on load and the meshes point straight into the mapping.
+// Entries are rejected when the source file's size or time changed, or when the
+// format version or the Vertex layout differ from the ones that wrote them.
+class MeshCache
+{
+public:
+	std::string directory = "meshCache";
+	bool enabled = true;
+
+	// the cache shared by all models
+	static MeshCache& instance()
+	{
+		static MeshCache cache;
+		return cache;
+	}
+
+	// fill data from the cache entry of a model file, false when there is no valid entry
+	bool load(const std::string& sourcePath, ModelData& data)
+	{
+		if (!enabled)
+			return false;
+		auto file = std::make_shared<MappedFile>();
+		if (!file->open(path(sourcePath)) || file->size() < sizeof(Header))
+			return false;
+
+		auto bytes = file->data();
+		Header header;
+		memcpy(&header, bytes, sizeof(header));
+		Source source;
+		if (memcmp(header.magic, "LTMC", 4) != 0 || header.version != VERSION || header.vertexSize != sizeof(Vertex)
+			|| !getSource(sourcePath, source) || header.sourceSize != source.size || header.sourceTime != source.time)
+			return false;
+
+		size_t recordsEnd = sizeof(Header) + header.numMeshes * sizeof(MeshRecord);
+		if (file->size() < recordsEnd + header.stringBytes)
+			return false;
+		auto records = (const MeshRecord*)(bytes + sizeof(Header));
+		auto strings = (const char*)(bytes + recordsEnd);
+		auto stringsEnd = strings + header.stringBytes;
+		auto nextString = [&strings, stringsEnd]()
+		{
+			auto length = strnlen(strings, stringsEnd - strings);
+			std::string value(strings, length);
+			strings = std::min(strings + length + 1, stringsEnd);
+			return value;
+		};
+		if (nextString() != sourcePath)
+			return false; // another file with the same hash
+
+		ModelData result;
+		result.directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+		for (uint32_t i = 0; i < header.numMeshes; i++)
+		{
+			auto& record = records[i];
+			if (record.vertexOffset + record.numVertices * sizeof(Vertex) > file->size()
+				|| record.indexOffset + record.numIndices * sizeof(GLuint) > file->size() || record.numMaterialComponents > 3)
+				return false;
+
+			MeshData mesh;
+			mesh.vertices = (const Vertex*)(bytes + record.vertexOffset);
+			mesh.indices = (const GLuint*)(bytes + record.indexOffset);
+			mesh.numVertices = (size_t)record.numVertices;
+			mesh.numIndices = (size_t)record.numIndices;
+			mesh.storage = file;
+			mesh.shininess = record.shininess;
+			for (uint32_t c = 0; c < record.numMaterialComponents; c++)
+				mesh.materialComponent.push_back(glm::vec3(record.materialComponent[c][0], record.materialComponent[c][1], record.materialComponent[c][2]));
+			for (uint32_t t = 0; t < record.numTextures; t++)
+			{
+				auto name = nextString();
+				auto type = nextString();
+				mesh.textureFiles.push_back({ name, type });
+			}
+			result.meshes.push_back(mesh);
+			result.boxes.push_back({ glm::vec3(record.boxMin[0], record.boxMin[1], record.boxMin[2]),
+				glm::vec3(record.boxMax[0], record.boxMax[1], record.boxMax[2]) });
+		}
+		data = result;
+		return true;
+	}
+
+	// write the cache entry of a model that was just imported
+	void save(const std::string& sourcePath, const ModelData& data)
+	{
+		Source source;
+		if (!enabled || !getSource(sourcePath, source))
+			return;
+
+		std::string strings = sourcePath + '\0';
+		std::vector<MeshRecord> records(data.meshes.size());
+		for (size_t i = 0; i < data.meshes.size(); i++)
+		{
+			auto& mesh = data.meshes[i];
+			auto& record = records[i];
+			memset(&record, 0, sizeof(record));
+			record.numVertices = mesh.numVertices;
+			record.numIndices = mesh.numIndices;
+			for (int c = 0; c < 3; c++)
+			{
+				record.boxMin[c] = data.boxes[i].first[c];
+				record.boxMax[c] = data.boxes[i].second[c];
+			}
+			record.shininess = mesh.shininess;
+			record.numMaterialComponents = (uint32_t)std::min<size_t>(mesh.materialComponent.size(), 3);
+			for (uint32_t c = 0; c < record.numMaterialComponents; c++)
+				for (int k = 0; k < 3; k++)
+					record.materialComponent[c][k] = mesh.materialComponent[c][k];
+			record.numTextures = (uint32_t)mesh.textureFiles.size();
+			for (auto& texture : mesh.textureFiles)
+				strings += texture.first + '\0' + texture.second + '\0';
+		}
+
+		// vertex and index arrays after the strings, 16-byte aligned
+		uint64_t offset = sizeof(Header) + records.size() * sizeof(MeshRecord) + strings.size();
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			offset = align(offset);
+			records[i].vertexOffset = offset;
+			offset += records[i].numVertices * sizeof(Vertex);
+			offset = align(offset);
+			records[i].indexOffset = offset;
+			offset += records[i].numIndices * sizeof(GLuint);
+		}
+
+		Header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "LTMC", 4);
+		header.version = VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.numMeshes = (uint32_t)records.size();
+		header.sourceSize = source.size;
+		header.sourceTime = source.time;
+		header.stringBytes = strings.size();
+
+		createDirectory();
+		std::ofstream file(path(sourcePath), std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Fail to write mesh cache to " << path(sourcePath) << std::endl;
+			return;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)records.data(), records.size() * sizeof(MeshRecord));
+		file.write(strings.data(), strings.size());
+		uint64_t position = sizeof(Header) + records.size() * sizeof(MeshRecord) + strings.size();
+		auto writeAt = [&file, &position](uint64_t offset, const void* data, size_t size)
+		{
+			static const char zeros[16] = {};
+			file.write(zeros, (size_t)(offset - position));
+			file.write((const char*)data, size);
+			position = offset + size;
+		};
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			writeAt(records[i].vertexOffset, data.meshes[i].vertices, data.meshes[i].numVertices * sizeof(Vertex));
+			writeAt(records[i].indexOffset, data.meshes[i].indices, data.meshes[i].numIndices * sizeof(GLuint));
+		}
+	}
+
+private:
+	// bump when the file layout or the meaning of Vertex changes
+	static const uint32_t VERSION = 1;
+
+	struct Header
+	{
+		char magic[4]; // "LTMC"
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t numMeshes;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t stringBytes; // source path, then file name and type of each texture, NUL separated
+	};
+
+	struct MeshRecord
+	{
+		uint64_t vertexOffset, numVertices;
+		uint64_t indexOffset, numIndices;
+		float boxMin[3], boxMax[3];
+		float shininess;
+		uint32_t numMaterialComponents; // ambient, diffuse, specular
+		float materialComponent[3][3];
+		uint32_t numTextures;
+	};
+
+	struct Source
+	{
+		uint64_t size;
+		int64_t time;
+	};
+
+	static bool getSource(const std::string& sourcePath, Source& source)
+	{
+		struct stat info;
+		if (stat(sourcePath.c_str(), &info) != 0)
+			return false;
+		source.size = (uint64_t)info.st_size;
+		source.time = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 15) & ~(uint64_t)15;
+	}
+
+	// 64-bit FNV-1a hash of the model path, as hex
+	std::string path(const std::string& sourcePath) const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : sourcePath)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+		return directory + "/" + name + ".mesh";
+	}
+
+	void createDirectory() const
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+};
@@ -16,6 +16,8 @@
 #include <cmath>
 
 #include "mesh.h"
+#include "modelData.h"
+#include "meshCache.h"
 #include "boundingBox.h"
 
 using namespace std;
@@ -25,10 +27,19 @@ class Model
 public:
 	vector<Mesh> meshes;
 
-	Model(const char* path)
+	Model(const char* path) : Model(import(path))
 	{
-		loadModel(path);
 	}
+	// create the GL objects of a model imported earlier
+	explicit Model(const ModelData& data, VertexFormat format = VertexFormat::Full);
+
+	// map the cached mesh data of the file, or read and process it with assimp and cache it.
+	// Does not touch OpenGL
+	static ModelData import(const string& path);
+
+	// the texture of textures loaded from file, or nullptr; loadTexture reuses it
+	static const Texture* findTexture(const vector<Texture>& textures, const string& file);
+
 	void draw(Shader& shader)
 	{
 		for (int i = 0; i < meshes.size(); i++)
@@ -67,14 +78,31 @@ private:
 	vector<boundingBox> boxes;
 	boundingBox modelBox;
 
-	void loadModel(string path);
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+	static void processNode(aiNode* node, const aiScene* scene, ModelData& data);
+	static MeshData processMesh(aiMesh* mesh, const aiScene* scene);
+	static void getMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, MeshData& data);
+	Texture loadTexture(const string& file, const string& typeName);
 };
 
-void Model::loadModel(string path)
+Model::Model(const ModelData& data, VertexFormat format) : directory(data.directory)
+{
+	for (auto& box : data.boxes)
+		boxes.push_back(boundingBox(box.first, box.second));
+	for (auto& mesh : data.meshes)
+	{
+		vector<Texture> textures;
+		for (auto& file : mesh.textureFiles)
+			textures.push_back(loadTexture(file.first, file.second));
+		meshes.push_back(Mesh(mesh.vertices, mesh.numVertices, mesh.indices, mesh.numIndices, textures, mesh.materialComponent, mesh.shininess, format));
+	}
+}
+
+ModelData Model::import(const string& path)
 {
+	ModelData data;
+	if (MeshCache::instance().load(path, data))
+		return data;
+
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path,
 		aiProcess_Triangulate |
@@ -85,14 +113,16 @@ void Model::loadModel(string path)
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
 		cout << "Error assimp: " << importer.GetErrorString() << endl;
-		return;
+		return data;
 	}
-	directory = path.substr(0, path.find_last_of('/'));
+	data.directory = path.substr(0, path.find_last_of('/'));
 
-	processNode(scene->mRootNode, scene);
+	processNode(scene->mRootNode, scene, data);
+	MeshCache::instance().save(path, data);
+	return data;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, ModelData& data)
 {
 	// process all the meshes in node
 	for (int i = 0; i < node->mNumMeshes; i++)
@@ -103,29 +133,36 @@ void Model::processNode(aiNode* node, const aiScene* scene)
 		glm::vec3 minPos = glm::vec3(mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z);
 		glm::vec3 maxPos = glm::vec3(mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z);
 
-		boxes.push_back(boundingBox(minPos, maxPos));
-		meshes.push_back(processMesh(mesh, scene));
+		data.boxes.push_back({ minPos, maxPos });
+		data.meshes.push_back(processMesh(mesh, scene));
 	}
 	// process node's children
 	for (int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, data);
 	}
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+MeshData Model::processMesh(aiMesh* mesh, const aiScene* scene)
 {
 	// mesh data
-	vector<Vertex> vertices;
-	vector<GLuint> indices;
-	vector<Texture> textures;
-	vector<glm::vec3> materialComponent;
-	GLfloat shininess;
+	MeshData data;
+	struct Buffers
+	{
+		vector<Vertex> vertices;
+		vector<GLuint> indices;
+	};
+	auto buffers = make_shared<Buffers>();
+	auto& vertices = buffers->vertices;
+	auto& indices = buffers->indices;
+	auto& materialComponent = data.materialComponent;
+	auto& shininess = data.shininess;
 
 	// process Vertex
+	vertices.resize(mesh->mNumVertices);
 	for (int i = 0; i < mesh->mNumVertices; i++)
 	{
-		Vertex vertex;
+		Vertex& vertex = vertices[i];
 		// process position
 		glm::vec3 vector;
 		vector.x = mesh->mVertices[i].x;
@@ -166,11 +203,10 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		vector.y = mesh->mBitangents[i].y;
 		vector.z = mesh->mBitangents[i].z;
 		vertex.Bitangent = vector;
-
-		vertices.push_back(vertex);
 	}
 
 	// process indices: mesh -> face -> indices
+	indices.reserve(mesh->mNumFaces * 3);
 	for (int i = 0; i < mesh->mNumFaces; i++)
 	{
 		aiFace face = mesh->mFaces[i];
@@ -185,11 +221,9 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	{
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 		// get diffuse textures
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+		getMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data);
 		// get specular textures
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+		getMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data);
 		// get shininess
 		material->Get(AI_MATKEY_SHININESS, shininess);
 		// get ambient
@@ -210,7 +244,12 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 			cout << "Cannot load specular component\n";
 	}
 
-	return Mesh(vertices, indices, textures, materialComponent, shininess);
+	data.vertices = vertices.data();
+	data.numVertices = vertices.size();
+	data.indices = indices.data();
+	data.numIndices = indices.size();
+	data.storage = buffers;
+	return data;
 }
 
 // get and bind all the textures
@@ -258,32 +297,34 @@ GLuint TextureFromFile(const char* path, const string& directory)
 	return textureID;
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+void Model::getMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, MeshData& data)
 {
-	vector<Texture> textures;
 	for (int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory);
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);
-		}
+		data.textureFiles.push_back({ str.C_Str(), typeName });
 	}
-	return textures;
+}
+
+const Texture* Model::findTexture(const vector<Texture>& textures, const string& file)
+{
+	for (auto& texture : textures)
+	{
+		if (texture.path == file)
+			return &texture;
+	}
+	return nullptr;
+}
+
+Texture Model::loadTexture(const string& file, const string& typeName)
+{
+	if (auto loaded = findTexture(textures_loaded, file))
+		return *loaded;
+	Texture texture;
+	texture.id = TextureFromFile(file.c_str(), directory);
+	texture.type = typeName;
+	texture.path = file;
+	textures_loaded.push_back(texture);
+	return texture;
 }
\ No newline at end of file
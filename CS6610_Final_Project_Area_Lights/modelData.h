@@ -0,0 +1,34 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "mesh.h"
+
+using namespace std;
+
+// CPU side of a mesh, no OpenGL objects yet.
+// vertices and indices point into storage: vectors filled by assimp, or a mapped mesh cache file
+struct MeshData
+{
+	const Vertex* vertices = nullptr;
+	const GLuint* indices = nullptr;
+	size_t numVertices = 0;
+	size_t numIndices = 0;
+	shared_ptr<const void> storage;
+	vector<pair<string, string>> textureFiles; // file name, type (texture_diffuse, ...)
+	vector<glm::vec3> materialComponent;
+	GLfloat shininess = 32.0f;
+};
+
+// imported model file, can be produced on any thread and turned into a Model on the GL thread
+struct ModelData
+{
+	string directory; // model data directory
+	vector<MeshData> meshes;
+	vector<pair<glm::vec3, glm::vec3>> boxes; // min and max of each mesh
+};
@@ -2,7 +2,7 @@
 
 out vec4 fragColor;
 
-uniform vec3 lightColor;
+in vec3 lightColor;
 
 void main()
 {
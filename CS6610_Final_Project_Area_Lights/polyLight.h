@@ -1,10 +1,13 @@
-﻿#include <glad/glad.h>
+﻿#pragma once
+
+#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
-#include <Eigen/Dense>
 #include <vector>
 
+#include "ltcBatch.h"
+
 using namespace glm;
 
 enum class LightType
@@ -15,6 +18,16 @@ enum class LightType
 	Sphere
 };
 
+// Conservative volume of the region a light can visibly affect, used for light culling.
+// Every shape is bounded by a capsule (a sphere when both segment ends meet) and an ellipsoid.
+struct LightBounds
+{
+	vec3 segment[2]; // capsule segment
+	GLfloat radius; // capsule radius
+	vec3 center;
+	vec3 axes[3]; // ellipsoid semi-axes
+};
+
 // TODO: create setDefault method for all light types
 class AreaLight
 {
@@ -24,11 +37,57 @@ public:
 	vec3 center;
 	GLfloat intensity;
 	vector<vec3> points; // key variable pass to the shader
+	GLuint version; // incremented by update() whenever a parameter changed
 
-	AreaLight(LightType type, vec3 color, vec3 center, GLfloat intensity) : type(type), color(color), center(center), intensity(intensity) { }
+	AreaLight(LightType type, vec3 color, vec3 center, GLfloat intensity) : type(type), color(color), center(center), intensity(intensity), version(0) { }
 	virtual void updatePoints() = 0;
 	virtual void draw() { };
 
+	// Call after changing the light. Recomputes the points only when a shape parameter changed
+	// since the last call, and counts any change in version so that data derived from the light
+	// can be cached. Returns whether anything changed.
+	bool update()
+	{
+		parameters.clear();
+		getShape(parameters);
+		auto shapeChanged = version == 0 || parameters != shape;
+		if (!shapeChanged && color == lastColor && intensity == lastIntensity)
+			return false;
+		if (shapeChanged)
+		{
+			updatePoints();
+			shape.swap(parameters);
+		}
+		lastColor = color;
+		lastIntensity = intensity;
+		version++;
+		return true;
+	}
+
+	// emitting area seen from the front, used to estimate how far the light reaches
+	virtual GLfloat getArea() const = 0;
+	// light shape grown by the influence range
+	virtual LightBounds getBounds(GLfloat range) const = 0;
+
+	// bounds of a sphere, for the light shapes and anything else packed into a LightBuffer
+	static LightBounds sphereBounds(vec3 center, GLfloat radius)
+	{
+		return LightBounds{ { center, center }, radius, center, { vec3(radius, 0.0f, 0.0f), vec3(0.0f, radius, 0.0f), vec3(0.0f, 0.0f, radius) } };
+	}
+
+protected:
+	// the parameters the points are derived from
+	virtual void getShape(vector<GLfloat>& shape) const = 0;
+
+	static void append(vector<GLfloat>& shape, vec3 v)
+	{
+		shape.insert(shape.end(), { v.x, v.y, v.z });
+	}
+
+private:
+	vector<GLfloat> shape, parameters; // shape at the last update, and scratch space to compare with it
+	vec3 lastColor;
+	GLfloat lastIntensity;
 };
 
 // rectangle and disk light have same properties, so I combind them
@@ -43,7 +102,17 @@ public:
 	RectDiskLight(LightType type, vec3 color, vec3 center, GLfloat intensity, vec3 dirX, vec3 dirY, GLfloat halfX, GLfloat halfY)
 		: dirX(dirX), dirY(dirY), halfX(halfX), halfY(halfY), AreaLight(type, color, center, intensity)
 	{
-		updatePoints();
+		update();
+	}
+
+	GLfloat getArea() const
+	{
+		return type == LightType::Disk ? 3.14159265f * halfX * halfY : 4.0f * halfX * halfY;
+	}
+
+	LightBounds getBounds(GLfloat range) const
+	{
+		return sphereBounds(center, sqrt(halfX * halfX + halfY * halfY) + range);
 	}
 
 	// Call after each change of light shape
@@ -58,6 +127,15 @@ public:
 		points.push_back(center + ex + ey);
 		points.push_back(center - ex + ey);
 	}
+
+protected:
+	void getShape(vector<GLfloat>& shape) const
+	{
+		append(shape, center);
+		append(shape, dirX);
+		append(shape, dirY);
+		shape.insert(shape.end(), { halfX, halfY });
+	}
 };
 
 
@@ -71,7 +149,7 @@ public:
 	CylinderLight(vec3 color, vec3 center, GLfloat intensity, vec3 tangent, GLfloat length, GLfloat radius)
 		: tangent(tangent), length(length), radius(radius), AreaLight(LightType::Cylinder, color, center, intensity)
 	{
-		updatePoints();
+		update();
 	}
 
 	virtual void updatePoints()
@@ -80,6 +158,30 @@ public:
 		points.push_back(center - 0.5f * length * tangent);
 		points.push_back(center + 0.5f * length * tangent);
 	}
+
+	GLfloat getArea() const
+	{
+		return 2.0f * radius * length;
+	}
+
+	// capsule around the line, the ellipsoid is its bounding sphere
+	LightBounds getBounds(GLfloat range) const
+	{
+		auto bounds = sphereBounds(center, 0.5f * length + radius + range);
+		bounds.segment[0] = center - 0.5f * length * tangent;
+		bounds.segment[1] = center + 0.5f * length * tangent;
+		bounds.radius = radius + range;
+		return bounds;
+	}
+
+protected:
+	// the radius does not move the points, but it is part of the shape the light records describe
+	void getShape(vector<GLfloat>& shape) const
+	{
+		append(shape, center);
+		append(shape, tangent);
+		shape.insert(shape.end(), { length, radius });
+	}
 };
 
 inline void outputVec3(vec3 a)
@@ -106,83 +208,54 @@ public:
 	SphereLight(vec3 color, vec3 center, GLfloat intensity, vec3 dirX, vec3 dirY, vec3 dirZ, GLfloat lengthX, GLfloat lengthY, GLfloat lengthZ)
 		: dirX(dirX), dirY(dirY), dirZ(dirZ), lengthX(lengthX), lengthY(lengthY), lengthZ(lengthZ), AreaLight(LightType::Sphere, color, center, intensity)
 	{
-		updatePoints();
+		update();
+	}
+
+	GLfloat getArea() const
+	{
+		auto maxLength = std::max(lengthX, std::max(lengthY, lengthZ));
+		return 3.14159265f * maxLength * maxLength;
+	}
+
+	// growing every semi-axis by the range still contains the grown ellipsoid
+	LightBounds getBounds(GLfloat range) const
+	{
+		auto bounds = sphereBounds(center, std::max(lengthX, std::max(lengthY, lengthZ)) + range);
+		bounds.axes[0] = normalize(dirX) * (lengthX + range);
+		bounds.axes[1] = normalize(dirY) * (lengthY + range);
+		bounds.axes[2] = normalize(dirZ) * (lengthZ + range);
+		return bounds;
 	}
 
 	// Reference: Analytical calculation of the solid angle subtended by an arbitrarily positioned ellipsoid
-	// Be careful the method in the paper assumes the origin to be (0, 0, 0)
+	// The ellipse is computed as seen from the point on the floor below the center, see ltc::projectEllipsoids
 	virtual void updatePoints()
 	{
 		auto origin = glm::vec3(center.x, 0.0f, center.z);
-		auto local_center = center - origin;
-
-		auto A = mat3(normalize(dirX), normalize(dirY), normalize(dirZ));
-		auto diagonal = mat3(
-			lengthX, 0.0f, 0.0f,
-			0.0f, lengthY, 0.0f,
-			0.0f, 0.0f, lengthZ
-		);
-
-		// ellipsoid to sphere
-		auto M = A * diagonal * transpose(A);
-		auto Minv = inverse(M);
-		auto Pb = Minv * local_center;
-
-		// sphere to disk
-		auto theta = asin(1 / length(Pb));
-		auto Pc = cos(theta) * cos(theta) * Pb;
-		auto radius = tan(theta) * length(Pc);
-		vec3 C1, C2;
-		buildOrthonormalBasis(normalize(Pc), C1, C2);
-
-		// disk to ellipse
-		auto Pd = M * Pc;
-		auto D1_ = M * radius * C1;
-		auto D2_ = M * radius * C2;
-
-		// ellipse principal axes
-		Eigen::Matrix2f Q;
-		Q << dot(D1_, D1_), dot(D1_, D2_), dot(D1_, D2_), dot(D2_, D2_);
-		Eigen::SelfAdjointEigenSolver<Eigen::Matrix2f> eigensolver(Q);
-		if (eigensolver.info() != Eigen::Success) abort();
-		auto eigenvalues = eigensolver.eigenvalues();
-		auto eigenvectors = eigensolver.eigenvectors();
-		//cout << "Here is the matrix Q:\n" << Q << endl;
-		//cout << "The eigenvalues of Q are:\n" << eigenvalues << endl;
-		//cout << "Here's a matrix whose columns are eigenvectors of Q \n"
-		//	<< "corresponding to these eigenvalues:\n"
-		//	<< eigenvectors << endl;
-
-		auto D1 = eigenvectors(0, 0) * D1_ + eigenvectors(1, 0) * D2_;
-		auto D2 = eigenvectors(0, 1) * D1_ + eigenvectors(1, 1) * D2_;
-		D1 = normalize(D1);
-		D2 = normalize(D2);
-		auto d1 = sqrt(eigenvalues(0));
-		auto d2 = sqrt(eigenvalues(1));
+		float ex[3], ey[3];
+		ltc::Ellipsoids ellipsoid = { 1, { &center.x, &center.y, &center.z }, { &origin.x, &origin.y, &origin.z },
+			{ { &dirX.x, &dirX.y, &dirX.z }, { &dirY.x, &dirY.y, &dirY.z }, { &dirZ.x, &dirZ.y, &dirZ.z } },
+			{ &lengthX, &lengthY, &lengthZ } };
+		ltc::projectEllipsoids(ellipsoid, { { &ex[0], &ex[1], &ex[2] }, { &ey[0], &ey[1], &ey[2] } }, ltc::Backend::Scalar);
 
 		// update points
-		auto ex = D1 * d1;
-		auto ey = D2 * d2;
-
+		auto D1 = vec3(ex[0], ex[1], ex[2]);
+		auto D2 = vec3(ey[0], ey[1], ey[2]);
 		points.clear();
-		points.push_back(center - ex - ey);
-		points.push_back(center + ex - ey);
-		points.push_back(center + ex + ey);
-		points.push_back(center - ex + ey);
+		points.push_back(center - D1 - D2);
+		points.push_back(center + D1 - D2);
+		points.push_back(center + D1 + D2);
+		points.push_back(center - D1 + D2);
 	}
-private:
-	void buildOrthonormalBasis(const vec3 n, vec3& b1, vec3& b2)
+
+protected:
+	void getShape(vector<GLfloat>& shape) const
 	{
-		if (n.z < -0.9999999f)
-		{
-			b1 = vec3(0.0, -1.0, 0.0);
-			b2 = vec3(-1.0, 0.0, 0.0);
-			return;
-		}
-		float a = 1.0f / (1.0f + n.z);
-		float b = -n.x * n.y * a;
-		b1 = vec3(1.0f - n.x * n.x * a, b, -n.x);
-		b2 = vec3(b, 1.0f - n.y * n.y * a, -n.y);
+		append(shape, center);
+		append(shape, dirX);
+		append(shape, dirY);
+		append(shape, dirZ);
+		shape.insert(shape.end(), { lengthX, lengthY, lengthZ });
 	}
 };
 
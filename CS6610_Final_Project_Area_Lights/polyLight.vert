@@ -1,12 +1,17 @@
 ﻿#version 460 core
 
 layout (location = 0) in vec3 aPos;
+// per instance, see ProxyInstance in lightProxies.h
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec3 aColor;
+
+out vec3 lightColor;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	lightColor = aColor;
+	gl_Position = projection * view * aModel * vec4(aPos, 1.0);
 }
\ No newline at end of file
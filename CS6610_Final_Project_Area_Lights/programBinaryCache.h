@@ -0,0 +1,160 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of every stage's final source, including injected defines,
+// and the driver's vendor, renderer and version strings, so a driver update never
+// loads a stale binary. A binary the driver rejects is simply compiled again.
+class ProgramBinaryCache
+{
+public:
+	std::string directory = "shaderCache";
+	bool enabled = true;
+
+	// startup statistics
+	GLuint numLoaded = 0;
+	GLuint numCompiled = 0;
+	GLuint numRejected = 0;
+
+	// the cache shared by all Shader objects
+	static ProgramBinaryCache& instance()
+	{
+		static ProgramBinaryCache cache;
+		return cache;
+	}
+
+	// 64-bit FNV-1a hash of the sources and the driver identification, as hex
+	std::string makeKey(const std::vector<std::string>& sources)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const char* data, size_t size)
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= (unsigned char)data[i];
+				hash *= 1099511628211ull;
+			}
+			hash ^= 0xFF; // separator, so ("ab", "c") and ("a", "bc") differ
+			hash *= 1099511628211ull;
+		};
+		for (auto& source : sources)
+			add(source.data(), source.size());
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			auto value = (const char*)glGetString(name);
+			add(value ? value : "", value ? strlen(value) : 0);
+		}
+
+		char key[17];
+		snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+		return key;
+	}
+
+	// restore a linked program, false when there is no usable binary
+	bool load(GLuint program, const std::string& key)
+	{
+		if (!isSupported())
+			return false;
+		std::ifstream file(path(key), std::ios::binary);
+		if (!file)
+			return false;
+
+		uint32_t magic = 0;
+		GLenum format = 0;
+		file.read((char*)&magic, sizeof(magic));
+		file.read((char*)&format, sizeof(format));
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (magic != MAGIC || binary.empty())
+			return false;
+
+		glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			numRejected++;
+			return false;
+		}
+		numLoaded++;
+		return true;
+	}
+
+	// store the binary of a program that was just compiled and linked
+	void save(GLuint program, const std::string& key)
+	{
+		numCompiled++;
+		if (!isSupported())
+			return;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+		createDirectory();
+		std::ofstream file(path(key), std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Fail to write program binary to " << path(key) << std::endl;
+			return;
+		}
+		uint32_t magic = MAGIC;
+		file.write((const char*)&magic, sizeof(magic));
+		file.write((const char*)&format, sizeof(format));
+		file.write(binary.data(), binary.size());
+	}
+
+	void report() const
+	{
+		std::cout << "Programs: " << numLoaded << " loaded from cache, " << numCompiled << " compiled";
+		if (numRejected > 0)
+			std::cout << " (" << numRejected << " cached binaries rejected by the driver)";
+		std::cout << std::endl;
+	}
+
+private:
+	static const uint32_t MAGIC = 0x4250544C; // "LTPB"
+	GLint numFormats = -1;
+
+	bool isSupported()
+	{
+		if (!enabled)
+			return false;
+		if (numFormats < 0)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		return numFormats > 0;
+	}
+
+	std::string path(const std::string& key) const
+	{
+		return directory + "/" + key + ".bin";
+	}
+
+	void createDirectory() const
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+};
@@ -9,6 +9,144 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <cstring>
+
+#include "programBinaryCache.h"
+
+// preprocessor definitions injected into every stage of a program, name -> value.
+// Ordered, so equal sets always produce the same source and cache key.
+typedef std::map<std::string, std::string> ShaderDefines;
+
+// one active uniform (or uniform array element) of a linked program,
+// with the last value written to it
+struct UniformSlot
+{
+	GLint location;
+	GLenum type;
+	GLint arraySize; // elements from this one to the end of the array
+	bool cached;
+	GLuint value[16]; // raw bits, up to a mat4
+};
+
+// all active uniforms of a program, reflected once after linking
+struct UniformTable
+{
+	std::vector<UniformSlot> slots;
+	std::unordered_map<std::string, GLint> indices; // name -> slot
+};
+
+// prebound handle to a uniform: sets the value without any name lookup,
+// and skips the GL call when the value did not change.
+// Values are written with glProgramUniform*, so the program does not need to be bound.
+// A handle to a uniform that is not active in the program does nothing.
+class Uniform
+{
+public:
+	Uniform() : program(0), slot(nullptr) {}
+	Uniform(GLuint program, UniformSlot* slot) : program(program), slot(slot) {}
+
+	bool valid() const
+	{
+		return slot != nullptr;
+	}
+
+	// element i of an array uniform
+	Uniform operator[](GLint i) const
+	{
+		return slot && i >= 0 && i < slot->arraySize ? Uniform(program, slot + i) : Uniform();
+	}
+
+	void set(bool value)
+	{
+		GLint v = value;
+		if (changed(&v, sizeof(v)))
+			glProgramUniform1i(program, slot->location, v);
+	}
+	void set(GLint value)
+	{
+		if (changed(&value, sizeof(value)))
+			glProgramUniform1i(program, slot->location, value);
+	}
+	void set(GLuint value)
+	{
+		set((GLint)value);
+	}
+	void set(GLfloat value)
+	{
+		if (changed(&value, sizeof(value)))
+			glProgramUniform1f(program, slot->location, value);
+	}
+	void set(const glm::ivec2& value)
+	{
+		if (changed(glm::value_ptr(value), sizeof(value)))
+			glProgramUniform2iv(program, slot->location, 1, glm::value_ptr(value));
+	}
+	void set(const glm::vec2& value)
+	{
+		if (changed(glm::value_ptr(value), sizeof(value)))
+			glProgramUniform2fv(program, slot->location, 1, glm::value_ptr(value));
+	}
+	void set(const glm::vec3& value)
+	{
+		if (changed(glm::value_ptr(value), sizeof(value)))
+			glProgramUniform3fv(program, slot->location, 1, glm::value_ptr(value));
+	}
+	void set(const glm::vec4& value)
+	{
+		if (changed(glm::value_ptr(value), sizeof(value)))
+			glProgramUniform4fv(program, slot->location, 1, glm::value_ptr(value));
+	}
+	void set(const glm::mat4& value)
+	{
+		if (changed(glm::value_ptr(value), sizeof(value)))
+			glProgramUniformMatrix4fv(program, slot->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+private:
+	GLuint program;
+	UniformSlot* slot;
+
+	// compare against the cached value and remember the new one
+	bool changed(const void* value, size_t size)
+	{
+		if (!slot)
+			return false;
+		if (slot->cached && memcmp(slot->value, value, size) == 0)
+			return false;
+		memcpy(slot->value, value, size);
+		slot->cached = true;
+		return true;
+	}
+};
+
+// source text without the UTF-8 byte order mark some editors add, Mesa rejects it
+inline const char* skipBOM(const std::string& code)
+{
+	return code.compare(0, 3, "\xEF\xBB\xBF") == 0 ? code.c_str() + 3 : code.c_str();
+}
+
+// insert the definitions right after the #version line.
+// A #line directive keeps the compiler's line numbers matching the file.
+inline std::string injectDefines(const std::string& code, const ShaderDefines& defines)
+{
+	if (defines.empty())
+		return code;
+	auto version = code.find("#version");
+	auto lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return code;
+
+	std::string header;
+	for (auto& define : defines)
+		header += "#define " + define.first + " " + define.second + "\n";
+	header += "#line " + std::to_string(std::count(code.begin(), code.begin() + lineEnd, '\n') + 2) + "\n";
+	return code.substr(0, lineEnd + 1) + header + code.substr(lineEnd + 1);
+}
 
 class Shader
 {
@@ -17,7 +155,9 @@ public:
 
 	Shader() = default;
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
-		const char* tescPath = nullptr, const char* tesePath = nullptr);
+		const char* tescPath = nullptr, const char* tesePath = nullptr, const ShaderDefines& defines = ShaderDefines());
+	// compute shader program
+	explicit Shader(const char* computePath, const ShaderDefines& defines = ShaderDefines());
 
 	// use/active the shader
 	void use()
@@ -30,41 +170,143 @@ public:
 		glDeleteProgram(ID);
 	}
 
-	// utility uniform functions
+	// handle to an active uniform, "name" of an array is its first element.
+	// Look handles up once and keep them, the per-frame set calls are then free of string work.
+	Uniform uniform(const std::string& name) const
+	{
+		if (!uniforms)
+			return Uniform();
+		auto it = uniforms->indices.find(name);
+		if (it == uniforms->indices.end())
+			return Uniform();
+		return Uniform(ID, &uniforms->slots[it->second]);
+	}
+
+	// utility uniform functions, convenient for setup code (one hash lookup each)
 	void setBool(const std::string& name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		uniform(name).set(value);
 	}
 	void setFloat(const std::string& name, GLfloat value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		uniform(name).set(value);
 	}
 	void setInt(const std::string& name, GLuint value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		uniform(name).set(value);
 	}
 	void setMat4(const std::string& name, glm::mat4 value) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+		uniform(name).set(value);
 	}
 	void setVec3(const std::string& name, glm::vec3 value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+		uniform(name).set(value);
 	}
 	void setVec3(const std::string& name, GLfloat x, GLfloat y, GLfloat z)
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		uniform(name).set(glm::vec3(x, y, z));
 	}
 	void setVec2(const std::string& name, glm::vec2 value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+		uniform(name).set(value);
 	}
 	void setVec2(const std::string& name, GLfloat x, GLfloat y)
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		uniform(name).set(glm::vec2(x, y));
 	}
 
 private:
+	struct ShaderStage
+	{
+		GLenum type;
+		const char* name; // for error messages
+		std::string code;
+	};
+
+	// load the program from the binary cache, or compile and link the stages and cache the result
+	void build(const std::vector<ShaderStage>& stages)
+	{
+		auto& binaryCache = ProgramBinaryCache::instance();
+		std::vector<std::string> sources;
+		for (auto& stage : stages)
+			sources.push_back(std::to_string(stage.type) + "\n" + stage.code);
+		auto key = binaryCache.makeKey(sources);
+
+		ID = glCreateProgram();
+		if (!binaryCache.load(ID, key))
+		{
+			// start over from a clean program when a cached binary was rejected
+			glDeleteProgram(ID);
+			ID = glCreateProgram();
+
+			std::vector<GLuint> shaders;
+			for (auto& stage : stages)
+			{
+				const char* code = skipBOM(stage.code);
+				GLuint shader = glCreateShader(stage.type);
+				glShaderSource(shader, 1, &code, NULL);
+				glCompileShader(shader);
+				checkCompileErrors(shader, stage.name);
+				glAttachShader(ID, shader);
+				shaders.push_back(shader);
+			}
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			glLinkProgram(ID);
+			checkCompileErrors(ID, "PROGRAM");
+
+			GLint success;
+			glGetProgramiv(ID, GL_LINK_STATUS, &success);
+			if (success)
+				binaryCache.save(ID, key);
+
+			// delete shaders
+			for (auto shader : shaders)
+				glDeleteShader(shader);
+		}
+		reflectUniforms();
+	}
+
+	// shared by all copies of the shader, so cached values stay consistent
+	std::shared_ptr<UniformTable> uniforms;
+
+	// reflect every active uniform and array element of the linked program
+	void reflectUniforms()
+	{
+		uniforms = std::make_shared<UniformTable>();
+		GLint count = 0;
+		glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+		const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+		std::vector<GLchar> name;
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint values[4];
+			glGetProgramResourceiv(ID, GL_UNIFORM, i, 4, properties, 4, NULL, values);
+			// members of uniform blocks have no location
+			if (values[2] < 0)
+				continue;
+
+			name.resize(values[0]);
+			glGetProgramResourceName(ID, GL_UNIFORM, i, values[0], NULL, name.data());
+			std::string base(name.data());
+			GLint arraySize = values[3];
+			bool isArray = base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0;
+			if (isArray)
+				base.resize(base.size() - 3);
+
+			// array elements get consecutive slots and locations
+			GLint first = (GLint)uniforms->slots.size();
+			for (GLint element = 0; element < arraySize; element++)
+			{
+				uniforms->slots.push_back({ values[2] + element, (GLenum)values[1], arraySize - element, false, {} });
+				if (isArray)
+					uniforms->indices[base + "[" + std::to_string(element) + "]"] = first + element;
+			}
+			uniforms->indices[base] = first;
+		}
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
@@ -92,7 +334,8 @@ private:
 	}
 };
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const char* tescPath, const char* tesePath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const char* tescPath, const char* tesePath,
+	const ShaderDefines& defines)
 {
 	// retrieve source code from filePath
 	std::string vertexCode;
@@ -124,8 +367,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 		vShaderFile.close();
 		fShaderFile.close();
 		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+		vertexCode = injectDefines(vShaderStream.str(), defines);
+		fragmentCode = injectDefines(fShaderStream.str(), defines);
 		// if geometry shader path exists, load the geometry shader
 		if (geometryPath != nullptr)
 		{
@@ -133,7 +376,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 			std::stringstream gShaderStream;
 			gShaderStream << gShaderFile.rdbuf();
 			gShaderFile.close();
-			geometryCode = gShaderStream.str();
+			geometryCode = injectDefines(gShaderStream.str(), defines);
 		}
 		// if tessellation control shader path exists, load the tess shader
 		if (tescPath != nullptr)
@@ -142,7 +385,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 			std::stringstream cShaderStream;
 			cShaderStream << cShaderFile.rdbuf();
 			cShaderFile.close();
-			tescCode = cShaderStream.str();
+			tescCode = injectDefines(cShaderStream.str(), defines);
 		}
 		// if tessellation evalution shader path exists, load the tese shader
 		if (tesePath != nullptr)
@@ -151,80 +394,42 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 			std::stringstream eShaderStream;
 			eShaderStream << eShaderFile.rdbuf();
 			eShaderFile.close();
-			teseCode = eShaderStream.str();
+			teseCode = injectDefines(eShaderStream.str(), defines);
 		}
 	}
 	catch (std::ifstream::failure e)
 	{
 		std::cout << "Error: shader file not successfully read\n";
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
-
-	// compile shaders
-	GLuint vertex, fragment;
-
-	// vertex Shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	checkCompileErrors(vertex, "VERTEX");
-	// fragment Shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	checkCompileErrors(fragment, "FRAGMENT");
-	// geometry shader
-	GLuint geometry;
-	if (geometryPath != nullptr)
-	{
-		const char* gShaderCode = geometryCode.c_str();
-		geometry = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(geometry, 1, &gShaderCode, NULL);
-		glCompileShader(geometry);
-		checkCompileErrors(geometry, "GEOMETRY");
-	}
-	// tessellation control shader
-	GLuint tesc;
+	// stages in pipeline order
+	std::vector<ShaderStage> stages = { { GL_VERTEX_SHADER, "VERTEX", vertexCode } };
 	if (tescPath != nullptr)
+		stages.push_back({ GL_TESS_CONTROL_SHADER, "TESS_CONTROL", tescCode });
+	if (tesePath != nullptr)
+		stages.push_back({ GL_TESS_EVALUATION_SHADER, "TESS_EVALUTION", teseCode });
+	if (geometryPath != nullptr)
+		stages.push_back({ GL_GEOMETRY_SHADER, "GEOMETRY", geometryCode });
+	stages.push_back({ GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode });
+	build(stages);
+}
+
+Shader::Shader(const char* computePath, const ShaderDefines& defines)
+{
+	// retrieve source code from filePath
+	std::string computeCode;
+	std::ifstream cShaderFile;
+	cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try
 	{
-		const char* cShaderCode = tescCode.c_str();
-		tesc = glCreateShader(GL_TESS_CONTROL_SHADER);
-		glShaderSource(tesc, 1, &cShaderCode, NULL);
-		glCompileShader(tesc);
-		checkCompileErrors(tesc, "TESS_CONTROL");
+		cShaderFile.open(computePath);
+		std::stringstream cShaderStream;
+		cShaderStream << cShaderFile.rdbuf();
+		cShaderFile.close();
+		computeCode = injectDefines(cShaderStream.str(), defines);
 	}
-	// tessellation evalution shader
-	GLuint tese;
-	if (tesePath != nullptr)
+	catch (const std::ifstream::failure&)
 	{
-		const char* eShaderCode = teseCode.c_str();
-		tese = glCreateShader(GL_TESS_EVALUATION_SHADER);
-		glShaderSource(tese, 1, &eShaderCode, NULL);
-		glCompileShader(tese);
-		checkCompileErrors(tese, "TESS_EVALUTION");
+		std::cout << "Error: shader file not successfully read\n";
 	}
-
-	// shader Program
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	if (tescPath != nullptr)
-		glAttachShader(ID, tesc);
-	if (tesePath != nullptr)
-		glAttachShader(ID, tese);
-	if (geometryPath != nullptr)
-		glAttachShader(ID, geometry);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
-	checkCompileErrors(ID, "PROGRAM");
-
-	// delete shaders
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-	if (geometryPath != nullptr)
-		glDeleteShader(geometry);
-	if (tescPath != nullptr)
-		glDeleteShader(tesc);
-	if (tesePath != nullptr)
-		glDeleteShader(tese);
-}
\ No newline at end of file
+	build({ { GL_COMPUTE_SHADER, "COMPUTE", computeCode } });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "shader.h"
+
+// Compiled programs keyed by their source files and preprocessor definitions.
+// Each permutation is compiled the first time it is requested and shared afterwards,
+// so switching between variants costs a hash lookup instead of a compile.
+class ShaderCache
+{
+public:
+	Shader get(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+		const char* tescPath = nullptr, const char* tesePath = nullptr, const ShaderDefines& defines = ShaderDefines())
+	{
+		auto key = makeKey({ vertexPath, fragmentPath, geometryPath, tescPath, tesePath }, defines);
+		auto it = programs.find(key);
+		if (it == programs.end())
+			it = programs.emplace(key, Shader(vertexPath, fragmentPath, geometryPath, tescPath, tesePath, defines)).first;
+		return it->second;
+	}
+
+	Shader getCompute(const char* computePath, const ShaderDefines& defines = ShaderDefines())
+	{
+		auto key = makeKey({ computePath }, defines);
+		auto it = programs.find(key);
+		if (it == programs.end())
+			it = programs.emplace(key, Shader(computePath, defines)).first;
+		return it->second;
+	}
+
+	// number of compiled permutations
+	size_t size() const
+	{
+		return programs.size();
+	}
+
+	void deletePrograms()
+	{
+		for (auto& program : programs)
+			program.second.deleteProgram();
+		programs.clear();
+	}
+
+private:
+	std::unordered_map<std::string, Shader> programs;
+
+	static std::string makeKey(std::initializer_list<const char*> paths, const ShaderDefines& defines)
+	{
+		std::string key;
+		for (auto path : paths)
+			key += std::string(path ? path : "") + "|";
+		for (auto& define : defines)
+			key += define.first + "=" + define.second + ";";
+		return key;
+	}
+};
@@ -0,0 +1,363 @@
+#pragma once
+
+// --------------------------------------------------------------------------------
+// Thin SIMD wrappers used by the CPU LTC kernels (ltcBatch.h).
+// Every backend defines Float, Int and Mask lane types with the same set of
+// operations, so a kernel is written once as a template over simd::<backend>::ISA.
+// Backends are compiled in when the target supports them:
+//   scalar - always
+//   sse4   - __SSE4_1__ (or any x64 MSVC build)
+//   avx2   - __AVX2__ (/arch:AVX2 or -mavx2 -mfma)
+//   neon   - __ARM_NEON (AArch64)
+// --------------------------------------------------------------------------------
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE4_1__) || defined(__AVX2__) || (defined(_MSC_VER) && defined(_M_X64))
+#define SIMD_HAS_SSE4 1
+#include <immintrin.h>
+#endif
+#if defined(__AVX2__)
+#define SIMD_HAS_AVX2 1
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_HAS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace simd
+{
+	// --------------------------------------------------------------------------------
+	// scalar fallback
+	// --------------------------------------------------------------------------------
+	namespace scalar
+	{
+		struct Mask { bool v; };
+		struct Float
+		{
+			float v;
+			Float() = default;
+			Float(float x) : v(x) { }
+		};
+		struct Int
+		{
+			int32_t v;
+			Int() = default;
+			Int(int32_t x) : v(x) { }
+		};
+
+		inline Float operator+(Float a, Float b) { return a.v + b.v; }
+		inline Float operator-(Float a, Float b) { return a.v - b.v; }
+		inline Float operator*(Float a, Float b) { return a.v * b.v; }
+		inline Float operator/(Float a, Float b) { return a.v / b.v; }
+		inline Float operator-(Float a) { return -a.v; }
+		inline Mask operator<(Float a, Float b) { return { a.v < b.v }; }
+		inline Mask operator<=(Float a, Float b) { return { a.v <= b.v }; }
+		inline Mask operator>(Float a, Float b) { return { a.v > b.v }; }
+		inline Mask operator>=(Float a, Float b) { return { a.v >= b.v }; }
+		inline Mask operator==(Float a, Float b) { return { a.v == b.v }; }
+		inline Mask operator&(Mask a, Mask b) { return { a.v && b.v }; }
+		inline Mask operator|(Mask a, Mask b) { return { a.v || b.v }; }
+		inline Mask operator!(Mask a) { return { !a.v }; }
+		inline bool any(Mask a) { return a.v; }
+
+		inline Float select(Mask m, Float a, Float b) { return m.v ? a : b; }
+		// like minps / maxps, the second operand is returned when either is NaN
+		inline Float min(Float a, Float b) { return a.v < b.v ? a.v : b.v; }
+		inline Float max(Float a, Float b) { return a.v > b.v ? a.v : b.v; }
+		inline Float abs(Float a) { return std::fabs(a.v); }
+		inline Float sqrt(Float a) { return std::sqrt(a.v); }
+		inline Float floor(Float a) { return std::floor(a.v); }
+
+		inline Int operator+(Int a, Int b) { return a.v + b.v; }
+		inline Int operator*(Int a, Int b) { return a.v * b.v; }
+		inline Int min(Int a, Int b) { return std::min(a.v, b.v); }
+		inline Int toInt(Float a) { return (int32_t)a.v; }
+
+		inline Float load(const float* p) { return *p; }
+		inline void store(float* p, Float a) { *p = a.v; }
+		inline Float gather(const float* base, Int index) { return base[index.v]; }
+
+		struct ISA
+		{
+			typedef scalar::Float Float;
+			typedef scalar::Int Int;
+			typedef scalar::Mask Mask;
+			static const int width = 1;
+			static const char* name() { return "scalar"; }
+			static Float load(const float* p) { return scalar::load(p); }
+		};
+	}
+
+#ifdef SIMD_HAS_SSE4
+	// --------------------------------------------------------------------------------
+	// SSE4.1, 4 lanes
+	// --------------------------------------------------------------------------------
+	namespace sse4
+	{
+		struct Mask { __m128 v; };
+		struct Float
+		{
+			__m128 v;
+			Float() = default;
+			Float(__m128 x) : v(x) { }
+			Float(float x) : v(_mm_set1_ps(x)) { }
+		};
+		struct Int
+		{
+			__m128i v;
+			Int() = default;
+			Int(__m128i x) : v(x) { }
+			Int(int32_t x) : v(_mm_set1_epi32(x)) { }
+		};
+
+		inline Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+		inline Float operator-(Float a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+		inline Mask operator<(Float a, Float b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+		inline Mask operator<=(Float a, Float b) { return { _mm_cmple_ps(a.v, b.v) }; }
+		inline Mask operator>(Float a, Float b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+		inline Mask operator>=(Float a, Float b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+		inline Mask operator==(Float a, Float b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+		inline Mask operator&(Mask a, Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+		inline Mask operator|(Mask a, Mask b) { return { _mm_or_ps(a.v, b.v) }; }
+		inline Mask operator!(Mask a) { return { _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+		inline bool any(Mask a) { return _mm_movemask_ps(a.v) != 0; }
+
+		inline Float select(Mask m, Float a, Float b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+		inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+		inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+		inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+		inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+		inline Float floor(Float a) { return _mm_floor_ps(a.v); }
+
+		inline Int operator+(Int a, Int b) { return _mm_add_epi32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return _mm_mullo_epi32(a.v, b.v); }
+		inline Int min(Int a, Int b) { return _mm_min_epi32(a.v, b.v); }
+		inline Int toInt(Float a) { return _mm_cvttps_epi32(a.v); }
+
+		inline Float load(const float* p) { return _mm_loadu_ps(p); }
+		inline void store(float* p, Float a) { _mm_storeu_ps(p, a.v); }
+		inline Float gather(const float* base, Int index)
+		{
+			alignas(16) int32_t i[4];
+			_mm_store_si128((__m128i*)i, index.v);
+			return _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]);
+		}
+
+		struct ISA
+		{
+			typedef sse4::Float Float;
+			typedef sse4::Int Int;
+			typedef sse4::Mask Mask;
+			static const int width = 4;
+			static const char* name() { return "sse4"; }
+			static Float load(const float* p) { return sse4::load(p); }
+		};
+	}
+#endif
+
+#ifdef SIMD_HAS_AVX2
+	// --------------------------------------------------------------------------------
+	// AVX2 + FMA, 8 lanes
+	// --------------------------------------------------------------------------------
+	namespace avx2
+	{
+		struct Mask { __m256 v; };
+		struct Float
+		{
+			__m256 v;
+			Float() = default;
+			Float(__m256 x) : v(x) { }
+			Float(float x) : v(_mm256_set1_ps(x)) { }
+		};
+		struct Int
+		{
+			__m256i v;
+			Int() = default;
+			Int(__m256i x) : v(x) { }
+			Int(int32_t x) : v(_mm256_set1_epi32(x)) { }
+		};
+
+		inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+		inline Float operator-(Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+		inline Mask operator<(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+		inline Mask operator<=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+		inline Mask operator>(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+		inline Mask operator>=(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+		inline Mask operator==(Float a, Float b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+		inline Mask operator&(Mask a, Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+		inline Mask operator|(Mask a, Mask b) { return { _mm256_or_ps(a.v, b.v) }; }
+		inline Mask operator!(Mask a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+		inline bool any(Mask a) { return _mm256_movemask_ps(a.v) != 0; }
+
+		inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+		inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+		inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+		inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+		inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+		inline Float floor(Float a) { return _mm256_floor_ps(a.v); }
+
+		inline Int operator+(Int a, Int b) { return _mm256_add_epi32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return _mm256_mullo_epi32(a.v, b.v); }
+		inline Int min(Int a, Int b) { return _mm256_min_epi32(a.v, b.v); }
+		inline Int toInt(Float a) { return _mm256_cvttps_epi32(a.v); }
+
+		inline Float load(const float* p) { return _mm256_loadu_ps(p); }
+		inline void store(float* p, Float a) { _mm256_storeu_ps(p, a.v); }
+		inline Float gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index.v, 4); }
+
+		struct ISA
+		{
+			typedef avx2::Float Float;
+			typedef avx2::Int Int;
+			typedef avx2::Mask Mask;
+			static const int width = 8;
+			static const char* name() { return "avx2"; }
+			static Float load(const float* p) { return avx2::load(p); }
+		};
+	}
+#endif
+
+#ifdef SIMD_HAS_NEON
+	// --------------------------------------------------------------------------------
+	// NEON (AArch64), 4 lanes
+	// --------------------------------------------------------------------------------
+	namespace neon
+	{
+		struct Mask { uint32x4_t v; };
+		struct Float
+		{
+			float32x4_t v;
+			Float() = default;
+			Float(float32x4_t x) : v(x) { }
+			Float(float x) : v(vdupq_n_f32(x)) { }
+		};
+		struct Int
+		{
+			int32x4_t v;
+			Int() = default;
+			Int(int32x4_t x) : v(x) { }
+			Int(int32_t x) : v(vdupq_n_s32(x)) { }
+		};
+
+		inline Float operator+(Float a, Float b) { return vaddq_f32(a.v, b.v); }
+		inline Float operator-(Float a, Float b) { return vsubq_f32(a.v, b.v); }
+		inline Float operator*(Float a, Float b) { return vmulq_f32(a.v, b.v); }
+		inline Float operator/(Float a, Float b) { return vdivq_f32(a.v, b.v); }
+		inline Float operator-(Float a) { return vnegq_f32(a.v); }
+		inline Mask operator<(Float a, Float b) { return { vcltq_f32(a.v, b.v) }; }
+		inline Mask operator<=(Float a, Float b) { return { vcleq_f32(a.v, b.v) }; }
+		inline Mask operator>(Float a, Float b) { return { vcgtq_f32(a.v, b.v) }; }
+		inline Mask operator>=(Float a, Float b) { return { vcgeq_f32(a.v, b.v) }; }
+		inline Mask operator==(Float a, Float b) { return { vceqq_f32(a.v, b.v) }; }
+		inline Mask operator&(Mask a, Mask b) { return { vandq_u32(a.v, b.v) }; }
+		inline Mask operator|(Mask a, Mask b) { return { vorrq_u32(a.v, b.v) }; }
+		inline Mask operator!(Mask a) { return { vmvnq_u32(a.v) }; }
+		inline bool any(Mask a) { return vmaxvq_u32(a.v) != 0; }
+
+		inline Float select(Mask m, Float a, Float b) { return vbslq_f32(m.v, a.v, b.v); }
+		// the NaN-ignoring variants, to match minps / maxps when the second operand is a number
+		inline Float min(Float a, Float b) { return vminnmq_f32(a.v, b.v); }
+		inline Float max(Float a, Float b) { return vmaxnmq_f32(a.v, b.v); }
+		inline Float abs(Float a) { return vabsq_f32(a.v); }
+		inline Float sqrt(Float a) { return vsqrtq_f32(a.v); }
+		inline Float floor(Float a) { return vrndmq_f32(a.v); }
+
+		inline Int operator+(Int a, Int b) { return vaddq_s32(a.v, b.v); }
+		inline Int operator*(Int a, Int b) { return vmulq_s32(a.v, b.v); }
+		inline Int min(Int a, Int b) { return vminq_s32(a.v, b.v); }
+		inline Int toInt(Float a) { return vcvtq_s32_f32(a.v); }
+
+		inline Float load(const float* p) { return vld1q_f32(p); }
+		inline void store(float* p, Float a) { vst1q_f32(p, a.v); }
+		inline Float gather(const float* base, Int index)
+		{
+			int32_t i[4];
+			vst1q_s32(i, index.v);
+			float v[4] = { base[i[0]], base[i[1]], base[i[2]], base[i[3]] };
+			return vld1q_f32(v);
+		}
+
+		struct ISA
+		{
+			typedef neon::Float Float;
+			typedef neon::Int Int;
+			typedef neon::Mask Mask;
+			static const int width = 4;
+			static const char* name() { return "neon"; }
+			static Float load(const float* p) { return neon::load(p); }
+		};
+	}
+#endif
+
+	// --------------------------------------------------------------------------------
+	// math functions shared by all backends, built only from the lane operations above
+	// polynomials are from the Cephes single precision library
+	// --------------------------------------------------------------------------------
+	const float PI = 3.14159265358979f;
+
+	template <class Float>
+	inline Float atan(Float x)
+	{
+		Float ax = abs(x);
+		auto big = ax > Float(2.414213562373095f); // tan(3pi/8)
+		auto mid = ax > Float(0.4142135623730950f); // tan(pi/8)
+
+		Float offset = select(big, Float(0.5f * PI), select(mid, Float(0.25f * PI), Float(0.0f)));
+		Float t = select(big, Float(-1.0f) / max(ax, Float(1e-30f)), select(mid, (ax - Float(1.0f)) / (ax + Float(1.0f)), ax));
+
+		Float z = t * t;
+		Float y = (((Float(8.05374449538e-2f) * z - Float(1.38776856032e-1f)) * z + Float(1.99777106478e-1f)) * z - Float(3.33329491539e-1f)) * z * t + t;
+		y = y + offset;
+		return select(x < Float(0.0f), -y, y);
+	}
+
+	// same convention as GLSL atan(y, x)
+	template <class Float>
+	inline Float atan2(Float y, Float x)
+	{
+		Float r = atan(y / x);
+		Float halfTurn = select(y >= Float(0.0f), Float(PI), Float(-PI));
+		return select(x < Float(0.0f), r + halfTurn, r);
+	}
+
+	template <class Float>
+	inline Float cos(Float x)
+	{
+		x = abs(x);
+
+		// octant of x, rounded to an even number
+		Float j = floor(x * Float(1.27323954473516f)); // 4 / pi
+		j = j + (j - Float(2.0f) * floor(j * Float(0.5f)));
+		Float octant = j - Float(8.0f) * floor(j * Float(0.125f));
+
+		Float sign(1.0f);
+		auto upper = octant > Float(3.0f);
+		sign = select(upper, -sign, sign);
+		octant = select(upper, octant - Float(4.0f), octant);
+		auto useSin = octant > Float(1.0f);
+		sign = select(useSin, -sign, sign);
+
+		// extended precision modular arithmetic
+		x = ((x - j * Float(0.78515625f)) - j * Float(2.4187564849853515625e-4f)) - j * Float(3.77489497744594108e-8f);
+		Float z = x * x;
+
+		Float c = ((Float(2.443315711809948e-5f) * z - Float(1.388731625493765e-3f)) * z + Float(4.166664568298827e-2f)) * z * z - Float(0.5f) * z + Float(1.0f);
+		Float s = ((Float(-1.9515295891e-4f) * z + Float(8.3321608736e-3f)) * z - Float(1.6666654611e-1f)) * z * x + x;
+		return sign * select(useSin, s, c);
+	}
+
+	template <class Float>
+	inline Float sin(Float x)
+	{
+		return cos(x - Float(0.5f * PI));
+	}
+}
@@ -0,0 +1,27 @@
+﻿#version 460 core
+
+out vec4 fragColor;
+
+in VS_OUT {
+    vec3 viewPos;
+    flat vec3 center;
+    flat float radius;
+    flat vec3 color;
+} fs_in;
+
+uniform mat4 projection;
+
+void main()
+{
+	// nearest hit of the view ray with the sphere
+	vec3 dir = normalize(fs_in.viewPos);
+	float b = dot(dir, fs_in.center);
+	float h = b * b - dot(fs_in.center, fs_in.center) + fs_in.radius * fs_in.radius;
+	if (h < 0.0)
+		discard;
+	vec3 hit = dir * (b - sqrt(h));
+
+	vec4 clip = projection * vec4(hit, 1.0);
+	gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+	fragColor = vec4(fs_in.color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+﻿#version 460 core
+
+// Analytic sphere on a camera facing quad, drawn as a 4 vertex triangle strip per instance.
+// per instance, see ProxyInstance in lightProxies.h: center in aModel[3], radius in the length of aModel[0]
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec3 aColor;
+
+out VS_OUT {
+    vec3 viewPos;
+    flat vec3 center;
+    flat float radius;
+    flat vec3 color;
+} vs_out;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	vec3 center = (view * vec4(aModel[3].xyz, 1.0)).xyz;
+	float radius = length(aModel[0].xyz);
+	vs_out.center = center;
+	vs_out.radius = radius;
+	vs_out.color = aColor;
+
+	// spheres around the camera are skipped
+	float d2 = dot(center, center);
+	if (d2 <= radius * radius)
+	{
+		gl_Position = vec4(0.0);
+		return;
+	}
+
+	// the quad goes through the center, perpendicular to the view ray to it; the silhouette
+	// cone projects there to a circle of radius r * d / sqrt(d^2 - r^2)
+	vec3 axis = center * inversesqrt(d2);
+	vec3 up = abs(axis.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 right = normalize(cross(up, axis));
+	up = cross(axis, right);
+	float size = radius * sqrt(d2 / (d2 - radius * radius));
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+	vs_out.viewPos = center + (corner.x * right + corner.y * up) * size;
+	gl_Position = projection * vec4(vs_out.viewPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+
+// Fixed set of worker threads running queued tasks in FIFO order.
+// Tasks must not touch OpenGL, the context belongs to the main thread.
+class ThreadPool
+{
+public:
+	// numThreads 0: one less than the hardware threads, leaving one for the GL thread
+	explicit ThreadPool(size_t numThreads = 0) : stopping(false)
+	{
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		numThreads = std::max<size_t>(numThreads, 1);
+		for (size_t i = 0; i < numThreads; i++)
+			workers.emplace_back([this] { run(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// queue a task, the future holds its result
+	template <class F>
+	auto submit(F task) -> std::future<decltype(task())>
+	{
+		auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+		auto result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push([packaged] { (*packaged)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+
+	size_t size() const
+	{
+		return workers.size();
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	void run()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+};
@@ -0,0 +1,277 @@
+// --------------------------------------------------------------------------------
+// Microbenchmarks of the host-side paths the renderer runs per frame or per asset.
+// Every case is timed in isolation on generated or shipped inputs and reported as
+// nanoseconds and heap allocations per operation:
+//   - AreaLight::update and updatePoints of sphere and rectangle lights, 1 to 100k lights
+//   - the texture lookup by path of Model::loadTexture (Model::findTexture)
+//   - Model::import of large generated OBJ grids, with and without the mesh cache
+//   - stbi_load of a shipped 2K JPEG and of a generated 4K PNG
+// On glibc the allocations are counted in malloc, so stb_image and assimp count too;
+// elsewhere only operator new is counted.
+//
+// usage: Host_Bench [minSeconds] [gridSize] [image]
+//   run from this directory, the textures are read from ../CS6610_Final_Project_Area_Lights;
+//   the mesh cache entries of the generated models are left in hostBenchCache/
+// build without Visual Studio (Linux):
+//   g++ -std=c++14 -O2 -I../CS6610_Final_Project_Area_Lights -I../CS6610_Final_Project_Area_Lights/includes
+//       hostBench.cpp ../CS6610_Final_Project_Area_Lights/includes/glad/glad.c -lassimp -ldl -o hostBench
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+
+#include "model.h"
+#include "polyLight.h"
+#include "imageWriter.h"
+
+using namespace std;
+
+// heap allocations since the start of the program
+static atomic<size_t> allocations(0);
+
+#if defined(__GLIBC__)
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* pointer, size_t size);
+	void __libc_free(void* pointer);
+
+	void* malloc(size_t size)
+	{
+		allocations.fetch_add(1, memory_order_relaxed);
+		return __libc_malloc(size);
+	}
+	void* calloc(size_t count, size_t size)
+	{
+		allocations.fetch_add(1, memory_order_relaxed);
+		return __libc_calloc(count, size);
+	}
+	void* realloc(void* pointer, size_t size)
+	{
+		allocations.fetch_add(1, memory_order_relaxed);
+		return __libc_realloc(pointer, size);
+	}
+	void free(void* pointer)
+	{
+		__libc_free(pointer);
+	}
+}
+#else
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	if (auto pointer = malloc(size ? size : 1))
+		return pointer;
+	throw bad_alloc();
+}
+void operator delete(void* pointer) noexcept
+{
+	free(pointer);
+}
+#endif
+
+double minSeconds = 0.2;
+volatile size_t sink; // keeps results of the timed code alive
+
+// Calls run until minSeconds passed (at least twice, the first call is a warm-up) and prints
+// the time and allocations per operation, where one call performs opsPerCall operations.
+template<typename Run>
+void measure(const string& name, size_t n, double opsPerCall, Run run)
+{
+	run();
+	size_t calls = 0;
+	auto startAllocations = allocations.load();
+	auto start = chrono::high_resolution_clock::now();
+	double seconds = 0.0;
+	do
+	{
+		run();
+		calls++;
+		seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	} while (seconds < minSeconds || calls < 2);
+	auto ops = calls * opsPerCall;
+	cout << left << setw(40) << name << right << setw(10) << n
+		<< setw(16) << fixed << setprecision(1) << seconds * 1e9 / ops
+		<< setw(14) << setprecision(3) << (allocations.load() - startAllocations) / ops << "\n";
+}
+
+vector<unique_ptr<SphereLight>> makeSphereLights(size_t count)
+{
+	vector<unique_ptr<SphereLight>> lights;
+	for (size_t i = 0; i < count; i++)
+	{
+		auto x = -20.0f + 40.0f * (i % 317) / 317.0f, z = -20.0f + 40.0f * (i % 293) / 293.0f;
+		lights.emplace_back(new SphereLight(vec3(1.0f), vec3(x, 1.0f, z), 10.0f, vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f),
+			0.3f, 0.4f, 0.5f));
+	}
+	return lights;
+}
+
+vector<unique_ptr<RectDiskLight>> makeRectLights(size_t count)
+{
+	vector<unique_ptr<RectDiskLight>> lights;
+	for (size_t i = 0; i < count; i++)
+		lights.emplace_back(new RectDiskLight(LightType::Rectangle, vec3(1.0f), vec3(0.0f, 1.0f, 0.01f * i), 4.0f,
+			vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), 0.5f, 0.5f));
+	return lights;
+}
+
+// size x size vertex grid with normals and texture coordinates, as an OBJ exported from a modeler
+bool writeGridOBJ(const string& path, GLuint size)
+{
+	ofstream out(path);
+	if (!out)
+		return false;
+	out << fixed << setprecision(6);
+	for (GLuint y = 0; y < size; y++)
+		for (GLuint x = 0; x < size; x++)
+			out << "v " << x / float(size - 1) * 2.0f - 1.0f << " 0.0 " << y / float(size - 1) * 2.0f - 1.0f << "\n";
+	for (GLuint y = 0; y < size; y++)
+		for (GLuint x = 0; x < size; x++)
+			out << "vt " << x / float(size - 1) << " " << y / float(size - 1) << "\n";
+	out << "vn 0.0 1.0 0.0\n";
+	for (GLuint y = 0; y + 1 < size; y++)
+		for (GLuint x = 0; x + 1 < size; x++)
+		{
+			auto i = y * size + x + 1;
+			out << "f " << i << "/" << i << "/1 " << i + size << "/" << i + size << "/1 " << i + 1 << "/" << i + 1 << "/1\n";
+			out << "f " << i + 1 << "/" << i + 1 << "/1 " << i + size << "/" << i + size << "/1 " << i + size + 1 << "/" << i + size + 1 << "/1\n";
+		}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+		minSeconds = atof(argv[1]);
+	GLuint gridSize = argc > 2 ? (GLuint)atoi(argv[2]) : 512;
+	string imagePath = argc > 3 ? argv[3] : "../CS6610_Final_Project_Area_Lights/resources/textures/tex3/WoodFloor_Color.jpg";
+
+	cout << left << setw(40) << "case" << right << setw(10) << "n" << setw(16) << "ns/op" << setw(14) << "allocs/op" << "\n";
+
+	// area lights, one operation is one light
+	for (size_t count : { 1, 100, 10000, 100000 })
+	{
+		auto spheres = makeSphereLights(count);
+		auto offset = 0.0f;
+		measure("SphereLight::update, moved", count, (double)count, [&]()
+		{
+			offset = offset > 0.5f ? 0.0f : offset + 0.001f;
+			for (auto& light : spheres)
+			{
+				light->center.y = 1.0f + offset;
+				light->update();
+			}
+		});
+		measure("SphereLight::update, unchanged", count, (double)count, [&]()
+		{
+			for (auto& light : spheres)
+				light->update();
+		});
+		measure("SphereLight::updatePoints", count, (double)count, [&]()
+		{
+			for (auto& light : spheres)
+				light->updatePoints();
+		});
+
+		auto rects = makeRectLights(count);
+		measure("RectDiskLight::update, moved", count, (double)count, [&]()
+		{
+			offset = offset > 0.5f ? 0.0f : offset + 0.001f;
+			for (auto& light : rects)
+			{
+				light->center.y = 1.0f + offset;
+				light->update();
+			}
+		});
+		measure("RectDiskLight::updatePoints", count, (double)count, [&]()
+		{
+			for (auto& light : rects)
+				light->updatePoints();
+		});
+	}
+
+	// the linear search of Model::loadTexture over the textures a model loaded, one operation is one lookup
+	for (size_t count : { 4, 64, 1024 })
+	{
+		vector<Texture> loaded;
+		for (size_t i = 0; i < count; i++)
+			loaded.push_back(Texture{ (GLuint)i, "texture_diffuse", "textures/material_" + to_string(i) + "_diffuse.png" });
+		auto file = loaded.back().path;
+		measure("texture lookup by path, last", count, 1.0, [&]()
+		{
+			sink = Model::findTexture(loaded, file)->id;
+		});
+	}
+
+	// model import, one operation is one import
+	for (GLuint size : { 64u, gridSize })
+	{
+		auto path = "hostBenchGrid" + to_string(size) + ".obj";
+		if (!writeGridOBJ(path, size))
+		{
+			cout << "Fail to write " << path << "\n";
+			continue;
+		}
+		auto vertices = (size_t)size * size;
+		MeshCache::instance().enabled = false;
+		measure("Assimp::Importer::ReadFile", vertices, 1.0, [&]()
+		{
+			Assimp::Importer importer;
+			importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenBoundingBoxes | aiProcess_CalcTangentSpace);
+		});
+		measure("Model::import, assimp", vertices, 1.0, [&]()
+		{
+			Model::import(path);
+		});
+		MeshCache::instance().enabled = true;
+		MeshCache::instance().directory = "hostBenchCache";
+		Model::import(path); // writes the cache entry
+		measure("Model::import, mesh cache", vertices, 1.0, [&]()
+		{
+			Model::import(path);
+		});
+		remove(path.c_str());
+	}
+
+	// texture decode, one operation is one image
+	{
+		int width = 0, height = 0, components = 0;
+		stbi_set_flip_vertically_on_load(true);
+		if (auto data = stbi_load(imagePath.c_str(), &width, &height, &components, 0))
+		{
+			stbi_image_free(data);
+			measure("stbi_load " + imagePath.substr(imagePath.find_last_of("/\\") + 1), (size_t)width * height, 1.0, [&]()
+			{
+				stbi_image_free(stbi_load(imagePath.c_str(), &width, &height, &components, 0));
+			});
+		}
+		else
+			cout << "Fail to load " << imagePath << "\n";
+
+		const GLuint SIZE = 4096;
+		vector<uint8_t> rgb((size_t)SIZE * SIZE * 3);
+		for (size_t i = 0; i < rgb.size(); i++)
+			rgb[i] = (uint8_t)((i * 2654435761u) >> 24);
+		auto pngPath = string("hostBench4k.png");
+		if (imageWriter::writePNG(pngPath, SIZE, SIZE, rgb.data()))
+		{
+			measure("stbi_load 4096x4096 PNG", (size_t)SIZE * SIZE, 1.0, [&]()
+			{
+				stbi_image_free(stbi_load(pngPath.c_str(), &width, &height, &components, 0));
+			});
+			remove(pngPath.c_str());
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,336 @@
+// --------------------------------------------------------------------------------
+// Offline fitter of ALU approximations of the LTC tables, for the LTC_ANALYTIC variant of
+// ltcAll.frag. Every table channel becomes a polynomial in two variables:
+//   LTC1.xyzw, LTC2.xy  p = (roughness, sqrt(1 - cos theta)), roughness >= 0.1 as in ltcAll.frag.
+//                       LTC1.y and LTC1.w scale with alpha = roughness^2, so they are fitted
+//                       divided by it and the shader multiplies it back.
+//                       The others are weighted by 1 / roughness: the narrower the lobe, the
+//                       more an absolute error in M shows.
+//   LTC2.w (sphere)     p = (z, form factor), only where the sphere straddles the horizon;
+//                       elsewhere the scale is max(z, 0) exactly.
+// The polynomials are least squares fits to the texels. Rational fits were tried as well, but
+// they put poles inside the domain at every degree. The error is reported against the
+// bilinearly filtered table, as the shaders sample it.
+//
+// usage: LTC_Approximation [--degree n] [--sphere-degree n] [--table path] [output]
+//   --degree         degree of the LTC1 and LTC2.xy polynomials, default 6
+//   --sphere-degree  degree of the sphere polynomial, default 5
+//   --table          table file to approximate (see ltcTable.h), default the GGX fit in LTC.h
+//   output           GLSL constants to paste into ltcAll.frag, default none (only the error report)
+// build without Visual Studio:
+//   g++ -std=c++14 -O2 -I../CS6610_Final_Project_Area_Lights -I../CS6610_Final_Project_Area_Lights/includes
+//       ltcApproximation.cpp -o ltcApproximation
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include "LTC.h" // LTC1 and LTC2
+#include "ltcTable.h"
+
+using namespace std;
+
+const double MIN_ROUGHNESS = 0.1; // the clamp of ltcAll.frag
+
+// x^i y^j of total degree <= degree, by degree, then by the power of y, as the shader loops over them
+vector<double> monomials(double x, double y, int degree)
+{
+	vector<double> m;
+	for (int k = 0; k <= degree; k++)
+		for (int j = 0; j <= k; j++)
+			m.push_back(pow(x, k - j) * pow(y, j));
+	return m;
+}
+
+// Least squares solution of the rows x cols system A x = b with Householder QR; A is row-major
+vector<double> solveLeastSquares(vector<double> A, vector<double> b, size_t rows, size_t cols)
+{
+	for (size_t k = 0; k < cols; k++)
+	{
+		double norm = 0.0;
+		for (size_t i = k; i < rows; i++)
+			norm += A[i * cols + k] * A[i * cols + k];
+		norm = sqrt(norm);
+		if (norm == 0.0)
+			continue;
+		auto alpha = A[k * cols + k] > 0.0 ? -norm : norm;
+		vector<double> v(rows - k);
+		for (size_t i = k; i < rows; i++)
+			v[i - k] = A[i * cols + k];
+		v[0] -= alpha;
+		double vv = 0.0;
+		for (auto x : v)
+			vv += x * x;
+		// reflect the remaining columns and b
+		for (size_t j = k; j <= cols; j++)
+		{
+			double dot = 0.0;
+			for (size_t i = k; i < rows; i++)
+				dot += v[i - k] * (j < cols ? A[i * cols + j] : b[i]);
+			auto f = 2.0 * dot / vv;
+			for (size_t i = k; i < rows; i++)
+				(j < cols ? A[i * cols + j] : b[i]) -= f * v[i - k];
+		}
+	}
+	vector<double> x(cols, 0.0);
+	for (size_t k = cols; k-- > 0;)
+	{
+		auto sum = b[k];
+		for (size_t j = k + 1; j < cols; j++)
+			sum -= A[k * cols + j] * x[j];
+		x[k] = A[k * cols + k] != 0.0 ? sum / A[k * cols + k] : 0.0;
+	}
+	return x;
+}
+
+struct Polynomial
+{
+	int degree = 0;
+	vector<double> coefficients;
+
+	double operator()(double x, double y) const
+	{
+		auto m = monomials(x, y, degree);
+		double value = 0.0;
+		for (size_t i = 0; i < m.size(); i++)
+			value += coefficients[i] * m[i];
+		return value;
+	}
+};
+
+struct Sample
+{
+	double x, y, value;
+	double weight;
+};
+
+Polynomial fitPolynomial(const vector<Sample>& samples, int degree)
+{
+	Polynomial polynomial;
+	polynomial.degree = degree;
+	auto terms = monomials(0.0, 0.0, degree).size();
+	vector<double> A, b;
+	for (auto& s : samples)
+	{
+		for (auto m : monomials(s.x, s.y, degree))
+			A.push_back(s.weight * m);
+		b.push_back(s.weight * s.value);
+	}
+	polynomial.coefficients = solveLeastSquares(A, b, samples.size(), terms);
+	return polynomial;
+}
+
+// table of size x size RGBA texels, bilinearly filtered like the GPU with texel i at i / (size - 1)
+struct Table
+{
+	uint32_t size;
+	vector<float> texels;
+
+	double texel(uint32_t x, uint32_t y, int c) const
+	{
+		return texels[4 * ((size_t)y * size + x) + c];
+	}
+
+	double at(double x, double y, int c) const
+	{
+		auto sx = x * (size - 1), sy = y * (size - 1);
+		auto x0 = std::min((uint32_t)sx, size - 2), y0 = std::min((uint32_t)sy, size - 2);
+		auto fx = sx - x0, fy = sy - y0;
+		auto top = texel(x0, y0, c) * (1.0 - fx) + texel(x0 + 1, y0, c) * fx;
+		auto bottom = texel(x0, y0 + 1, c) * (1.0 - fx) + texel(x0 + 1, y0 + 1, c) * fx;
+		return top * (1.0 - fy) + bottom * fy;
+	}
+};
+
+bool loadTable(const string& path, Table& ltc1, Table& ltc2)
+{
+	if (path.empty())
+	{
+		ltc1 = { 64, vector<float>(LTC1, LTC1 + 64 * 64 * 4) };
+		ltc2 = { 64, vector<float>(LTC2, LTC2 + 64 * 64 * 4) };
+		return true;
+	}
+	LTCTable table;
+	if (!table.load(path))
+		return false;
+	for (int index = 0; index < 2; index++)
+	{
+		auto& t = index == 0 ? ltc1 : ltc2;
+		t.size = table.size;
+		t.texels.resize((size_t)table.size * table.size * 4);
+		for (size_t i = 0; i < t.texels.size(); i++)
+			t.texels[i] = table.halfFloat ? glm::unpackHalf1x16(((const uint16_t*)table.texels(index))[i]) : ((const float*)table.texels(index))[i];
+	}
+	return true;
+}
+
+struct Channel
+{
+	const char* name;
+	const Table* table;
+	int c;
+	bool sphere; // indexed by (z * 0.5 + 0.5, form factor)
+	bool alphaScaled; // fitted divided by alpha
+	Polynomial fit;
+
+	Channel(const char* name, const Table* table, int c, bool sphere, bool alphaScaled)
+		: name(name), table(table), c(c), sphere(sphere), alphaScaled(alphaScaled)
+	{
+	}
+
+	// the fitted value at table coordinates (u, v), or false where the shader does not use the fit
+	bool fitted(double u, double v, double& value) const
+	{
+		if (sphere)
+		{
+			auto z = 2.0 * u - 1.0;
+			if (z * z >= v)
+				return false;
+			value = std::max(fit(z, v), 0.0);
+		}
+		else
+		{
+			if (u < MIN_ROUGHNESS)
+				return false;
+			value = fit(u, v) * (alphaScaled ? u * u : 1.0);
+		}
+		return true;
+	}
+};
+
+string glslFloat(double value)
+{
+	stringstream out;
+	out << setprecision(9) << (float)value;
+	auto s = out.str();
+	return s.find_first_of(".en") == string::npos ? s + ".0" : s;
+}
+
+// const array of the coefficients of channels first..first+count as vecN, one per monomial
+void writeCoefficients(ostream& out, const string& name, const vector<Channel>& channels, size_t first, size_t count)
+{
+	auto type = count == 1 ? string("float") : "vec" + to_string(count);
+	auto terms = channels[first].fit.coefficients.size();
+	out << "const " << type << " " << name << "[" << terms << "] = " << type << "[](\n";
+	for (size_t i = 0; i < terms; i++)
+	{
+		out << "    " << (count == 1 ? "" : type + "(");
+		for (size_t c = 0; c < count; c++)
+			out << (c ? ", " : "") << glslFloat(channels[first + c].fit.coefficients[i]);
+		out << (count == 1 ? "" : ")") << (i + 1 < terms ? ",\n" : ");\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int degree = 6, sphereDegree = 5;
+	string tablePath, output;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--degree" && i + 1 < argc)
+			degree = atoi(argv[++i]);
+		else if (arg == "--sphere-degree" && i + 1 < argc)
+			sphereDegree = atoi(argv[++i]);
+		else if (arg == "--table" && i + 1 < argc)
+			tablePath = argv[++i];
+		else if (arg[0] != '-')
+			output = arg;
+		else
+		{
+			cout << "usage: " << argv[0] << " [--degree n] [--sphere-degree n] [--table path] [output]" << endl;
+			return arg == "--help" || arg == "-h" ? 0 : -1;
+		}
+	}
+	if (degree < 1 || degree > 8 || sphereDegree < 1 || sphereDegree > 8)
+	{
+		cout << "Unsupported degree, use 1 to 8" << endl;
+		return -1;
+	}
+	Table ltc1, ltc2;
+	if (!loadTable(tablePath, ltc1, ltc2))
+	{
+		cout << "Fail to load LTC table " << tablePath << endl;
+		return -1;
+	}
+
+	vector<Channel> channels = {
+		{ "LTC1.x", &ltc1, 0, false, false }, { "LTC1.y", &ltc1, 1, false, true }, { "LTC1.z", &ltc1, 2, false, false }, { "LTC1.w", &ltc1, 3, false, true },
+		{ "LTC2.x", &ltc2, 0, false, false }, { "LTC2.y", &ltc2, 1, false, false }, { "LTC2.w", &ltc2, 3, true, false },
+	};
+
+	// fitted at the texels, including the column below the roughness clamp that the filtering reaches
+	auto size = ltc1.size;
+	for (auto& channel : channels)
+	{
+		vector<Sample> samples;
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				auto u = x / double(size - 1), v = y / double(size - 1);
+				auto value = channel.table->texel(x, y, channel.c);
+				if (channel.sphere)
+				{
+					auto z = 2.0 * u - 1.0;
+					if (z * z < v)
+						samples.push_back({ z, v, value, 1.0 });
+				}
+				else if (u >= MIN_ROUGHNESS - 1.0 / (size - 1))
+					samples.push_back({ u, v, channel.alphaScaled ? value / (u * u) : value, channel.alphaScaled ? 1.0 : 1.0 / u });
+			}
+		}
+		channel.fit = fitPolynomial(samples, channel.sphere ? sphereDegree : degree);
+	}
+
+	// errors on a grid 4 times finer than the table, where the shader evaluates the fit
+	cout << "error against " << (tablePath.empty() ? "LTC.h" : tablePath) << ", degree " << degree << ", sphere degree "
+		<< sphereDegree << "\n" << fixed << setprecision(6);
+	const uint32_t GRID = 4 * (size - 1) + 1;
+	for (auto& channel : channels)
+	{
+		double maxError = 0.0, sum = 0.0, maxRelative = 0.0;
+		size_t count = 0;
+		for (uint32_t y = 0; y < GRID; y++)
+		{
+			for (uint32_t x = 0; x < GRID; x++)
+			{
+				auto u = x / double(GRID - 1), v = y / double(GRID - 1);
+				double value;
+				if (!channel.fitted(u, v, value))
+					continue;
+				auto reference = channel.table->at(u, v, channel.c);
+				auto error = fabs(value - reference);
+				maxError = std::max(maxError, error);
+				maxRelative = std::max(maxRelative, error / std::max(fabs(reference), 0.01));
+				sum += error;
+				count++;
+			}
+		}
+		cout << "  " << left << setw(8) << channel.name << right << " max " << setw(9) << maxError << "  mean " << setw(9) << sum / count
+			<< "  max relative (to at least 0.01) " << setw(9) << maxRelative << "\n";
+	}
+
+	if (output.empty())
+		return 0;
+	ofstream out(output);
+	if (!out)
+	{
+		cout << "Fail to write " << output << endl;
+		return -1;
+	}
+	out << "// generated by LTC_Approximation from " << (tablePath.empty() ? "LTC.h" : tablePath) << "\n"
+		<< "const int LTC_FIT_DEGREE = " << degree << ";\n";
+	writeCoefficients(out, "LTC1_FIT", channels, 0, 4);
+	writeCoefficients(out, "LTC2_FIT", channels, 4, 2);
+	out << "const int SPHERE_FIT_DEGREE = " << sphereDegree << ";\n";
+	writeCoefficients(out, "SPHERE_FIT", channels, 6, 1);
+	cout << "GLSL written to " << output << endl;
+	return 0;
+}
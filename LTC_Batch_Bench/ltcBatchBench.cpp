@@ -0,0 +1,383 @@
+// --------------------------------------------------------------------------------
+// Throughput benchmark for the CPU LTC kernels in ltcBatch.h.
+// Shades a batch of points on the floor plane against one light of each type
+// with every compiled-in backend, and prints points per second together with
+// the largest difference to the scalar results.
+// Then projects random ellipsoids with ltc::projectEllipsoids and compares the
+// ellipses to the former Eigen based SphereLight::updatePoints.
+//
+// usage: LTC_Batch_Bench [numPoints] [minSeconds]
+//   numPoints is also the number of ellipsoids
+// build without Visual Studio (AVX2 + SSE4 + scalar backends):
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I../CS6610_Final_Project_Area_Lights
+//       -I../CS6610_Final_Project_Area_Lights/includes ltcBatchBench.cpp -o ltcBatchBench
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include "ltcBatch.h"
+#include "LTC.h" // LTC1 and LTC2
+
+using namespace std;
+
+// SoA storage for the shading points and the results
+struct Batch
+{
+	vector<float> position[3], normal[3], view[3], roughness;
+	vector<float> diffuse, specular, norm, fresnel;
+
+	ltc::ShadingPoints points() const
+	{
+		ltc::ShadingPoints p;
+		p.count = roughness.size();
+		for (int i = 0; i < 3; i++)
+		{
+			p.position[i] = position[i].data();
+			p.normal[i] = normal[i].data();
+			p.view[i] = view[i].data();
+		}
+		p.roughness = roughness.data();
+		return p;
+	}
+
+	ltc::ShadingResult result()
+	{
+		return { diffuse.data(), specular.data(), norm.data(), fresnel.data() };
+	}
+};
+
+// random points on the floor of scene 2 seen from a fixed camera, with slightly perturbed normals
+Batch createBatch(size_t count)
+{
+	Batch batch;
+	mt19937 rng(1234);
+	uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	const glm::vec3 cameraPos(0.0f, 4.0f, 12.0f);
+
+	for (int i = 0; i < 3; i++)
+	{
+		batch.position[i].resize(count);
+		batch.normal[i].resize(count);
+		batch.view[i].resize(count);
+	}
+	batch.roughness.resize(count);
+	batch.diffuse.resize(count);
+	batch.specular.resize(count);
+	batch.norm.resize(count);
+	batch.fresnel.resize(count);
+
+	for (size_t k = 0; k < count; k++)
+	{
+		glm::vec3 P(10.0f * uniform(rng), 0.0f, 10.0f * uniform(rng));
+		glm::vec3 N = glm::normalize(glm::vec3(0.1f * uniform(rng), 1.0f, 0.1f * uniform(rng)));
+		glm::vec3 V = glm::normalize(cameraPos - P);
+		for (int i = 0; i < 3; i++)
+		{
+			batch.position[i][k] = P[i];
+			batch.normal[i][k] = N[i];
+			batch.view[i][k] = V[i];
+		}
+		batch.roughness[k] = 0.55f + 0.45f * uniform(rng);
+	}
+	return batch;
+}
+
+// runs the light until minSeconds passed, returns points per second
+template <class Light>
+double measure(const ltc::Tables& tables, Batch& batch, const Light& light, ltc::Backend backend, double minSeconds)
+{
+	auto points = batch.points();
+	auto result = batch.result();
+	ltc::evaluate(tables, points, light, result, backend); // warm up
+
+	size_t iterations = 0;
+	double seconds = 0.0;
+	auto start = chrono::high_resolution_clock::now();
+	while (seconds < minSeconds)
+	{
+		ltc::evaluate(tables, points, light, result, backend);
+		iterations++;
+		seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	}
+	return iterations * points.count / seconds;
+}
+
+float maxDifference(const vector<float>& a, const vector<float>& b)
+{
+	float diff = 0.0f;
+	for (size_t i = 0; i < a.size(); i++)
+		diff = max(diff, fabs(a[i] - b[i]));
+	return diff;
+}
+
+template <class Light>
+void benchmark(const string& name, const ltc::Tables& tables, Batch& batch, const Light& light, double minSeconds)
+{
+	// scalar results as reference for the SIMD backends
+	ltc::evaluate(tables, batch.points(), light, batch.result(), ltc::Backend::Scalar);
+	vector<float> diffuse = batch.diffuse, specular = batch.specular;
+
+	const ltc::Backend backends[] = { ltc::Backend::Scalar, ltc::Backend::SSE4, ltc::Backend::AVX2, ltc::Backend::NEON };
+	for (auto backend : backends)
+	{
+		if (!ltc::isAvailable(backend))
+			continue;
+		double rate = measure(tables, batch, light, backend, minSeconds);
+		float error = max(maxDifference(diffuse, batch.diffuse), maxDifference(specular, batch.specular));
+		cout << left << setw(10) << name << setw(8) << ltc::backendName(backend)
+			<< right << setw(12) << fixed << setprecision(2) << rate * 1e-6 << " Mpoints/s"
+			<< setw(14) << scientific << setprecision(2) << error << endl;
+	}
+}
+
+// SoA ellipsoids and the ellipses they project to
+struct EllipsoidBatch
+{
+	vector<float> center[3], origin[3], axis[3][3], length[3];
+	vector<float> ex[3], ey[3];
+
+	size_t size() const
+	{
+		return length[0].size();
+	}
+
+	ltc::Ellipsoids ellipsoids() const
+	{
+		ltc::Ellipsoids e;
+		e.count = size();
+		for (int c = 0; c < 3; c++)
+		{
+			e.center[c] = center[c].data();
+			e.origin[c] = origin[c].data();
+			e.length[c] = length[c].data();
+			for (int k = 0; k < 3; k++)
+				e.axis[k][c] = axis[k][c].data();
+		}
+		return e;
+	}
+
+	ltc::Ellipses ellipses()
+	{
+		return { { ex[0].data(), ex[1].data(), ex[2].data() }, { ey[0].data(), ey[1].data(), ey[2].data() } };
+	}
+};
+
+// random orientations and sizes seen from random points on the floor.
+// spheres: every third ellipsoid has equal semi-axes; inside: the origin is at the center
+EllipsoidBatch createEllipsoids(size_t count, bool inside)
+{
+	EllipsoidBatch batch;
+	mt19937 rng(5678);
+	uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	for (int c = 0; c < 3; c++)
+	{
+		batch.center[c].resize(count);
+		batch.origin[c].resize(count);
+		batch.length[c].resize(count);
+		batch.ex[c].resize(count);
+		batch.ey[c].resize(count);
+		for (int k = 0; k < 3; k++)
+			batch.axis[k][c].resize(count);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 center(10.0f * uniform(rng), 4.0f + 2.0f * uniform(rng), 10.0f * uniform(rng));
+		glm::vec3 origin = inside ? center : glm::vec3(10.0f * uniform(rng), 0.0f, 10.0f * uniform(rng));
+		glm::vec3 size(1.0f + 0.8f * uniform(rng), 1.0f + 0.8f * uniform(rng), 1.0f + 0.8f * uniform(rng));
+		if (i % 3 == 0)
+			size = glm::vec3(size.x);
+		glm::vec3 x = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+		glm::vec3 y = glm::normalize(glm::cross(x, glm::vec3(uniform(rng), uniform(rng), uniform(rng))));
+		glm::vec3 axes[3] = { x, y, glm::cross(x, y) };
+		for (int c = 0; c < 3; c++)
+		{
+			batch.center[c][i] = center[c];
+			batch.origin[c][i] = origin[c];
+			batch.length[c][i] = size[c];
+			for (int k = 0; k < 3; k++)
+				batch.axis[k][c][i] = axes[k][c];
+		}
+	}
+	return batch;
+}
+
+// SphereLight::updatePoints before the closed-form kernel, for one ellipsoid.
+// T = float times the old path, T = double gives the reference the errors are measured against.
+template <typename T>
+void projectEigen(const EllipsoidBatch& batch, size_t i, glm::vec3& ex, glm::vec3& ey)
+{
+	typedef glm::tvec3<T> vec3;
+	typedef glm::tmat3x3<T> mat3;
+	auto at = [&batch, i](const vector<float>* v) { return vec3(v[0][i], v[1][i], v[2][i]); };
+	vec3 local_center = at(batch.center) - at(batch.origin);
+	auto A = mat3(glm::normalize(at(batch.axis[0])), glm::normalize(at(batch.axis[1])), glm::normalize(at(batch.axis[2])));
+	auto diagonal = mat3(batch.length[0][i], 0, 0, 0, batch.length[1][i], 0, 0, 0, batch.length[2][i]);
+
+	auto M = A * diagonal * glm::transpose(A);
+	auto Pb = glm::inverse(M) * local_center;
+	auto theta = asin(1 / glm::length(Pb));
+	auto Pc = cos(theta) * cos(theta) * Pb;
+	auto radius = tan(theta) * glm::length(Pc);
+	vec3 n = glm::normalize(Pc), C1, C2;
+	if (n.z < T(-0.9999999))
+	{
+		C1 = vec3(0, -1, 0);
+		C2 = vec3(-1, 0, 0);
+	}
+	else
+	{
+		T a = 1 / (1 + n.z);
+		T b = -n.x * n.y * a;
+		C1 = vec3(1 - n.x * n.x * a, b, -n.x);
+		C2 = vec3(b, 1 - n.y * n.y * a, -n.y);
+	}
+	auto D1_ = M * radius * C1;
+	auto D2_ = M * radius * C2;
+
+	Eigen::Matrix<T, 2, 2> Q;
+	Q << glm::dot(D1_, D1_), glm::dot(D1_, D2_), glm::dot(D1_, D2_), glm::dot(D2_, D2_);
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix<T, 2, 2>> eigensolver(Q);
+	auto eigenvalues = eigensolver.eigenvalues();
+	auto eigenvectors = eigensolver.eigenvectors();
+	ex = glm::vec3(glm::normalize(eigenvectors(0, 0) * D1_ + eigenvectors(1, 0) * D2_) * sqrt(eigenvalues(0)));
+	ey = glm::vec3(glm::normalize(eigenvectors(0, 1) * D1_ + eigenvectors(1, 1) * D2_) * sqrt(eigenvalues(1)));
+}
+
+// the ellipse as ex ex^T + ey ey^T, independent of the signs and, for circles, the directions of the axes
+glm::mat3 ellipseForm(const glm::vec3& ex, const glm::vec3& ey)
+{
+	return glm::outerProduct(ex, ex) + glm::outerProduct(ey, ey);
+}
+
+void benchmarkEllipsoids(size_t count, double minSeconds)
+{
+	auto batch = createEllipsoids(count, false);
+	auto ellipsoids = batch.ellipsoids();
+	auto ellipses = batch.ellipses();
+
+	// double precision reference
+	vector<glm::vec3> referenceX(count), referenceY(count);
+	for (size_t i = 0; i < count; i++)
+		projectEigen<double>(batch, i, referenceX[i], referenceY[i]);
+
+	// largest difference of the ellipse forms relative to the size of the ellipse
+	auto maxError = [&](const vector<float>* ex, const vector<float>* ey)
+	{
+		float error = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			auto difference = ellipseForm(glm::vec3(ex[0][i], ex[1][i], ex[2][i]), glm::vec3(ey[0][i], ey[1][i], ey[2][i]))
+				- ellipseForm(referenceX[i], referenceY[i]);
+			float scale = glm::dot(referenceY[i], referenceY[i]);
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					error = max(error, fabs(difference[r][c]) / scale);
+		}
+		return error;
+	};
+
+	// the float Eigen path replaced by the kernel
+	vector<float> eigenX[3], eigenY[3];
+	for (int c = 0; c < 3; c++)
+	{
+		eigenX[c].resize(count);
+		eigenY[c].resize(count);
+	}
+	size_t iterations = 0;
+	double seconds = 0.0;
+	auto start = chrono::high_resolution_clock::now();
+	while (seconds < minSeconds || iterations == 0)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 ex, ey;
+			projectEigen<float>(batch, i, ex, ey);
+			for (int c = 0; c < 3; c++)
+			{
+				eigenX[c][i] = ex[c];
+				eigenY[c][i] = ey[c];
+			}
+		}
+		iterations++;
+		seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+	}
+	cout << endl << count << " ellipsoids, a third of them spheres, max error against double precision" << endl;
+	cout << left << setw(10) << "project" << setw(8) << "eigen" << right << setw(12) << fixed << setprecision(2)
+		<< iterations * count / seconds * 1e-6 << " Mellipsoids/s"
+		<< setw(14) << scientific << setprecision(2) << maxError(eigenX, eigenY) << endl;
+
+	const ltc::Backend backends[] = { ltc::Backend::Scalar, ltc::Backend::SSE4, ltc::Backend::AVX2, ltc::Backend::NEON };
+	for (auto backend : backends)
+	{
+		if (!ltc::isAvailable(backend))
+			continue;
+		ltc::projectEllipsoids(ellipsoids, ellipses, backend); // warm up
+		iterations = 0;
+		seconds = 0.0;
+		start = chrono::high_resolution_clock::now();
+		while (seconds < minSeconds)
+		{
+			ltc::projectEllipsoids(ellipsoids, ellipses, backend);
+			iterations++;
+			seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+		}
+
+		cout << left << setw(10) << "project" << setw(8) << ltc::backendName(backend)
+			<< right << setw(12) << fixed << setprecision(2) << iterations * count / seconds * 1e-6 << " Mellipsoids/s"
+			<< setw(14) << scientific << setprecision(2) << maxError(batch.ex, batch.ey) << endl;
+	}
+
+	// the origin at the center, where the Eigen path produced NaN: every ellipse must stay finite and non-empty
+	auto insideBatch = createEllipsoids(count, true);
+	ltc::projectEllipsoids(insideBatch.ellipsoids(), insideBatch.ellipses());
+	size_t invalid = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		float minor = 0.0f;
+		for (int c = 0; c < 3; c++)
+			minor += insideBatch.ex[c][i] * insideBatch.ex[c][i];
+		if (!(minor > 0.0f) || !std::isfinite(minor + insideBatch.ey[0][i] + insideBatch.ey[1][i] + insideBatch.ey[2][i]))
+			invalid++;
+	}
+	cout << "origin inside: " << invalid << " of " << count << " ellipses invalid" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numPoints = argc > 1 ? strtoul(argv[1], NULL, 10) : (1 << 18);
+	double minSeconds = argc > 2 ? atof(argv[2]) : 0.5;
+
+	ltc::Tables tables = { LTC1, LTC2, 64 };
+	Batch batch = createBatch(numPoints);
+
+	// same shapes as the scene 2 lights, facing down over the floor
+	const glm::vec3 center(0.0f, 3.0f, 0.0f);
+	const glm::vec3 ex(2.0f, 0.0f, 0.0f), ey(0.0f, 0.0f, 1.0f);
+	ltc::PolygonLight rect = { { center - ex - ey, center + ex - ey, center + ex + ey, center - ex + ey } };
+	ltc::LineLight cylinder = { { center - ex, center + ex }, 0.2f };
+	ltc::DiskLight disk = { { center - ex - ey, center + ex - ey, center + ex + ey, center - ex + ey } };
+	// sphere lights reuse the disk kernel with the ellipse from SphereLight::updatePoints, here a vertical one
+	ltc::DiskLight sphere = { { center - ey - glm::vec3(0, 1, 0), center + ey - glm::vec3(0, 1, 0),
+		center + ey + glm::vec3(0, 1, 0), center - ey + glm::vec3(0, 1, 0) } };
+
+	cout << numPoints << " points, best backend: " << ltc::backendName(ltc::bestBackend()) << endl;
+	cout << left << setw(10) << "light" << setw(8) << "backend" << right << setw(22) << "throughput" << setw(14) << "max diff" << endl;
+	benchmark("rect", tables, batch, rect, minSeconds);
+	benchmark("cylinder", tables, batch, cylinder, minSeconds);
+	benchmark("disk", tables, batch, disk, minSeconds);
+	benchmark("sphere", tables, batch, sphere, minSeconds);
+
+	benchmarkEllipsoids(numPoints, minSeconds);
+
+	return 0;
+}
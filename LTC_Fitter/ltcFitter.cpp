@@ -0,0 +1,538 @@
+// --------------------------------------------------------------------------------
+// Offline fitter of the LTC tables for a microfacet BRDF, after the fitting code of
+// Heitz et al. (https://github.com/selfshadow/ltc_code/tree/master/fit).
+// For every roughness and view angle of the table, Nelder-Mead finds the LTC closest to
+// the cosine weighted BRDF, starting from the fit of the previous view angle. The view
+// angles of one roughness form such a chain, so every roughness is one task of the
+// thread pool and an idle worker picks up the next one.
+// Writes the table format of ltcTable.h:
+//   LTC1  inverse M divided by its (1, 1) entry, as (m00, m20, m02, m22)
+//   LTC2  BRDF norm, Fresnel weighted norm, 0, form factor of a horizon-clipped sphere
+//
+// usage: LTC_Fitter [--brdf ggx|beckmann] [--size n] [--samples n] [--threads n] [--half] [output]
+//   --size     texels per side, default 64
+//   --samples  n x n samples of the BRDF and of the LTC per error evaluation, default 32
+//   --threads  worker threads, default all hardware threads
+//   default output: ../CS6610_Final_Project_Area_Lights/resources/ltc/<brdf><size>_<f16|f32>.ltc
+//   A GGX fit is also compared with the fit in LTC.h. The renderer loads a table with --ltc-table.
+// build without Visual Studio:
+//   g++ -std=c++14 -O2 -pthread -I../CS6610_Final_Project_Area_Lights -I../CS6610_Final_Project_Area_Lights/includes
+//       ltcFitter.cpp -o ltcFitter
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+
+#include "LTC.h" // LTC1 and LTC2, the reference GGX fit
+#include "ltcTable.h"
+#include "threadPool.h"
+
+using namespace std;
+using glm::vec3;
+using glm::mat3;
+
+const float PI = 3.14159265f;
+const float MIN_ALPHA = 0.00001f;
+
+// cosine weighted BRDF of a microfacet distribution with Smith shadowing, without Fresnel
+class Brdf
+{
+public:
+	virtual ~Brdf() = default;
+
+	// BRDF * cos of the light direction L, and the pdf of sample() for L
+	float eval(const vec3& V, const vec3& L, float alpha, float& pdf) const
+	{
+		if (V.z <= 0.0f)
+		{
+			pdf = 0.0f;
+			return 0.0f;
+		}
+		auto LambdaV = lambda(V.z, alpha);
+		auto G2 = L.z <= 0.0f ? 0.0f : 1.0f / (1.0f + LambdaV + lambda(L.z, alpha));
+
+		auto H = glm::normalize(V + L);
+		auto D = distribution(H, alpha);
+		pdf = fabs(D * H.z / 4.0f / glm::dot(V, H));
+		return D * G2 / 4.0f / V.z;
+	}
+
+	// light direction of the half vector sampled with pdf D(H) * H.z for the uniforms U1, U2
+	vec3 sample(const vec3& V, float alpha, float U1, float U2) const
+	{
+		auto phi = 2.0f * PI * U1;
+		auto r = slope(alpha, U2);
+		auto N = glm::normalize(vec3(r * cos(phi), r * sin(phi), 1.0f));
+		return -V + 2.0f * N * glm::dot(N, V);
+	}
+
+protected:
+	virtual float distribution(const vec3& H, float alpha) const = 0;
+	virtual float slope(float alpha, float U) const = 0; // tan of the sampled half vector elevation
+	virtual float lambda(float cosTheta, float alpha) const = 0; // Smith masking
+
+	// 1 / (alpha tan theta)
+	static float inverseSlope(float cosTheta, float alpha)
+	{
+		return cosTheta / (alpha * sqrt(std::max(1.0f - cosTheta * cosTheta, 1e-12f)));
+	}
+};
+
+class BrdfGGX : public Brdf
+{
+protected:
+	float distribution(const vec3& H, float alpha) const override
+	{
+		auto slopes = (H.x * H.x + H.y * H.y) / (H.z * H.z);
+		auto D = 1.0f / (1.0f + slopes / (alpha * alpha));
+		return D * D / (PI * alpha * alpha * H.z * H.z * H.z * H.z);
+	}
+
+	float slope(float alpha, float U) const override
+	{
+		return alpha * sqrt(U / (1.0f - U));
+	}
+
+	float lambda(float cosTheta, float alpha) const override
+	{
+		if (cosTheta >= 1.0f)
+			return 0.0f;
+		auto a = inverseSlope(cosTheta, alpha);
+		return 0.5f * (-1.0f + sqrt(1.0f + 1.0f / (a * a)));
+	}
+};
+
+class BrdfBeckmann : public Brdf
+{
+protected:
+	float distribution(const vec3& H, float alpha) const override
+	{
+		auto slopes = (H.x * H.x + H.y * H.y) / (H.z * H.z);
+		return exp(-slopes / (alpha * alpha)) / (PI * alpha * alpha * H.z * H.z * H.z * H.z);
+	}
+
+	float slope(float alpha, float U) const override
+	{
+		return alpha * sqrt(-log(1.0f - U));
+	}
+
+	// rational approximation of Walter et al. 2007
+	float lambda(float cosTheta, float alpha) const override
+	{
+		if (cosTheta >= 1.0f)
+			return 0.0f;
+		auto a = inverseSlope(cosTheta, alpha);
+		return a < 1.6f ? (1.0f - 1.259f * a + 0.396f * a * a) / (3.535f * a + 2.181f * a * a) : 0.0f;
+	}
+};
+
+// clamped cosine distribution transformed by M = (X, Y, Z) * (m11 0 m13, 0 m22 0, 0 0 1)
+struct LTC
+{
+	float magnitude = 1.0f; // BRDF norm
+	float fresnel = 1.0f; // Fresnel weighted norm
+	float m11 = 1.0f, m22 = 1.0f, m13 = 0.0f;
+	vec3 X = vec3(1, 0, 0), Y = vec3(0, 1, 0), Z = vec3(0, 0, 1);
+
+	mat3 M, invM;
+	float detM;
+
+	LTC()
+	{
+		update();
+	}
+
+	void update()
+	{
+		M = mat3(X, Y, Z) * mat3(m11, 0, 0, 0, m22, 0, m13, 0, 1);
+		invM = glm::inverse(M);
+		detM = fabs(glm::determinant(M));
+	}
+
+	// L is a unit vector, so M maps the normalized original direction to a vector of length 1 / l
+	float eval(const vec3& L) const
+	{
+		auto original = invM * L;
+		auto l = glm::length(original);
+		auto jacobian = detM * l * l * l;
+		return magnitude * std::max(0.0f, original.z / l) / PI / jacobian;
+	}
+
+	// direction of the clamped cosine distribution transformed by M
+	vec3 sample(const vec3& cosineDir) const
+	{
+		return glm::normalize(M * cosineDir);
+	}
+};
+
+int numSamples = 32;
+vector<vec3> cosineSamples; // numSamples x numSamples stratified directions of the clamped cosine
+
+void makeCosineSamples()
+{
+	cosineSamples.clear();
+	for (int j = 0; j < numSamples; j++)
+	{
+		for (int i = 0; i < numSamples; i++)
+		{
+			auto theta = acos(sqrt((i + 0.5f) / numSamples));
+			auto phi = 2.0f * PI * (j + 0.5f) / numSamples;
+			cosineSamples.push_back(vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)));
+		}
+	}
+}
+
+// stratified samples of the BRDF for one view direction and roughness; they do not depend
+// on the LTC, so they are taken once per texel instead of once per error evaluation
+struct BrdfSamples
+{
+	const Brdf& brdf;
+	vec3 V;
+	float alpha;
+	vector<vec3> L;
+	vector<float> value, pdf;
+
+	float norm = 0.0f; // BRDF norm
+	float fresnel = 0.0f; // Fresnel weighted norm
+	vec3 averageDir; // average direction of the BRDF
+
+	BrdfSamples(const Brdf& brdf, const vec3& V, float alpha) : brdf(brdf), V(V), alpha(alpha)
+	{
+		averageDir = vec3(0.0f);
+		for (int j = 0; j < numSamples; j++)
+		{
+			for (int i = 0; i < numSamples; i++)
+			{
+				auto l = brdf.sample(V, alpha, (i + 0.5f) / numSamples, (j + 0.5f) / numSamples);
+				float p;
+				auto v = brdf.eval(V, l, alpha, p);
+				L.push_back(l);
+				value.push_back(v);
+				pdf.push_back(p);
+				if (p <= 0.0f)
+					continue;
+				auto weight = v / p;
+				auto H = glm::normalize(V + l);
+				norm += weight;
+				fresnel += weight * pow(1.0f - std::max(glm::dot(V, H), 0.0f), 5.0f);
+				averageDir += weight * l;
+			}
+		}
+		norm /= (float)L.size();
+		fresnel /= (float)L.size();
+		averageDir.y = 0.0f; // zero for isotropic BRDFs
+		averageDir = glm::normalize(averageDir);
+	}
+};
+
+// cubed difference of the LTC and the BRDF, integrated with samples of both (multiple importance sampling)
+float fitError(const LTC& ltc, const BrdfSamples& samples)
+{
+	double error = 0.0;
+	auto add = [&](const vec3& L, float valueBrdf, float pdfBrdf)
+	{
+		auto valueLtc = ltc.eval(L);
+		double difference = fabs(valueBrdf - valueLtc);
+		error += difference * difference * difference / (valueLtc / ltc.magnitude + pdfBrdf);
+	};
+	for (size_t i = 0; i < cosineSamples.size(); i++)
+	{
+		auto L = ltc.sample(cosineSamples[i]);
+		float pdfBrdf;
+		auto valueBrdf = samples.brdf.eval(samples.V, L, samples.alpha, pdfBrdf);
+		add(L, valueBrdf, pdfBrdf);
+	}
+	for (size_t i = 0; i < samples.L.size(); i++)
+		add(samples.L[i], samples.value[i], samples.pdf[i]);
+	return (float)(error / cosineSamples.size());
+}
+
+// Minimum of f around start with the Nelder-Mead simplex method; delta is the initial simplex size
+template<int DIM, typename F>
+float nelderMead(float* result, const float* start, float delta, float tolerance, int maxIterations, F f)
+{
+	const int POINTS = DIM + 1;
+	float s[POINTS][DIM], values[POINTS];
+	for (int i = 0; i < POINTS; i++)
+	{
+		std::copy(start, start + DIM, s[i]);
+		if (i > 0)
+			s[i][i - 1] += delta;
+		values[i] = f(s[i]);
+	}
+
+	int lo = 0;
+	for (int iteration = 0; iteration < maxIterations; iteration++)
+	{
+		// lowest, highest and second highest point
+		int hi = 0, nh = 0;
+		lo = 0;
+		for (int i = 1; i < POINTS; i++)
+		{
+			if (values[i] < values[lo])
+				lo = i;
+			if (values[i] > values[hi])
+				hi = i;
+		}
+		nh = lo;
+		for (int i = 0; i < POINTS; i++)
+			if (i != hi && values[i] > values[nh])
+				nh = i;
+
+		auto a = fabs(values[lo]), b = fabs(values[hi]);
+		if (2.0f * fabs(a - b) < (a + b) * tolerance)
+			break;
+
+		// centroid of all points but the highest
+		float o[DIM] = {};
+		for (int i = 0; i < POINTS; i++)
+			for (int k = 0; i != hi && k < DIM; k++)
+				o[k] += s[i][k] / DIM;
+
+		auto along = [&](float t, float* p)
+		{
+			for (int k = 0; k < DIM; k++)
+				p[k] = o[k] + t * (o[k] - s[hi][k]);
+			return f(p);
+		};
+		auto replace = [&](const float* p, float value)
+		{
+			std::copy(p, p + DIM, s[hi]);
+			values[hi] = value;
+		};
+
+		float r[DIM], e[DIM], c[DIM];
+		auto valueR = along(1.0f, r); // reflection
+		if (valueR < values[nh])
+		{
+			float valueE;
+			if (valueR < values[lo] && (valueE = along(2.0f, e)) < valueR) // expansion
+				replace(e, valueE);
+			else
+				replace(r, valueR);
+			continue;
+		}
+		auto valueC = along(-0.5f, c); // contraction
+		if (valueC < values[hi])
+		{
+			replace(c, valueC);
+			continue;
+		}
+		for (int i = 0; i < POINTS; i++) // shrink towards the lowest point
+		{
+			if (i == lo)
+				continue;
+			for (int k = 0; k < DIM; k++)
+				s[i][k] = s[lo][k] + 0.5f * (s[i][k] - s[lo][k]);
+			values[i] = f(s[i]);
+		}
+	}
+	std::copy(s[lo], s[lo] + DIM, result);
+	return values[lo];
+}
+
+struct Cell
+{
+	mat3 M;
+	float norm, fresnel;
+};
+
+// Fits the view angles of roughness column a in order, each starting from the previous one.
+// The column of roughness 1 starts from the cosine distribution, the others from alpha.
+void fitColumn(const Brdf& brdf, int a, int size, vector<Cell>& cells)
+{
+	LTC ltc;
+	for (int t = 0; t < size; t++)
+	{
+		// parameterized by sqrt(1 - cos(theta)), roughness = sqrt(alpha)
+		auto x = t / float(size - 1);
+		auto theta = std::min(1.57f, acos(1.0f - x * x));
+		auto V = vec3(sin(theta), 0.0f, cos(theta));
+		auto roughness = a / float(size - 1);
+		auto alpha = std::max(roughness * roughness, MIN_ALPHA);
+
+		BrdfSamples samples(brdf, V, alpha);
+		ltc.magnitude = samples.norm;
+		ltc.fresnel = samples.fresnel;
+		auto& averageDir = samples.averageDir;
+
+		// at normal incidence the lobe is isotropic around Z
+		auto isotropic = t == 0;
+		if (isotropic)
+		{
+			ltc.X = vec3(1, 0, 0);
+			ltc.Y = vec3(0, 1, 0);
+			ltc.Z = vec3(0, 0, 1);
+			ltc.m11 = ltc.m22 = a == size - 1 ? 1.0f : alpha;
+			ltc.m13 = 0.0f;
+		}
+		else
+		{
+			ltc.X = vec3(averageDir.z, 0, -averageDir.x);
+			ltc.Y = vec3(0, 1, 0);
+			ltc.Z = averageDir;
+		}
+		ltc.update();
+
+		auto apply = [&](const float* p)
+		{
+			ltc.m11 = std::max(p[0], 1e-7f);
+			ltc.m22 = isotropic ? ltc.m11 : std::max(p[1], 1e-7f);
+			ltc.m13 = isotropic ? 0.0f : p[2];
+			ltc.update();
+		};
+		float start[3] = { ltc.m11, ltc.m22, ltc.m13 }, best[3];
+		// the simplex must not be much larger than the lobe, which is alpha wide near roughness 0
+		nelderMead<3>(best, start, std::min(0.05f, ltc.m11), 1e-5f, 100, [&](const float* p)
+		{
+			apply(p);
+			return fitError(ltc, samples);
+		});
+		apply(best);
+
+		auto& cell = cells[a + t * size];
+		cell.M = ltc.M;
+		// the y row and column are 0 for isotropic BRDFs
+		cell.M[0][1] = cell.M[1][0] = cell.M[2][1] = cell.M[1][2] = 0.0f;
+		cell.norm = ltc.magnitude;
+		cell.fresnel = ltc.fresnel;
+	}
+}
+
+// Form factor of a sphere around the direction of elevation cos z with sin^2(half angle)
+// formFactor, clipped by the horizon and divided by formFactor [Snyder 1996]
+float sphereClipping(float z, float formFactor)
+{
+	double s2 = std::max(formFactor, 1e-5f), c = z, s = sqrt(std::max(0.0, 1.0 - c * c));
+	if (c * c >= s2)
+		return (float)std::max(c, 0.0);
+	auto x = sqrt(1.0 / s2 - 1.0); // cot of the half angle
+	auto y = -x * c / std::max(s, 1e-9);
+	auto sy = s * sqrt(std::max(0.0, 1.0 - y * y));
+	auto illuminance = (c * acos(glm::clamp(y, -1.0, 1.0)) - x * sy) * s2 + atan2(sy, x);
+	return (float)(std::max(illuminance, 0.0) / (3.14159265358979 * s2));
+}
+
+// largest and mean absolute difference of component c of two size x size RGBA tables
+void compare(const char* name, const vector<float>& fit, const vector<float>& reference, int c)
+{
+	float maxDifference = 0.0f;
+	double sum = 0.0;
+	size_t n = fit.size() / 4;
+	for (size_t i = 0; i < n; i++)
+	{
+		auto difference = fabs(fit[4 * i + c] - reference[4 * i + c]);
+		maxDifference = std::max(maxDifference, difference);
+		sum += difference;
+	}
+	cout << "  " << left << setw(12) << name << right << " max " << setw(10) << maxDifference << "  mean " << setw(10) << sum / n << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+	string brdfName = "ggx", output;
+	int size = 64;
+	size_t numThreads = thread::hardware_concurrency();
+	bool halfFloat = false, valid = true;
+	for (int i = 1; i < argc && valid; i++)
+	{
+		string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--half")
+			halfFloat = true;
+		else if (arg[0] != '-')
+			output = arg;
+		else if (!value)
+			valid = false;
+		else if (arg == "--brdf")
+			brdfName = argv[++i];
+		else if (arg == "--size")
+			valid = (size = atoi(argv[++i])) >= 2 && size <= 1024;
+		else if (arg == "--samples")
+			valid = (numSamples = atoi(argv[++i])) >= 4;
+		else if (arg == "--threads")
+			valid = (numThreads = (size_t)atoi(argv[++i])) >= 1;
+		else
+			valid = false;
+	}
+	unique_ptr<Brdf> brdf;
+	if (brdfName == "ggx")
+		brdf.reset(new BrdfGGX());
+	else if (brdfName == "beckmann")
+		brdf.reset(new BrdfBeckmann());
+	if (!valid || !brdf)
+	{
+		cout << "usage: " << argv[0] << " [--brdf ggx|beckmann] [--size n] [--samples n] [--threads n] [--half] [output]" << endl;
+		return -1;
+	}
+	if (output.empty())
+		output = "../CS6610_Final_Project_Area_Lights/resources/ltc/" + brdfName + to_string(size) + (halfFloat ? "_f16.ltc" : "_f32.ltc");
+
+	auto start = chrono::high_resolution_clock::now();
+	makeCosineSamples();
+	vector<Cell> cells((size_t)size * size);
+	{
+		ThreadPool pool(numThreads);
+		vector<future<void>> columns;
+		// rough columns converge fastest, start with the smooth ones so the long tasks do not come last
+		for (int a = 0; a < size; a++)
+			columns.push_back(pool.submit([&, a] { fitColumn(*brdf, a, size, cells); }));
+		for (auto& column : columns)
+			column.get();
+	}
+	auto seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	vector<float> ltc1((size_t)size * size * 4), ltc2((size_t)size * size * 4);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			auto i = (size_t)y * size + x;
+			auto& cell = cells[i];
+			auto invM = glm::inverse(cell.M);
+			invM /= invM[1][1];
+			ltc1[4 * i + 0] = invM[0][0];
+			ltc1[4 * i + 1] = invM[0][2];
+			ltc1[4 * i + 2] = invM[2][0];
+			ltc1[4 * i + 3] = invM[2][2];
+
+			// the sphere table is indexed by (z * 0.5 + 0.5, form factor) instead
+			ltc2[4 * i + 0] = cell.norm;
+			ltc2[4 * i + 1] = cell.fresnel;
+			ltc2[4 * i + 2] = 0.0f;
+			ltc2[4 * i + 3] = sphereClipping(2.0f * x / (size - 1) - 1.0f, y / float(size - 1));
+		}
+	}
+	cout << brdfName << " " << size << "x" << size << ", " << numSamples << "x" << numSamples << " samples, " << numThreads
+		<< " threads: " << fixed << setprecision(2) << seconds << " s\n";
+
+	if (brdfName == "ggx")
+	{
+		auto reference1 = size == 64 ? vector<float>(LTC1, LTC1 + 64 * 64 * 4) : LTCTable::resample(LTC1, 64, size);
+		auto reference2 = size == 64 ? vector<float>(LTC2, LTC2 + 64 * 64 * 4) : LTCTable::resample(LTC2, 64, size);
+		cout << "difference to LTC.h" << (size == 64 ? "" : " resampled") << ":\n" << fixed << setprecision(5);
+		const char* names1[] = { "LTC1.m00", "LTC1.m20", "LTC1.m02", "LTC1.m22" };
+		for (int c = 0; c < 4; c++)
+			compare(names1[c], ltc1, reference1, c);
+		compare("norm", ltc2, reference2, 0);
+		compare("fresnel", ltc2, reference2, 1);
+		compare("sphere", ltc2, reference2, 3);
+	}
+
+	if (!LTCTable::write(output, (uint32_t)size, halfFloat, brdfName == "ggx" ? LTCTable::Brdf::GGX : LTCTable::Brdf::Beckmann, ltc1.data(), ltc2.data()))
+	{
+		cout << "Fail to write " << output << endl;
+		return -1;
+	}
+	cout << "written to " << output << endl;
+	return 0;
+}
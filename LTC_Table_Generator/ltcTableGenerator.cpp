@@ -0,0 +1,90 @@
+// --------------------------------------------------------------------------------
+// Offline generator of the LTC table files the renderer loads (see ltcTable.h), from the
+// GGX fit in LTC.h. The fit is 64x64; other sizes are resampled bilinearly from it, so they
+// trade accuracy for a smaller table rather than adding any; LTC_Fitter fits other sizes directly.
+// Every written file is loaded back and compared with the fit.
+//
+// usage: LTC_Table_Generator [--size <n>] [--half] [output]
+//   --size   texels per side, 32, 64 or 128 (default 64)
+//   --half   pack the texels as 16 bit floats (RGBA16F)
+//   default output: ../CS6610_Final_Project_Area_Lights/resources/ltc/ggx<size>_<f16|f32>.ltc
+// build without Visual Studio:
+//   g++ -std=c++14 -O2 -I../CS6610_Final_Project_Area_Lights -I../CS6610_Final_Project_Area_Lights/includes
+//       ltcTableGenerator.cpp -o ltcTableGenerator
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include "LTC.h" // LTC1 and LTC2
+#include "ltcTable.h"
+
+using namespace std;
+
+const uint32_t FIT_SIZE = 64;
+
+int main(int argc, char* argv[])
+{
+	uint32_t size = FIT_SIZE;
+	bool halfFloat = false;
+	string output;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc)
+			size = (uint32_t)atoi(argv[++i]);
+		else if (arg == "--half")
+			halfFloat = true;
+		else if (arg[0] != '-')
+			output = arg;
+		else
+		{
+			cout << "usage: " << argv[0] << " [--size <32|64|128>] [--half] [output]" << endl;
+			return arg == "--help" || arg == "-h" ? 0 : -1;
+		}
+	}
+	if (size != 32 && size != 64 && size != 128)
+	{
+		cout << "Unsupported table size " << size << ", use 32, 64 or 128" << endl;
+		return -1;
+	}
+	if (output.empty())
+		output = "../CS6610_Final_Project_Area_Lights/resources/ltc/ggx" + to_string(size) + (halfFloat ? "_f16.ltc" : "_f32.ltc");
+
+	vector<float> ltc1(LTC1, LTC1 + FIT_SIZE * FIT_SIZE * 4), ltc2(LTC2, LTC2 + FIT_SIZE * FIT_SIZE * 4);
+	if (size != FIT_SIZE)
+	{
+		ltc1 = LTCTable::resample(LTC1, FIT_SIZE, size);
+		ltc2 = LTCTable::resample(LTC2, FIT_SIZE, size);
+	}
+	if (!LTCTable::write(output, size, halfFloat, LTCTable::Brdf::GGX, ltc1.data(), ltc2.data()))
+	{
+		cout << "Fail to write " << output << endl;
+		return -1;
+	}
+
+	// load it back, the largest difference shows the cost of the half float packing
+	LTCTable table;
+	if (!table.load(output) || table.size != size || table.halfFloat != halfFloat || table.brdf != LTCTable::Brdf::GGX)
+	{
+		cout << "Fail to load " << output << " back" << endl;
+		return -1;
+	}
+	float maxError[2] = { 0.0f, 0.0f };
+	for (int index = 0; index < 2; index++)
+	{
+		auto& expected = index == 0 ? ltc1 : ltc2;
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			auto value = halfFloat ? glm::unpackHalf1x16(((const uint16_t*)table.texels(index))[i]) : ((const float*)table.texels(index))[i];
+			maxError[index] = max(maxError[index], fabs(value - expected[i]));
+		}
+	}
+	cout << output << ": " << size << "x" << size << (halfFloat ? " RGBA16F, " : " RGBA32F, ")
+		<< LTCTable::fileBytes(size, halfFloat) << " bytes, max error LTC1 " << maxError[0]
+		<< " LTC2 " << maxError[1] << endl;
+	return 0;
+}
@@ -0,0 +1,255 @@
+// --------------------------------------------------------------------------------
+// Offline converter from the material images under resources/textures to KTX2 files
+// with block compressed mip chains, written next to the sources (name.jpg -> name.ktx2).
+// AssetLoader uploads a KTX2 file directly when it exists and falls back to the image.
+//   *_Color.*   BC7 in sRGB (BC1 with --bc1), mipmaps filtered in linear space
+//   *_Normal.*  BC5 with the x and y components, z is reconstructed in the shader
+//   others      BC4 from the red channel (roughness, AO, metalness, displacement)
+// Files whose KTX2 is newer than the image are skipped unless --force is given.
+//
+// usage: Texture_Converter [--bc1] [--force] [directories or images...]
+//   default directory: ../CS6610_Final_Project_Area_Lights/resources/textures
+// build without Visual Studio:
+//   g++ -std=c++17 -O2 -pthread -I../CS6610_Final_Project_Area_Lights
+//       -I../CS6610_Final_Project_Area_Lights/includes textureConverter.cpp -o textureConverter
+// --------------------------------------------------------------------------------
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "blockCompression.h"
+#include "ktx2.h"
+#include "threadPool.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+enum class MapKind { Color, Normal, Data };
+
+// RGBA image with float channels: linear color, [-1, 1] normals or [0, 1] data
+struct Image
+{
+	int width = 0, height = 0;
+	vector<float> pixels;
+
+	float* at(int x, int y) { return &pixels[4 * ((size_t)y * width + x)]; }
+};
+
+float srgbToLinear(float v)
+{
+	return v <= 0.04045f ? v / 12.92f : pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float v)
+{
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * pow(v, 1.0f / 2.4f) - 0.055f;
+}
+
+MapKind classify(const string& name)
+{
+	if (name.find("_Color") != string::npos)
+		return MapKind::Color;
+	if (name.find("_Normal") != string::npos)
+		return MapKind::Normal;
+	return MapKind::Data;
+}
+
+Image decode(const unsigned char* data, int width, int height, MapKind kind)
+{
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < image.pixels.size(); i++)
+	{
+		float v = data[i] / 255.0f;
+		if (kind == MapKind::Color && i % 4 != 3)
+			v = srgbToLinear(v);
+		else if (kind == MapKind::Normal && i % 4 != 3)
+			v = v * 2.0f - 1.0f;
+		image.pixels[i] = v;
+	}
+	return image;
+}
+
+// 2x2 box filter, odd edges reuse the last row or column
+Image downsample(Image& source, MapKind kind)
+{
+	Image image;
+	image.width = max(1, source.width / 2);
+	image.height = max(1, source.height / 2);
+	image.pixels.resize((size_t)image.width * image.height * 4);
+	for (int y = 0; y < image.height; y++)
+		for (int x = 0; x < image.width; x++)
+		{
+			float* out = image.at(x, y);
+			for (int dy = 0; dy < 2; dy++)
+				for (int dx = 0; dx < 2; dx++)
+				{
+					float* in = source.at(min(2 * x + dx, source.width - 1), min(2 * y + dy, source.height - 1));
+					for (int c = 0; c < 4; c++)
+						out[c] += in[c] / 4.0f;
+				}
+			if (kind == MapKind::Normal)
+			{
+				float length = sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+				for (int c = 0; c < 3 && length > 0.0f; c++)
+					out[c] /= length;
+			}
+		}
+	return image;
+}
+
+unsigned char encodeChannel(float v, int channel, MapKind kind)
+{
+	if (kind == MapKind::Color && channel != 3)
+		v = linearToSrgb(v);
+	else if (kind == MapKind::Normal && channel != 3)
+		v = v * 0.5f + 0.5f;
+	return (unsigned char)lround(min(1.0f, max(0.0f, v)) * 255.0f);
+}
+
+// append the blocks of one level to the texture
+void compressLevel(Image& image, MapKind kind, ktx2::Texture& texture)
+{
+	ktx2::Level level;
+	level.width = image.width;
+	level.height = image.height;
+	level.offset = texture.data.size();
+	level.size = ktx2::levelBytes(texture.format, image.width, image.height);
+	texture.data.resize(level.offset + level.size);
+
+	auto blockBytes = ktx2::blockBytes(texture.format);
+	auto out = texture.data.data() + level.offset;
+	for (int by = 0; by < image.height; by += 4)
+		for (int bx = 0; bx < image.width; bx += 4, out += blockBytes)
+		{
+			uint8_t block[64];
+			for (int i = 0; i < 16; i++)
+			{
+				float* pixel = image.at(min(bx + i % 4, image.width - 1), min(by + i / 4, image.height - 1));
+				for (int c = 0; c < 4; c++)
+					block[i * 4 + c] = encodeChannel(pixel[c], c, kind);
+			}
+			switch (texture.format)
+			{
+			case ktx2::BC1_RGB_SRGB: bc::encodeBC1(block, out); break;
+			case ktx2::BC4_UNORM: bc::encodeBC4(block, out); break;
+			case ktx2::BC5_UNORM: bc::encodeBC5(block, out); break;
+			default: bc::encodeBC7(block, out); break;
+			}
+		}
+	texture.levels.push_back(level);
+}
+
+string convert(const fs::path& source, const fs::path& target, bool useBC1)
+{
+	auto start = chrono::high_resolution_clock::now();
+	auto kind = classify(source.filename().string());
+
+	// bottom-up rows like the runtime loader, which uploads the image as it is
+	stbi_set_flip_vertically_on_load_thread(true);
+	int width, height, components;
+	auto data = stbi_load(source.string().c_str(), &width, &height, &components, 4);
+	if (!data)
+		return "Fail to load " + source.string();
+	auto image = decode(data, width, height, kind);
+	stbi_image_free(data);
+
+	ktx2::Texture texture;
+	texture.format = kind == MapKind::Color ? (useBC1 ? ktx2::BC1_RGB_SRGB : ktx2::BC7_SRGB)
+		: kind == MapKind::Normal ? ktx2::BC5_UNORM : ktx2::BC4_UNORM;
+	texture.width = width;
+	texture.height = height;
+	size_t uncompressed = 0;
+	while (true)
+	{
+		compressLevel(image, kind, texture);
+		uncompressed += (size_t)image.width * image.height * 4;
+		if (image.width == 1 && image.height == 1)
+			break;
+		image = downsample(image, kind);
+	}
+
+	if (!ktx2::write(target.string(), texture))
+		return "Fail to write " + target.string();
+
+	const char* formatNames[] = { "BC7 sRGB", "BC1 sRGB", "BC5", "BC4" };
+	auto formatName = formatNames[texture.format == ktx2::BC7_SRGB ? 0 : texture.format == ktx2::BC1_RGB_SRGB ? 1
+		: texture.format == ktx2::BC5_UNORM ? 2 : 3];
+	ostringstream report;
+	report << fixed << setprecision(1) << target.string() << ": " << width << "x" << height << " " << formatName << ", "
+		<< texture.levels.size() << " levels, " << texture.data.size() / 1024.0 / 1024.0 << " MB (RGBA8 "
+		<< uncompressed / 1024.0 / 1024.0 << " MB) in "
+		<< chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << " ms";
+	return report.str();
+}
+
+bool isImage(const fs::path& path)
+{
+	auto extension = path.extension().string();
+	return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga";
+}
+
+int main(int argc, char* argv[])
+{
+	bool useBC1 = false, force = false;
+	vector<fs::path> inputs;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--bc1")
+			useBC1 = true;
+		else if (arg == "--force")
+			force = true;
+		else if (arg == "--help" || arg == "-h")
+		{
+			cout << "usage: " << argv[0] << " [--bc1] [--force] [directories or images...]" << endl;
+			return 0;
+		}
+		else
+			inputs.push_back(arg);
+	}
+	if (inputs.empty())
+		inputs.push_back("../CS6610_Final_Project_Area_Lights/resources/textures");
+
+	vector<fs::path> sources;
+	for (auto& input : inputs)
+	{
+		error_code error;
+		if (fs::is_directory(input, error))
+		{
+			for (auto& entry : fs::recursive_directory_iterator(input))
+				if (entry.is_regular_file() && isImage(entry.path()))
+					sources.push_back(entry.path());
+		}
+		else if (fs::exists(input, error))
+			sources.push_back(input);
+		else
+			cout << "No such file or directory: " << input.string() << endl;
+	}
+
+	ThreadPool pool(thread::hardware_concurrency());
+	vector<future<string>> reports;
+	for (auto& source : sources)
+	{
+		auto target = fs::path(source).replace_extension(".ktx2");
+		error_code error;
+		if (!force && fs::exists(target, error) && fs::last_write_time(target) >= fs::last_write_time(source))
+			continue;
+		reports.push_back(pool.submit([source, target, useBC1] { return convert(source, target, useBC1); }));
+	}
+	for (auto& report : reports)
+		cout << report.get() << endl;
+	cout << reports.size() << " textures converted, " << sources.size() - reports.size() << " up to date" << endl;
+	return 0;
+}
@@ -0,0 +1,17 @@
+﻿#version 460 core
+
+// shows the interpolated normal and texture coordinates, so both vertex formats can be compared
+in VS_OUT
+{
+	vec3 fragPos;
+	vec3 normal;
+	vec2 texCoords;
+} fs_in;
+
+out vec4 fragColor;
+
+void main()
+{
+	// the bench grid's UVs span [0, 4]; scale instead of fract so quantization near an integer cannot wrap
+	fragColor = vec4(normalize(fs_in.normal) * 0.5 + 0.5, fs_in.texCoords.x * 0.25);
+}
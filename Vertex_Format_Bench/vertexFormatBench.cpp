@@ -0,0 +1,163 @@
+// --------------------------------------------------------------------------------
+// GPU benchmark of the two vertex formats in mesh.h on a dense receiver mesh.
+// A wavy grid is uploaded as 56-byte Vertex and as 24-byte CompactVertex and drawn
+// repeatedly into an offscreen target with ltc.vert; the report lists buffer sizes,
+// GPU time per draw and the largest difference of the shaded normals and UVs.
+//
+// usage: Vertex_Format_Bench [gridSize] [draws]
+//   run from this directory, the shaders are read from ../CS6610_Final_Project_Area_Lights
+// build without Visual Studio (Linux, EGL):
+//   g++ -std=c++14 -O2 -I../CS6610_Final_Project_Area_Lights -I../CS6610_Final_Project_Area_Lights/includes
+//       vertexFormatBench.cpp ../CS6610_Final_Project_Area_Lights/includes/glad/glad.c -lEGL -ldl -o vertexFormatBench
+// --------------------------------------------------------------------------------
+
+#include "headless.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh.h"
+
+using namespace std;
+
+const GLsizei TARGET_SIZE = 1024;
+
+// height field z = a sin(kx) cos(ky) over [-1, 1]^2 with analytic tangent frames
+void makeGrid(GLuint size, vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+	const float a = 0.05f, k = 12.0f;
+	vertices.resize((size_t)size * size);
+	for (GLuint y = 0; y < size; y++)
+		for (GLuint x = 0; x < size; x++)
+		{
+			float u = x / float(size - 1), v = y / float(size - 1);
+			float px = u * 2.0f - 1.0f, py = v * 2.0f - 1.0f;
+			float dzdx = a * k * cos(k * px) * cos(k * py);
+			float dzdy = -a * k * sin(k * px) * sin(k * py);
+			auto& vertex = vertices[(size_t)y * size + x];
+			vertex.Position = glm::vec3(px, py, a * sin(k * px) * cos(k * py));
+			vertex.Tangent = glm::normalize(glm::vec3(1.0f, 0.0f, dzdx));
+			vertex.Bitangent = glm::normalize(glm::vec3(0.0f, 1.0f, dzdy));
+			vertex.Normal = glm::normalize(glm::cross(vertex.Tangent, vertex.Bitangent));
+			vertex.TexCoords = glm::vec2(u * 4.0f, v * 4.0f);
+		}
+
+	indices.clear();
+	indices.reserve((size_t)(size - 1) * (size - 1) * 6);
+	for (GLuint y = 0; y + 1 < size; y++)
+		for (GLuint x = 0; x + 1 < size; x++)
+		{
+			GLuint i = y * size + x;
+			indices.insert(indices.end(), { i, i + 1, i + size, i + 1, i + size + 1, i + size });
+		}
+}
+
+struct Result
+{
+	size_t vertexBytes;
+	double gpuMs;
+	vector<unsigned char> image;
+};
+
+Result run(VertexFormat format, const vector<Vertex>& vertices, const vector<GLuint>& indices, GLint draws)
+{
+	Mesh mesh(vertices.data(), vertices.size(), indices.data(), indices.size(), {}, {}, 32.0f, format);
+	ShaderDefines defines;
+	if (format == VertexFormat::Compact)
+		defines["COMPACT_VERTEX"] = "1";
+	Shader shader("../CS6610_Final_Project_Area_Lights/ltc.vert", "normals.frag", nullptr, nullptr, nullptr, defines);
+	shader.use();
+	shader.uniform("model").set(glm::rotate(glm::mat4(1.0f), glm::radians(-60.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+	shader.uniform("view").set(glm::lookAt(glm::vec3(0.0f, 0.0f, 2.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+	shader.uniform("projection").set(glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f));
+
+	// warm up, then time all draws with one query
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	mesh.draw(shader);
+	glFinish();
+	GLuint query;
+	glGenQueries(1, &query);
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	for (GLint i = 0; i < draws; i++)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		mesh.draw(shader);
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+	glDeleteQueries(1, &query);
+
+	Result result;
+	result.vertexBytes = mesh.vertexBytes();
+	result.gpuMs = elapsed / 1e6 / draws;
+	result.image.resize((size_t)TARGET_SIZE * TARGET_SIZE * 4);
+	glReadPixels(0, 0, TARGET_SIZE, TARGET_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, result.image.data());
+
+	glDeleteVertexArrays(1, &mesh.VAO);
+	glDeleteBuffers(1, &mesh.VBO);
+	glDeleteBuffers(1, &mesh.EBO);
+	shader.deleteProgram();
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	GLuint gridSize = argc > 1 ? (GLuint)atoi(argv[1]) : 1024;
+	GLint draws = argc > 2 ? atoi(argv[2]) : 20;
+	gridSize = std::max(gridSize, 2u);
+	draws = std::max(draws, 1);
+
+	HeadlessContext context;
+	if (!context.create())
+		return 1;
+	ProgramBinaryCache::instance().enabled = false;
+
+	GLuint framebuffer, color, depth;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenTextures(1, &color);
+	glBindTexture(GL_TEXTURE_2D, color);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, TARGET_SIZE, TARGET_SIZE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, TARGET_SIZE, TARGET_SIZE);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+	glEnable(GL_DEPTH_TEST);
+
+	vector<Vertex> vertices;
+	vector<GLuint> indices;
+	makeGrid(gridSize, vertices, indices);
+	cout << "Grid " << gridSize << "x" << gridSize << ": " << vertices.size() << " vertices, " << indices.size() / 3
+		<< " triangles, " << draws << " draws into " << TARGET_SIZE << "x" << TARGET_SIZE << endl;
+
+	auto full = run(VertexFormat::Full, vertices, indices, draws);
+	auto compact = run(VertexFormat::Compact, vertices, indices, draws);
+
+	// largest channel difference of the normals and UVs, in 1/255 steps
+	int maxDifference = 0;
+	for (size_t i = 0; i < full.image.size(); i++)
+		maxDifference = std::max(maxDifference, std::abs(full.image[i] - compact.image[i]));
+
+	cout << fixed << setprecision(3);
+	cout << "Full    (" << sizeof(Vertex) << " B): " << full.vertexBytes / 1048576.0 << " MB vertex buffer, " << full.gpuMs << " ms per draw" << endl;
+	cout << "Compact (" << sizeof(CompactVertex) << " B): " << compact.vertexBytes / 1048576.0 << " MB vertex buffer, " << compact.gpuMs << " ms per draw" << endl;
+	cout << "Vertex memory " << (double)full.vertexBytes / compact.vertexBytes << "x smaller, draws "
+		<< full.gpuMs / compact.gpuMs << "x faster, max image difference " << maxDifference << "/255" << endl;
+
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteTextures(1, &color);
+	glDeleteFramebuffers(1, &framebuffer);
+	context.destroy();
+	return 0;
+}